@@ -11,39 +11,68 @@
 #include "os/bind_table.h"
 #include "os/table_base.hpp"
 #include "net/protocol.h" 
+#include "net/rpc_channel.h"
+#include "net/transport.h"
+
+// 请求来自的连接（TCP 或同机共享内存），回复由处理它的线程经同一连接发回
+using PeerRef = std::shared_ptr<Transport>;
 
 // [0x01] DSM_MSG_JOIN_REQ
-// 接收者：Manager (Leader)
-// 作用：记录新节点，分配ID，准备回复 ACK
-void process_join_req(int sock, const dsm_header_t& head);
+// 接收者：本节点的计算进程与 barrier 树中各子节点的守护进程（os/barrier_tree.h）
+// 作用：合并各到达方写过的页；到齐后根节点回复带全体写通知的 ACK，其他节点向父节点发送一条 JOIN_REQ，收到 ACK 后转发给子树
+void process_join_req(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
 // [0x10] DSM_MSG_PAGE_REQ
 // 接收者：Manager 或 Owner
 // 作用：
 // 1. 如果我是 Owner：直接发回 DSM_MSG_PAGE_REP (带数据, unused=1)
 // 2. 如果我不是：发回 DSM_MSG_PAGE_REP (带重定向ID, unused=0)
-void process_page_req(int sock, const dsm_header_t& head, rio_t &rp);
+void process_page_req(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
-// [0x20] DSM_MSG_LOCK_ACQ
-// 接收者：Manager
-// 作用：查 LockTable，如果空闲则授予 (发LOCK_REP)，如果占用则加入队列
-void process_lock_acq(int sock, const dsm_header_t& head, rio_t &rp);
+// [0x14] DSM_MSG_PAGE_BATCH_REQ
+// 接收者：Manager 或 Owner
+// 作用：对列表中的每一页按 PAGE_REQ 的规则处理，用一条 DSM_MSG_PAGE_BATCH_REP
+//       按请求顺序返回：能提供的页带数据，其余返回重定向 ID
+void process_page_batch_req(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
+// [0x12] DSM_MSG_PAGE_INV
+// 接收者：只读副本持有者
+// 作用：丢弃本地副本（PROT_NONE），回复 ACK
+void process_page_inv(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
+// [0x13] DSM_MSG_PAGE_DIFF
+// 接收者：多写者页面的 home（即 manager）
+// 作用：把各写者的 run-length diff 合并进 home 副本，回复 ACK
+void process_page_diff(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
+// [0x20] DSM_MSG_LOCK_ACQ
+// 接收者：Manager
+// 作用：查 LockTable，如果可以授予则发 LOCK_REP（读请求可与其他读者共享），否则加入队列
+void process_lock_acq(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
+
+// [0x22] DSM_MSG_LOCK_RLS
+// 接收者：Manager
+// 作用：记下持有者写过的页（读者释放不带页），回复 ACK；锁因此可以转交时向队首（或队首的一串读请求）发送 LOCK_REP
+void process_lock_rls(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
-void process_lock_rls(int sock, const dsm_header_t& head, rio_t &rp);
+// [0x23] DSM_MSG_LOCK_RECALL
+// 接收者：缓存着锁令牌的节点
+// 作用：令牌空闲时交回并在 ACK 中带上持有期间写过的页；锁正在使用时回复稍后交回，由释放时的 LOCK_RLS 交回
+void process_lock_recall(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
 // [0x30] DSM_MSG_OWNER_UPDATE
 // 接收者：Manager
-// 作用：收到 RealOwner 的通知，更新 Directory 中的 owner_id
-void process_owner_update(int sock, const dsm_header_t& head, rio_t &rp);
+// 作用：收到 RealOwner 的通知，更新 Directory 中的 owner_id（写）或 copyset（读）
+//       写更新时先失效 copyset 中的全部只读副本，再回复 ACK
+void process_owner_update(const PeerRef &peer, const dsm_header_t& head, RpcMessage &msg);
 
 // =========================================================================
 // 2. 监听服务入口 (Daemon)
 // =========================================================================
+// 一个 epoll 反应器线程接受连接、非阻塞读入完整报文；一个线程服务所有同机节点的共享内存段；
+// 页面、所有权与 diff 请求交给 DaemonThreads 个工作线程处理，JOIN / 锁 / PAGE_INV 不等待其他节点，
+// 直接在读到它的线程上处理
 void dsm_start_daemon(int port);
-void peer_handler(int connfd); 
 
 
 #endif // DSM_STATE_HPP
\ No newline at end of file
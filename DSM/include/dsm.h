@@ -8,6 +8,7 @@
 
 
 #define PAGESIZE 4096
+#define DSM_BLOCK_MAX (2 * 1024 * 1024)     // dsm_malloc_block 允许的最大一致性块
 
 
 struct PageTable;
@@ -28,6 +29,16 @@ extern void *SharedAddrBase;                //
 extern int ProcNum;                         // 
 extern int WorkerNodeNum;                   // 
 extern std::vector<std::string> WorkerNodeIps;  // 
+extern int MultiWriter;                     // 1: twin/diff 多写者协议（环境变量 DSM_MULTI_WRITER）
+extern int PrefetchMax;                     // 顺序/跨步缺页时最多预取的页数，0 关闭（环境变量 DSM_PREFETCH_MAX）
+extern int PageCodec;                       // 页面传输请求的压缩编码：0 原始 / 1 LZ / 2 shuffle+RLE（环境变量 DSM_PAGE_CODEC）
+extern int FaultThreads;                    // userfaultfd 缺页服务线程数，0 表示不用 userfaultfd，所有缺页由 SIGSEGV 的服务线程调页（环境变量 DSM_FAULT_THREADS）
+extern int DaemonThreads;                   // 守护进程处理页面请求的工作线程数（环境变量 DSM_DAEMON_THREADS）
+extern int DaemonUring;                     // 1: 守护进程的 TCP 连接由 io_uring 事件循环处理（环境变量 DSM_DAEMON_URING）
+extern int LocalShm;                        // 1: 同机节点之间走共享内存环而不是 TCP（环境变量 DSM_LOCAL_SHM）
+extern int ControlUdp;                      // 1: 锁、barrier 与 OWNER_UPDATE 走可靠 UDP，不排在 TCP 上的页面数据之后（环境变量 DSM_CONTROL_UDP）
+extern int LockCache;                       // 1: 释放的锁令牌留在本节点，直到其他节点请求，再次加锁不发报文（环境变量 DSM_LOCK_CACHE）
+extern int BarrierFanout;                   // barrier 组合树中每个节点的子节点数，0 不限（环境变量 DSM_BARRIER_FANOUT）
 
 
 
@@ -40,7 +51,15 @@ int dsm_mutex_init();
 int dsm_mutex_destroy(int *mutex);
 int dsm_mutex_lock(int *mutex);
 int dsm_mutex_unlock(int *mutex);
-void* dsm_malloc(const char *name, int * num); //name:共享区绑定的文件路径； 返回共享区起始地址
+// 读写锁：读者之间共享，写者独占；写者释放时才带上写过的页，读者释放不带页
+// 与 dsm_mutex_* 共用锁编号，所有节点必须按相同顺序调用 dsm_mutex_init / dsm_rwlock_init
+int dsm_rwlock_init();
+int dsm_rwlock_destroy(int *rwlock);
+int dsm_rwlock_rdlock(int *rwlock);
+int dsm_rwlock_wrlock(int *rwlock);
+int dsm_rwlock_unlock(int *rwlock);
+void* dsm_malloc(const char *name, int * num); //name:共享区绑定的文件路径； 返回共享区起始地址；所有节点都要调用，返回前经过一次 barrier
+void* dsm_malloc_block(const char *name, int * num, size_t block_size); //同上，block_size 为该区域的一致性块大小（PAGESIZE 的 2 的幂倍）
 
 bool dsm_barrier(void);
 
@@ -48,6 +67,11 @@ bool dsm_barrier(void);
 
 
 std::string GetPodIp(int pod_id);      //
+std::string PodHostIp(int pod_id);     // 节点所在主机在集群配置中的地址（本节点也不换成回环地址），barrier 据此按主机聚合
 int GetPodPort(int pod_id);            // 
 
+// Manager 召回本节点缓存的锁令牌（DSM_MSG_LOCK_RECALL）：令牌空闲时交出，pages 为本节点持有令牌以来写过的页，返回 true；
+// 锁正在使用或正在送来时返回 false，并在释放时交回
+bool SurrenderLockToken(int lock_id, std::vector<int>& pages);
+
 #endif /* DSM_H */
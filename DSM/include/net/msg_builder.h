@@ -0,0 +1,42 @@
+#ifndef NET_MSG_BUILDER_H
+#define NET_MSG_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+#include "net/protocol.h"
+
+#define DSM_MSG_MAX_PARTS 8     // 一条报文最多的负载段数
+
+// 一条报文的发送描述：报文头加若干段负载，Send 时拼成一个 iovec 用一次 sendmsg 写出
+// 各段只记录地址不拷贝，Send 返回前调用方须保持它们有效
+// 报文头的 payload_len 由 Send 按各段长度之和填写（网络字节序）
+class MsgBuilder {
+public:
+	explicit MsgBuilder(const dsm_header_t &header);
+
+	// 追加一段负载，段数超过 DSM_MSG_MAX_PARTS 时 Send 失败
+	MsgBuilder &Add(const void *data, size_t len);
+
+	template <typename T>
+	MsgBuilder &Add(const T &value) { return Add(&value, sizeof(value)); }
+
+	size_t PayloadLen() const { return payload_len_; }
+
+	// 把填好 payload_len 的报文头写入 *header，iov 依次指向它与各段负载，返回段数
+	// iov 至少 DSM_MSG_MAX_PARTS + 1 项；段数超限时返回 0
+	int Gather(dsm_header_t *header, struct iovec *iov) const;
+
+	// 写出整条报文（处理部分写与 EINTR），失败返回 false
+	bool Send(int sock) const;
+
+private:
+	dsm_header_t header_;
+	struct iovec iov_[DSM_MSG_MAX_PARTS + 1];   // iov_[0] 留给报文头
+	int iovcnt_;
+	size_t payload_len_;
+	bool overflow_;
+};
+
+#endif /* NET_MSG_BUILDER_H */
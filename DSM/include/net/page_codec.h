@@ -0,0 +1,30 @@
+#ifndef NET_PAGE_CODEC_H
+#define NET_PAGE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 页面数据的压缩编码（PAGE_REP / PAGE_BATCH_REP 的页面负载）
+// 请求方在 PAGE_REQ 报文头 unused 的高 4 位给出它能解码的编码，
+// 发送方逐页决定：压缩后不小于 DSM_CODEC_THRESHOLD(size) 时照常发送原始页面
+typedef enum {
+	DSM_CODEC_NONE    = 0,  // 原始页面
+	DSM_CODEC_LZ      = 1,  // LZ77 风格：字面量 + (偏移, 长度) 回溯拷贝，适合重复片段
+	DSM_CODEC_SHUFFLE = 2,  // 按 4 字节字拆成 4 个字节平面后做 RLE，适合数值较小的 int 数组
+	DSM_CODEC_COUNT
+} dsm_codec_t;
+
+// 压缩结果必须小于原始大小的 7/8 才值得发送
+#define DSM_CODEC_THRESHOLD(size) ((size) - (size) / 8)
+#define DSM_CODEC_MAX_SIZE 4096     // 一次压缩的最大字节数（一页）
+
+// 压缩 page，成功返回写入 out 的字节数；不认识的编码、或结果达不到阈值时返回 0
+// out 至少 size 字节；size 不超过 DSM_CODEC_MAX_SIZE，SHUFFLE 要求 size 是 4 的倍数
+size_t dsm_codec_compress(int codec, const void *page, size_t size, uint8_t *out);
+
+// 解压到 page（恰好 size 字节），数据损坏或长度不符时返回 false
+bool dsm_codec_decompress(int codec, const uint8_t *in, size_t len, void *page, size_t size);
+
+const char *dsm_codec_name(int codec);
+
+#endif /* NET_PAGE_CODEC_H */
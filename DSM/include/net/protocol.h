@@ -47,14 +47,19 @@ typedef enum {
     DSM_MSG_PAGE_REQ      = 0x10,  // A向B发送页面请求
     DSM_MSG_PAGE_REP      = 0x11,  // 注意：B不会判断自己是prob owner还是real owner,只是判断自己与pagetable里对应页的owner是否一致，
                                    // 一致就发送页面，否则返回页的owner的ID给A，如果页owner是-1，则向0号进程调数据
+    DSM_MSG_PAGE_INV      = 0x12,  // Manager向只读副本持有者发送失效通知，回复ACK
+    DSM_MSG_PAGE_DIFF     = 0x13,  // 多写者模式：释放时把页面与twin的差异发给home合并，回复ACK
+    DSM_MSG_PAGE_BATCH_REQ = 0x14, // 一次请求多页（预取/批量调页），unused 同 PAGE_REQ
+    DSM_MSG_PAGE_BATCH_REP = 0x15, // 按请求顺序逐页回复：数据或重定向
     
     // 3. 锁请求流程
     DSM_MSG_LOCK_ACQ      = 0x20,  // A向B发送锁请求
     DSM_MSG_LOCK_REP      = 0x21,  // B向A返回锁请求，一并返回的还有无效页号
     DSM_MSG_LOCK_RLS      = 0X22,  // A向B发送锁释放，返回无效页号的list，B会将该list存储在锁表里
+    DSM_MSG_LOCK_RECALL   = 0x23,  // 有其他节点等待时，B请缓存着锁令牌的持有者交回令牌，回复 ACK
 
     // 4. 维护与确认
-    DSM_MSG_OWNER_UPDATE  = 0x30,  // 告知Manager页表所有权已变更
+    DSM_MSG_OWNER_UPDATE  = 0x30,  // 告知Manager页表所有权已变更（一条消息可携带多页，缺页路径不等待回复）
 
     DSM_MSG_ACK           = 0xFF   // 通用确认：同步确认，lock release确认，页表更新确认
 } dsm_msg_type_t;
@@ -68,6 +73,47 @@ typedef struct {
     uint32_t payload_len;    // 后续负载长度 (不含包头)
 } __attribute__((packed)) dsm_header_t;
 
+// [DSM_MSG_PAGE_REQ] 报文头 unused 字段：低 4 位为本次缺页的访问类型，高 4 位为请求方能解码的页面编码（net/page_codec.h）
+#define DSM_PAGE_ACCESS_READ    0   // 读缺页：只取只读副本，不转移所有权
+#define DSM_PAGE_ACCESS_WRITE   1   // 写缺页：取得独占所有权
+#define DSM_PAGE_REQ_INITIAL    2   // 与访问类型按位或：manager 回复 INITIAL 后发往 Pod 0，页面尚无 owner，直接给出文件内容
+#define DSM_PAGE_REQ_FLAGS(access, codec) ((uint8_t)((access) | ((codec) << 4)))
+#define DSM_PAGE_REQ_ACCESS(unused)       ((unused) & 0x01)
+#define DSM_PAGE_REQ_IS_INITIAL(unused)   (((unused) & DSM_PAGE_REQ_INITIAL) != 0)
+#define DSM_PAGE_REQ_CODEC(unused)        ((unused) >> 4)
+
+// [DSM_MSG_OWNER_UPDATE] payload_owner_update_t 的 kind 字段：更新类型
+#define DSM_OWNER_UPDATE_WRITER 0   // 所有权转移给 new_owner_id，Manager 失效全部只读副本
+#define DSM_OWNER_UPDATE_READER 1   // src_node_id 从 new_owner_id 处取得只读副本，加入 copyset
+
+// [DSM_MSG_PAGE_REP] 报文头 unused 字段：回复内容
+#define DSM_PAGE_REP_REDIRECT   0   // 只有 real_owner_id：去问它
+#define DSM_PAGE_REP_DATA       1   // real_owner_id + 页面数据
+#define DSM_PAGE_REP_ZERO       2   // 页面全为 0：只有 real_owner_id，不带页面数据
+#define DSM_PAGE_REP_PACKED     3   // real_owner_id + payload_page_packed_t + 压缩后的页面
+#define DSM_PAGE_REP_INITIAL    4   // 页面从未被访问：只有 real_owner_id（Pod 0），带 DSM_PAGE_REQ_INITIAL 向它请求
+
+// 负载末尾原样携带的整页数据的页数：PAGE_REP 为 DATA 时 1 页，PAGE_BATCH_REP 记在 unused 中
+// 接收方把它们直接读入按页对齐的暂存页（RpcMessage::TakePage），缺页处理再整页移入共享区
+#define DSM_RAW_PAGES(header) \
+    ((header).type == DSM_MSG_PAGE_REP ? ((header).unused == DSM_PAGE_REP_DATA ? 1u : 0u) \
+     : (header).type == DSM_MSG_PAGE_BATCH_REP ? (uint32_t)(header).unused : 0u)
+
+// [DSM_MSG_JOIN_REQ] 与其 ACK 的负载：barrier 的写通知（见 os/barrier_tree.h）
+// payload_barrier_notice_t + page_count 个 payload_barrier_page_t；JOIN_REQ 为到达方子树写过的页，ACK 为全体的并集
+// 报文头 unused 为 DSM_BARRIER_ALL 时不带负载：写过的页超过 DSM_BARRIER_NOTICE_MAX，各节点撤销整个共享区
+#define DSM_BARRIER_ALL          1
+#define DSM_BARRIER_NOTICE_MAX   8192       // 逐页记录的写通知上限
+#define DSM_BARRIER_WRITER_MANY  0xFFFF     // 多个节点写过同一页
+typedef struct {
+    uint32_t page_count;
+} __attribute__((packed)) payload_barrier_notice_t;
+
+typedef struct {
+    uint32_t page_index;        // 共享区内的页号
+    uint16_t writer_id;         // 写过该页的节点，或 DSM_BARRIER_WRITER_MANY
+} __attribute__((packed)) payload_barrier_page_t;
+
 // [DSM_MSG_PAGE_REQ] Requestor -> Manager
 typedef struct {
     uint32_t page_index;        // 请求的全局页号
@@ -76,14 +122,61 @@ typedef struct {
 // [DSM_MSG_PAGE_REP] Manager -> Requestor
 typedef struct {
     uint16_t real_owner_id;
+    uint32_t version;           // 页面的所有权转移次数，写请求时为交给请求方后的新值（见 PageRecord::version）
     char pagedata[DSM_PAGE_SIZE];
 } __attribute__((packed)) payload_page_rep_t;
 
+// [DSM_MSG_PAGE_BATCH_REQ] Requestor -> Manager / Owner
+// 负载：payload_page_batch_req_t + uint32_t page_index[count]
+#define DSM_PAGE_BATCH_MAX 64       // 单个请求最多携带的页数
+typedef struct {
+    uint32_t count;             // 请求的页数
+} __attribute__((packed)) payload_page_batch_req_t;
+
+// [DSM_MSG_PAGE_BATCH_REP] Manager / Owner -> Requestor
+// 负载：count 个条目，每个条目为 payload_page_batch_entry_t，status 为 PACKED 时紧跟压缩后的页面；
+// 之后按条目顺序是各 DATA 条目的 DSM_PAGE_SIZE 字节页面数据，报文头 unused 为 DATA 条目数（DSM_RAW_PAGES）
+#define DSM_PAGE_BATCH_REDIRECT 0   // real_owner_id 为下一跳
+#define DSM_PAGE_BATCH_DATA     1   // 页面数据在负载末尾，real_owner_id 为副本来源
+#define DSM_PAGE_BATCH_FAILED   2   // 无法提供（越界或转发失败），由缺页路径单独重试
+#define DSM_PAGE_BATCH_ZERO     3   // 页面全为 0，不带页面数据
+#define DSM_PAGE_BATCH_PACKED   4   // 随后为 payload_page_packed_t + 压缩后的页面
+#define DSM_PAGE_BATCH_INITIAL  5   // 页面从未被访问，带 DSM_PAGE_REQ_INITIAL 向 real_owner_id（Pod 0）请求
+typedef struct {
+    uint32_t page_index;
+    uint8_t  status;
+    uint16_t real_owner_id;
+    uint32_t version;           // 同 payload_page_rep_t.version，仅 DATA / ZERO / PACKED 时有意义
+} __attribute__((packed)) payload_page_batch_entry_t;
+
+// 压缩页面的前缀（PAGE_REP 的 DSM_PAGE_REP_PACKED、PAGE_BATCH_REP 的 DSM_PAGE_BATCH_PACKED）
+typedef struct {
+    uint8_t  codec;             // dsm_codec_t，必须是请求方在 PAGE_REQ 中给出的编码
+    uint16_t packed_len;        // 紧随其后的压缩数据字节数
+} __attribute__((packed)) payload_page_packed_t;
+
+// [DSM_MSG_PAGE_INV] Manager -> Copyset member
+typedef struct {
+    uint32_t page_index;        // 需要失效的全局页号
+} __attribute__((packed)) payload_page_inv_t;
+
+// [DSM_MSG_PAGE_DIFF] Writer -> Home
+// 一条消息可携带多个段：每段为 payload_page_diff_t + diff_len 字节的 run-length diff（见 os/page_diff.h）
+typedef struct {
+    uint32_t page_index;        // 全局页号
+    uint32_t diff_len;          // 紧随其后的 diff 字节数
+} __attribute__((packed)) payload_page_diff_t;
+
 // [DSM_MSG_LOCK_ACQ]  Requestor -> Manager
 typedef struct {
     uint32_t lock_id;           // 锁 ID
 } __attribute__((packed)) payload_lock_req_t;
 
+// LOCK_ACQ 报文头的 unused 字段：请求锁的方式
+#define DSM_LOCK_MUTEX 0    // dsm_mutex_lock：独占，DSM_LOCK_CACHE 时令牌可缓存在释放方
+#define DSM_LOCK_WRITE 1    // dsm_rwlock_wrlock：独占，释放时带上写过的页
+#define DSM_LOCK_READ  2    // dsm_rwlock_rdlock：与其他读者共享，释放时不带页
+
 // [DSM_MSG_LOCK_REP] Manager -> Requestor (授予锁)
 typedef struct {
     uint32_t invalid_set_count; // Scope Consistency: 需要失效的页数量
@@ -97,10 +190,25 @@ typedef struct {
     // Note: invalid_page_list follows as array of uint32_t[invalid_set_count]
 } __attribute__((packed)) payload_lock_rls_t;
 
+// [DSM_MSG_LOCK_RECALL] Manager -> 令牌持有者，负载为 payload_lock_req_t
+// 回复 ACK 的 unused 字段：DSM_LOCK_RECALL_RETURNED 时令牌已交回，负载同 LOCK_REP（失效页数 + 失效页列表）；
+// DSM_LOCK_RECALL_DEFERRED 时锁仍在使用（或正在送来），持有者释放时照常发送 LOCK_RLS
+#define DSM_LOCK_RECALL_DEFERRED 0
+#define DSM_LOCK_RECALL_RETURNED 1
+
 // [DSM_MSG_OWNER_UPDATE] RealOwner -> Manager
+// 负载：payload_owner_update_batch_t + count 个 payload_owner_update_t，Manager 按顺序逐条处理
+// 回复 ACK，负载为 count 个字节，与请求逐条对应：1 表示接受；READER 更新被拒绝（副本来源已不是 owner）时为 0
+#define DSM_OWNER_UPDATE_BATCH_MAX 256  // 单个请求最多携带的更新数
+typedef struct {
+    uint32_t count;          // 更新条数
+} __attribute__((packed)) payload_owner_update_batch_t;
+
 typedef struct {
     uint32_t resource_id;    // 页号
-    uint16_t new_owner_id;   // 页面最新副本在哪里
+    uint16_t new_owner_id;   // 页面最新副本在哪里（READER 更新时为副本来源）
+    uint8_t  kind;           // DSM_OWNER_UPDATE_WRITER / DSM_OWNER_UPDATE_READER
+    uint32_t version;        // WRITER：随页面收到的所有权转移次数，Manager 忽略早于目录中版本的更新
 } __attribute__((packed)) payload_owner_update_t;
 
 
@@ -0,0 +1,70 @@
+#ifndef NET_RPC_CHANNEL_H
+#define NET_RPC_CHANNEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "net/protocol.h"
+#include "net/transport.h"
+
+// 请求负载的一段（按顺序紧跟在报文头之后发送）
+struct RpcPart {
+	const void *data;
+	size_t len;
+};
+
+// 到一个远端守护进程的连接上的请求/回复复用（ARCHITECTURE.md 的 seq_num 管理规范）
+// 发送前分配 seq_num 并登记等待者，后台读线程收到完整的回复报文后按 seq_num 交给等待者，
+// 多个线程（缺页、锁、所有权更新）可以同时在同一连接上各有未完成的请求
+// 对端按请求到达的顺序处理，但回复可以乱序到达
+// 底层是 TCP 还是同机的共享内存环由 Transport 决定
+class RpcChannel {
+public:
+	explicit RpcChannel(std::unique_ptr<Transport> transport);
+	RpcChannel(const RpcChannel &) = delete;
+	RpcChannel &operator=(const RpcChannel &) = delete;
+
+	const Transport &Link() const { return *transport_; }
+
+	// 填写 header.seq_num 与 payload_len，报文头与各段负载用一次 sendmsg 写出（net/msg_builder.h），
+	// 返回 seq_num；连接已断开或发送失败返回 0
+	uint32_t Send(dsm_header_t header, std::initializer_list<RpcPart> parts);
+
+	// 阻塞等待 Send 返回的 seq 的回复；连接断开时返回 false
+	bool Wait(uint32_t seq, RpcMessage &reply);
+
+	// Send 后 Wait
+	bool Call(const dsm_header_t &header, std::initializer_list<RpcPart> parts, RpcMessage &reply);
+
+	// 回复的回调：ok 为 false 表示发送失败或连接断开
+	using ReplyHandler = std::function<void(bool ok, RpcMessage &reply)>;
+
+	// 同 Send，但不等待回复：on_reply 恰好被调用一次，回复到达或连接断开时在后台读线程上，
+	// 发送失败时在调用线程上。回调中不能 Wait 同一通道的回复
+	void Post(const dsm_header_t &header, std::initializer_list<RpcPart> parts, ReplyHandler on_reply);
+
+private:
+	struct Waiter {
+		bool done { false };
+		RpcMessage reply;
+		ReplyHandler on_reply;      // Post 的请求：不经过 Wait，由读线程交给回调
+	};
+
+	uint32_t Start(dsm_header_t header, std::initializer_list<RpcPart> parts, ReplyHandler &on_reply);
+	void ReaderLoop();
+
+	std::unique_ptr<Transport> transport_;
+	std::mutex mutex_;                      // 保护以下成员
+	std::condition_variable cond_;
+	std::map<uint32_t, Waiter> waiters_;    // seq_num -> 等待者
+	uint32_t next_seq_ { 1 };
+	bool closed_ { false };
+};
+
+#endif /* NET_RPC_CHANNEL_H */
@@ -0,0 +1,83 @@
+#ifndef NET_SHM_TRANSPORT_H
+#define NET_SHM_TRANSPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "net/transport.h"
+
+#define DSM_SHM_RING_SIZE (1024 * 1024)     // 每个方向的环大小（2 的幂）
+
+// 单生产者/单消费者的字节环，位于 POSIX 共享内存中
+// head/tail 是单调递增的字节计数，只由生产者/消费者各自推进
+// 一方等待时置 *_waiting 并在 *_seq 上 futex 等待，另一方推进后递增 *_seq 并唤醒
+struct ShmRing {
+	alignas(64) std::atomic<uint64_t> head;       // 已写入的字节数（生产者）
+	alignas(64) std::atomic<uint64_t> tail;       // 已读出的字节数（消费者）
+	alignas(64) std::atomic<uint32_t> data_seq;   // 每次写入后递增，消费者在其上等待
+	std::atomic<uint32_t> reader_waiting;
+	alignas(64) std::atomic<uint32_t> space_seq;  // 每次读出后递增，生产者在其上等待
+	std::atomic<uint32_t> writer_waiting;
+	alignas(64) char data[DSM_SHM_RING_SIZE];
+};
+
+// 一个计算进程到一个同机守护进程的共享内存段：请求环与回复环
+struct ShmSegment {
+	uint32_t magic;
+	int32_t daemon_pid;
+	std::atomic<int32_t> client_pid;    // 0 表示尚无计算进程接入
+	ShmRing to_daemon;
+	ShmRing to_client;
+};
+
+// 共享内存环上的 Transport，同一台机器上的节点之间不经过回环网络协议栈
+// 守护进程启动时为每个同机节点 Create 一个段，计算进程 Open 接入；
+// 段不存在、已被接入或守护进程已退出时 Open 返回空，调用方改用 TCP
+class ShmTransport : public Transport {
+public:
+	~ShmTransport() override;
+	ShmTransport(const ShmTransport &) = delete;
+	ShmTransport &operator=(const ShmTransport &) = delete;
+
+	// 守护进程监听端口 daemon_port、计算进程 client_pod 之间的段名
+	static std::string SegmentName(int daemon_port, int client_pod);
+
+	static std::unique_ptr<ShmTransport> Create(const std::string &name);
+	static std::unique_ptr<ShmTransport> Open(const std::string &name);
+
+	bool Send(const MsgBuilder &msg) override;
+	ssize_t RecvV(const struct iovec *iov, int iovcnt) override;
+	std::string Name() const override { return "shm:" + name_; }
+
+	// 不阻塞地读出已到达的字节，环为空时返回 0
+	size_t TryRecv(void *buf, size_t len);
+
+	// 对端已退出且接收环中没有剩余数据
+	bool Closed() const;
+
+	// 在多个段的接收环上同时等待新数据（futex_waitv），守护进程以一个线程服务所有同机节点；
+	// 超时（用于检查对端是否退出）返回 false。内核不支持 futex_waitv 时改为短暂睡眠后轮询
+	static bool WaitAny(const std::vector<ShmTransport *> &segments);
+
+private:
+	ShmTransport(const std::string &name, ShmSegment *seg, bool daemon_side);
+
+	bool Write(const void *data, size_t len);
+	size_t Drain(const struct iovec *iov, int iovcnt);
+	bool PeerAlive() const;
+
+	std::string name_;
+	ShmSegment *seg_;
+	bool daemon_side_;
+	ShmRing *tx_;
+	ShmRing *rx_;
+	std::mutex send_mutex_;     // 多个线程的报文依次写入，保持单生产者
+};
+
+#endif /* NET_SHM_TRANSPORT_H */
@@ -0,0 +1,112 @@
+#ifndef NET_TRANSPORT_H
+#define NET_TRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "net/msg_builder.h"
+#include "net/protocol.h"
+
+// 一条完整的报文：报文头（网络字节序）与全部负载
+// channel 收到的回复与守护进程读齐的请求都用它表示
+// 负载末尾的整页数据（DSM_RAW_PAGES）不进 payload，单独放在按页对齐的暂存页中
+struct RpcMessage {
+	dsm_header_t header;
+	std::vector<char> payload;
+	size_t pos { 0 };
+	std::shared_ptr<char> pages;    // page_count 个暂存页，拷贝报文时共享
+	uint32_t page_count { 0 };
+	uint32_t next_page { 0 };
+
+	// 按顺序取出负载中的 n 字节，剩余不足时返回 false
+	bool Read(void *buf, size_t n);
+
+	// 同 Read，但不拷贝：返回负载中这 n 字节的地址，剩余不足时返回 nullptr
+	const char *Take(size_t n);
+
+	// 按顺序取出下一个暂存页，没有时返回 nullptr；取出的页归调用者，可以整页移走（UFFDIO_MOVE）
+	char *TakePage();
+
+	// 按报文头与负载长度分配暂存页，返回留在 payload 中的字节数
+	size_t ResetPages(size_t payload_len);
+};
+
+// 把收到的字节流按 dsm_header_t.payload_len 切成完整报文
+class FrameBuffer {
+public:
+	void Append(const char *data, size_t len);
+
+	// 取出下一条完整的报文，不足一条时返回 false
+	bool Next(RpcMessage &msg);
+
+private:
+	std::vector<char> buf_;
+	size_t pos_ { 0 };          // buf_ 中下一条报文的起点
+};
+
+// 到一个对端的双向字节流：远端节点走 TCP，同机的节点走共享内存环（net/shm_transport.h）
+// Send 整条写出一条报文，多个线程可以同时调用；Recv 只由一个读线程调用
+class Transport {
+public:
+	virtual ~Transport() = default;
+
+	virtual bool Send(const MsgBuilder &msg) = 0;
+
+	// 阻塞读入，依次填充 iov 的各段，返回读到的字节数；对端关闭返回 0，出错返回 -1
+	virtual ssize_t RecvV(const struct iovec *iov, int iovcnt) = 0;
+
+	ssize_t Recv(void *buf, size_t len)
+	{
+		struct iovec iov = { buf, len };
+		return RecvV(&iov, 1);
+	}
+
+	// 日志中标识这条连接
+	virtual std::string Name() const = 0;
+};
+
+// TCP 套接字上的 Transport，析构时关闭套接字
+class TcpTransport : public Transport {
+public:
+	explicit TcpTransport(int sock) : sock_(sock) {}
+	~TcpTransport() override;
+	TcpTransport(const TcpTransport &) = delete;
+	TcpTransport &operator=(const TcpTransport &) = delete;
+
+	int Fd() const { return sock_; }
+
+	bool Send(const MsgBuilder &msg) override;
+	ssize_t RecvV(const struct iovec *iov, int iovcnt) override;
+	std::string Name() const override;
+
+private:
+	int sock_;
+	std::mutex send_mutex_;     // 一条报文的部分写不与其他报文交错
+};
+
+// 阻塞地从 Transport 逐条读出报文，负载的每个字节只拷贝一次：
+// 负载直接读入 RpcMessage::payload，末尾的整页数据直接读入暂存页；
+// 读负载的同一次 readv 至多顺带读入下一条报文的报文头，暂存在内部缓冲区，不会读到它的负载
+class MessageReader {
+public:
+	explicit MessageReader(Transport &transport);
+
+	// 读出下一条完整的报文，连接关闭或出错时返回 false
+	bool Next(RpcMessage &msg);
+
+private:
+	bool ReadInto(struct iovec *iov, int iovcnt, bool read_ahead);
+
+	Transport &transport_;
+	std::vector<char> buf_;
+	size_t pos_ { 0 };
+	size_t end_ { 0 };
+};
+
+#endif /* NET_TRANSPORT_H */
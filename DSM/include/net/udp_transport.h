@@ -0,0 +1,109 @@
+#ifndef NET_UDP_TRANSPORT_H
+#define NET_UDP_TRANSPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "net/transport.h"
+
+#define DSM_UDP_FRAGMENT    1200    // 每个数据报携带的负载字节数，整个数据报不超过以太网 MTU
+#define DSM_UDP_RTO_MS      50      // 首次重传超时
+#define DSM_UDP_RTO_MAX_MS  1000    // 重传超时倍增的上限
+#define DSM_UDP_MAX_PARTIAL 64      // 每个对端最多同时拼装的报文数
+#define DSM_UDP_REFUSED_MAX 8       // 连续这么多次 ICMP 端口不可达后认为对端已退出
+
+// 控制报文通道上每个数据报的前缀（网络字节序），其后是报文负载从 offset 开始的一段
+// 每个分片都带完整的报文头，接收方据此得到 seq_num 与总长度
+typedef struct {
+	dsm_header_t header;
+	uint32_t offset;        // 本分片在负载中的起点
+	uint32_t low_seq;       // 请求方：本连接上仍在等待回复的最小 seq_num，之前的回复对端可以丢弃
+} __attribute__((packed)) dsm_dgram_t;
+
+// 把一个对端发来的分片拼回完整报文（只由一个线程调用）
+class DatagramAssembler {
+public:
+	// 加入一个数据报；拼出完整报文时填写 msg 并返回 true
+	// 重复的分片被忽略，格式错误的数据报被丢弃
+	bool Add(const char *data, size_t len, RpcMessage &msg);
+
+private:
+	struct Partial {
+		RpcMessage msg;
+		std::vector<bool> got;  // 各分片是否已收到
+		size_t missing;
+	};
+	std::map<uint32_t, Partial> partial_;   // seq_num -> 拼装中的报文
+};
+
+// 计算进程一侧到一个守护进程的可靠数据报连接（已 connect 的 UDP 套接字），承载锁、barrier 与
+// OWNER_UPDATE 等控制报文，不会排在同一 TCP 连接上的页面数据之后
+// Send 记下请求并按 DSM_UDP_FRAGMENT 分片发出；读线程在 RecvV 中等待回复，到期未收到回复的请求
+// 按 seq_num 整条重传（超时从 DSM_UDP_RTO_MS 倍增到 DSM_UDP_RTO_MAX_MS），重复的回复被丢弃
+// 回复按到达顺序以字节流交给 RpcChannel，因此 RpcChannel 不需要知道底层是数据报
+class UdpTransport : public Transport {
+public:
+	explicit UdpTransport(int sock);
+	~UdpTransport() override;
+	UdpTransport(const UdpTransport &) = delete;
+	UdpTransport &operator=(const UdpTransport &) = delete;
+
+	bool Send(const MsgBuilder &msg) override;
+	// 对端连续 DSM_UDP_REFUSED_MAX 次不可达（ICMP 端口不可达）时返回 0
+	ssize_t RecvV(const struct iovec *iov, int iovcnt) override;
+	std::string Name() const override;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Pending {
+		std::vector<char> bytes;        // 报文头与负载
+		Clock::time_point deadline;     // 到期未收到回复则重传
+		int rto_ms;
+	};
+
+	// 重传到期的请求，返回距下一次到期的毫秒数，没有等待中的请求时返回 -1
+	int RetransmitDue();
+
+	int sock_;
+	int wake_fd_;                           // 新请求比读线程预定的醒来时间更早到期时唤醒它
+	std::mutex mutex_;                      // 保护以下两项
+	std::map<uint32_t, Pending> pending_;   // seq_num -> 等待回复的请求
+	Clock::time_point wake_at_ { Clock::time_point::max() };   // 读线程预定醒来重传的时间
+	DatagramAssembler in_;                  // 以下只由读线程使用
+	std::vector<char> ready_;               // 已拼好、尚未交给 RecvV 调用方的回复字节
+	size_t ready_pos_ { 0 };
+	int refused_ { 0 };                     // 连续收到的端口不可达次数
+};
+
+// 守护进程一侧的一个数据报对端（按源地址区分），所有对端共用守护进程的 UDP 套接字
+// Deliver 拼装请求并去重：已处理完的请求重发缓存的回复，正在处理的请求（例如等待中的锁）的重传被丢弃
+// Send 发出回复并按 seq_num 缓存，直到请求方的 low_seq 表明它已收到
+class UdpPeer : public Transport {
+public:
+	UdpPeer(int sock, const struct sockaddr_in &addr) : sock_(sock), addr_(addr) {}
+
+	// 加入一个数据报（只由守护进程的 UDP 读线程调用）；拼出一个尚未处理过的请求时返回 true
+	bool Deliver(const char *data, size_t len, RpcMessage &msg);
+
+	bool Send(const MsgBuilder &msg) override;
+	// 请求由 Deliver 交付，不支持阻塞读
+	ssize_t RecvV(const struct iovec *iov, int iovcnt) override;
+	std::string Name() const override;
+
+private:
+	int sock_;
+	struct sockaddr_in addr_;
+	DatagramAssembler in_;
+	std::mutex mutex_;                               // 保护以下成员
+	uint32_t low_seq_ { 0 };                         // 小于它的请求已完成，重复到达时丢弃
+	std::map<uint32_t, std::vector<char>> served_;   // seq_num -> 回复，处理中时为空
+};
+
+#endif /* NET_UDP_TRANSPORT_H */
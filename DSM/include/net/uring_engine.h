@@ -0,0 +1,116 @@
+#ifndef NET_URING_ENGINE_H
+#define NET_URING_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "net/transport.h"
+
+#define DSM_URING_ENTRIES     256          // 提交队列深度
+#define DSM_URING_BUFFERS     64           // 提供给内核的接收缓冲区个数
+#define DSM_URING_BUFFER_SIZE (16 * 1024)  // 每个接收缓冲区的大小
+#define DSM_URING_CHAIN_MAX   32           // 一条链接发送链最多的报文数
+
+class UringEngine;
+
+// io_uring 上的一条 TCP 连接
+// Send 把报文拷贝后交给内核就返回；上一批发送尚未完成时只排队，
+// 完成后排队的报文作为一条 IOSQE_IO_LINK 链一次提交，按顺序写出
+class UringConn : public Transport, public std::enable_shared_from_this<UringConn> {
+public:
+	UringConn(UringEngine *engine, int sock) : engine_(engine), sock_(sock) {}
+	~UringConn() override;
+	UringConn(const UringConn &) = delete;
+	UringConn &operator=(const UringConn &) = delete;
+
+	int Fd() const { return sock_; }
+
+	bool Send(const MsgBuilder &msg) override;
+	// 接收由引擎的多发 recv 完成，不支持阻塞读
+	ssize_t RecvV(const struct iovec *iov, int iovcnt) override;
+	std::string Name() const override;
+
+private:
+	friend class UringEngine;
+
+	// 一条发送完成（事件循环线程），res 为内核返回值
+	void SendDone(int res, size_t len);
+
+	UringEngine *engine_;
+	int sock_;
+	FrameBuffer in_;                        // 尚未组成完整报文的字节（事件循环线程）
+	bool dropped_ { false };                // 事件循环已不再处理这条连接的请求
+	std::mutex mutex_;                      // 保护以下成员
+	size_t inflight_ { 0 };                 // 已提交未完成的发送数
+	bool broken_ { false };                 // 发送出错后不再发送
+	std::deque<std::vector<char>> queued_;  // 等待下一条链的报文
+};
+
+// 守护进程的 io_uring 事件循环：多发 accept 接受连接，多发 recv 读入预先提供给内核的接收缓冲区
+// （IORING_OP_PROVIDE_BUFFERS，由内核为每次完成挑选一个），切出的完整报文交给 handler；
+// 事件循环线程上产生的回复在下一次 io_uring_enter 时与等待完成合并为一次系统调用
+// 直接调用 io_uring 系统调用，不依赖 liburing
+class UringEngine {
+public:
+	// handler 返回 false 时关闭该连接
+	using MessageHandler = bool (*)(const std::shared_ptr<Transport> &peer, RpcMessage &msg);
+
+	// 内核不支持（或被禁止）所需的 io_uring 特性时返回空，调用方改用 epoll
+	static std::unique_ptr<UringEngine> Create();
+	~UringEngine();
+	UringEngine(const UringEngine &) = delete;
+	UringEngine &operator=(const UringEngine &) = delete;
+
+	// 在当前线程上运行事件循环，不返回
+	void Run(int listenfd, MessageHandler handler);
+
+private:
+	friend class UringConn;
+	struct Op;
+
+	UringEngine() = default;
+	bool Setup();
+
+	// 以下在 sq_mutex_ 下取得并填写提交项；不在事件循环线程上时立即提交
+	void SubmitChain(const std::shared_ptr<UringConn> &conn, std::deque<std::vector<char>> chain);
+	void ArmAccept();
+	void ArmRecv(const std::shared_ptr<UringConn> &conn);
+	struct io_uring_sqe *GetSqe();           // sq_mutex_ 持有者调用
+	unsigned PublishLocked();                // 公开已填写的提交项，返回内核尚未取走的个数
+	void FlushLocked();                      // sq_mutex_ 持有者调用
+
+	void HandleRecv(Op *op, int res, uint32_t flags);
+	void ReturnBuffer(uint16_t bid);
+
+	int ring_fd_ { -1 };
+	int listenfd_ { -1 };
+	MessageHandler handler_ { nullptr };
+
+	void *sq_ring_ { nullptr };
+	size_t sq_ring_len_ { 0 };
+	void *cq_ring_ { nullptr };
+	size_t cq_ring_len_ { 0 };
+	struct io_uring_sqe *sqes_ { nullptr };
+	size_t sqes_len_ { 0 };
+	unsigned *sq_head_ { nullptr };
+	unsigned *sq_tail_ { nullptr };
+	unsigned *sq_array_ { nullptr };
+	unsigned sq_mask_ { 0 };
+	unsigned sq_entries_ { 0 };
+	unsigned *cq_head_ { nullptr };
+	unsigned *cq_tail_ { nullptr };
+	unsigned cq_mask_ { 0 };
+	struct io_uring_cqe *cqes_ { nullptr };
+
+	char *buffers_ { nullptr };
+
+	std::mutex sq_mutex_;                    // 多个线程提交发送
+	unsigned sq_local_tail_ { 0 };           // 已填写的提交项，FlushLocked 时才对内核可见
+};
+
+#endif /* NET_URING_ENGINE_H */
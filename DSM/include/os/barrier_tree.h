@@ -0,0 +1,38 @@
+#ifndef OS_BARRIER_TREE_H
+#define OS_BARRIER_TREE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "net/transport.h"
+
+// 组合树 barrier 中一个节点的上下游
+// 同一主机上的节点先组成一棵扇出为 fanout 的树，根为其中编号最小的节点；各主机的根再组成扇出为
+// fanout 的树，按各主机最小的节点编号排列，Pod 0 为整棵树的根。跨主机的到达与释放每台主机各一条
+struct BarrierLinks {
+    int parent { -1 };              // 到齐后向它发送 JOIN_REQ，-1 表示根
+    std::vector<int> children;      // 等待其 JOIN_REQ 的子节点（不含本节点的计算进程）
+};
+
+// pod_hosts[i] 为 Pod i 所在主机的地址；fanout <= 0 时不限扇出（同机节点都挂在本机的根下，各主机的根都挂在 Pod 0 下）
+BarrierLinks dsm_barrier_links(int pod, const std::vector<std::string> &pod_hosts, int fanout);
+
+// barrier 的写通知：页号 -> 写过它的节点（多个节点写过时为 DSM_BARRIER_WRITER_MANY）
+// 沿 barrier 树逐级合并，释放时各节点只失效别的节点写过的页
+struct BarrierNotices {
+    std::map<uint32_t, uint16_t> pages;
+    bool overflow { false };        // 超过 DSM_BARRIER_NOTICE_MAX 页，不再逐页记录
+
+    void Add(uint32_t page, uint16_t writer);
+
+    // 并入一条 JOIN_REQ 或 JOIN_ACK 携带的写通知，负载格式错误时返回 false
+    bool Merge(RpcMessage &msg);
+
+    // 报文头的 unused 字段（0 或 DSM_BARRIER_ALL）与负载
+    uint8_t Flags() const;
+    std::vector<char> Encode() const;
+};
+
+#endif /* OS_BARRIER_TREE_H */
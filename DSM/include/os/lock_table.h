@@ -3,16 +3,34 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <limits>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include <pthread.h>
 
+#include "net/transport.h"
 #include "os/table_base.hpp"
 
-// LockRecord 以 pthread 互斥锁为核心，辅以失效集合统计
+// 等待锁的一个 LOCK_ACQ；锁释放时处理 LOCK_RLS 的线程经 peer 向它发送 LOCK_REP
+struct LockWaiter {
+    std::shared_ptr<Transport> peer;      // 请求到达的连接
+    uint16_t requester_id { 0 };
+    uint32_t seq_num { 0 };
+    uint8_t mode { DSM_LOCK_MUTEX };      // 请求的方式（DSM_LOCK_MUTEX / DSM_LOCK_WRITE / DSM_LOCK_READ）
+};
+
+// LockRecord 是锁的显式状态：独占的持有者或共享的读者，以及按到达顺序排队的等待者
+// pthread 互斥锁只在读改这些字段时短暂持有，不代表分布式锁本身，守护进程线程不会阻塞在上面等锁
 struct LockRecord {
-    pthread_mutex_t mutex;                // 局部锁
+    pthread_mutex_t mutex;                // 局部锁，保护以下字段
+    int holder { -1 };                    // 独占持有锁的节点，-1 表示没有
+    uint8_t holder_mode { DSM_LOCK_MUTEX };   // holder 取得锁的方式，只有 DSM_LOCK_MUTEX 会缓存令牌
+    bool recalled { false };              // 已请 holder 交回缓存的令牌（DSM_MSG_LOCK_RECALL）
+    std::multiset<int> readers;           // 以 DSM_LOCK_READ 持有锁的节点，一个节点可出现多次
+    std::deque<LockWaiter> waiters;       // 等待授予的 LOCK_ACQ（FIFO）
     uint32_t invalid_set_count { 0 };     // 失效页计数
     std::vector<int> invalid_page_list;   // 失效页列表
 
@@ -25,7 +43,12 @@ struct LockRecord {
     }
 
     LockRecord(const LockRecord &other)
-        : invalid_set_count(other.invalid_set_count),
+        : holder(other.holder),
+          holder_mode(other.holder_mode),
+          recalled(other.recalled),
+          readers(other.readers),
+          waiters(other.waiters),
+          invalid_set_count(other.invalid_set_count),
           invalid_page_list(other.invalid_page_list)
     {
         ::pthread_mutex_init(&mutex, nullptr);
@@ -35,6 +58,11 @@ struct LockRecord {
         if (this != &other) {
             ::pthread_mutex_destroy(&mutex);
             ::pthread_mutex_init(&mutex, nullptr);
+            holder = other.holder;
+            holder_mode = other.holder_mode;
+            recalled = other.recalled;
+            readers = other.readers;
+            waiters = other.waiters;
             invalid_set_count = other.invalid_set_count;
             invalid_page_list = other.invalid_page_list;
         }
@@ -42,7 +70,12 @@ struct LockRecord {
     }
 
     LockRecord(LockRecord &&other) noexcept
-        : invalid_set_count(other.invalid_set_count),
+        : holder(other.holder),
+          holder_mode(other.holder_mode),
+          recalled(other.recalled),
+          readers(std::move(other.readers)),
+          waiters(std::move(other.waiters)),
+          invalid_set_count(other.invalid_set_count),
           invalid_page_list(std::move(other.invalid_page_list))
     {
         ::pthread_mutex_init(&mutex, nullptr);
@@ -52,6 +85,11 @@ struct LockRecord {
         if (this != &other) {
             ::pthread_mutex_destroy(&mutex);
             ::pthread_mutex_init(&mutex, nullptr);
+            holder = other.holder;
+            holder_mode = other.holder_mode;
+            recalled = other.recalled;
+            readers = std::move(other.readers);
+            waiters = std::move(other.waiters);
             invalid_set_count = other.invalid_set_count;
             invalid_page_list = std::move(other.invalid_page_list);
         }
@@ -94,6 +132,107 @@ public:
         int rc = ::pthread_mutex_unlock(&record->mutex);
         return rc == 0;
     }
+
+    // LOCK_ACQ：能立即授予时交给 waiter.requester_id 并取出失效页列表，返回 true；
+    // 否则 waiter 排到队尾，返回 false，之后由 Release 交给它
+    // 独占请求要求锁完全空闲；读请求只要没有独占持有者、也没有人排队（不越过等待的写者）
+    bool Acquire(int lock_id, const LockWaiter &waiter, std::vector<int> &invalid_pages) {
+        LockRecord *record = Record(lock_id);
+        ::pthread_mutex_lock(&record->mutex);
+        bool granted = record->holder == -1 && record->waiters.empty()
+                       && (waiter.mode == DSM_LOCK_READ || record->readers.empty());
+        if (granted) {
+            Grant(record, waiter);
+            invalid_pages = record->invalid_page_list;
+        } else {
+            record->waiters.push_back(waiter);
+        }
+        ::pthread_mutex_unlock(&record->mutex);
+        return granted;
+    }
+
+    enum ReleaseResult { NOT_HELD, FREED, HANDED_OVER };
+
+    // LOCK_RLS：独占持有者释放时记下它在临界区内写过的页，读者释放时不改变失效页列表（读者不写）
+    // 锁因此可以授予队首时交给它（HANDED_OVER，写入 granted，grant_pages 为它们应失效的页）：
+    // 队首是读请求时，一并授予紧随其后的所有读请求；否则返回 FREED（可能仍有其他读者）
+    // node 并不持有该锁时不做任何改变（NOT_HELD）
+    ReleaseResult Release(int lock_id, int node, const std::vector<int> &invalid_pages,
+                          std::vector<LockWaiter> &granted, std::vector<int> &grant_pages) {
+        LockRecord *record = Record(lock_id);
+        ::pthread_mutex_lock(&record->mutex);
+        ReleaseResult result = NOT_HELD;
+        auto reader = record->readers.find(node);
+        if (record->holder == node) {
+            record->invalid_page_list = invalid_pages;
+            record->invalid_set_count = static_cast<uint32_t>(invalid_pages.size());
+            record->holder = -1;
+            record->recalled = false;
+            result = FREED;
+        } else if (reader != record->readers.end()) {
+            record->readers.erase(reader);
+            result = FREED;
+        }
+        if (result == FREED && GrantWaiters(record, granted)) {
+            grant_pages = record->invalid_page_list;
+            result = HANDED_OVER;
+        }
+        ::pthread_mutex_unlock(&record->mutex);
+        return result;
+    }
+
+    // 锁被占用、有节点在等且尚未召回时，记下已召回并返回应交回令牌的持有者，否则返回 -1
+    int TakeRecall(int lock_id) {
+        LockRecord *record = Record(lock_id);
+        ::pthread_mutex_lock(&record->mutex);
+        int holder = -1;
+        if (record->holder != -1 && record->holder_mode == DSM_LOCK_MUTEX
+            && !record->waiters.empty() && !record->recalled) {
+            record->recalled = true;
+            holder = record->holder;
+        }
+        ::pthread_mutex_unlock(&record->mutex);
+        return holder;
+    }
+
+private:
+    // 把锁交给 waiter（调用者持有 record->mutex）
+    static void Grant(LockRecord *record, const LockWaiter &waiter) {
+        if (waiter.mode == DSM_LOCK_READ) {
+            record->readers.insert(waiter.requester_id);
+        } else {
+            record->holder = waiter.requester_id;
+            record->holder_mode = waiter.mode;
+            record->recalled = false;
+        }
+    }
+
+    // 从队首起授予所有此刻能授予的请求：一个独占请求，或一串连续的读请求
+    static bool GrantWaiters(LockRecord *record, std::vector<LockWaiter> &granted) {
+        granted.clear();
+        while (!record->waiters.empty() && record->holder == -1) {
+            LockWaiter &front = record->waiters.front();
+            if (front.mode != DSM_LOCK_READ && !(record->readers.empty() && granted.empty())) {
+                break;
+            }
+            Grant(record, front);
+            granted.push_back(std::move(front));
+            record->waiters.pop_front();
+        }
+        return !granted.empty();
+    }
+
+    // 查找（不存在时创建）锁记录；记录创建后不会删除，释放全局锁后仍可用
+    LockRecord *Record(int lock_id) {
+        GlobalMutexLock();
+        LockRecord *record = Find(lock_id);
+        if (record == nullptr) {
+            Insert(lock_id, LockRecord());
+            record = Find(lock_id);
+        }
+        GlobalMutexUnlock();
+        return record;
+    }
 };
 
 
@@ -0,0 +1,25 @@
+#ifndef OS_PAGE_DIFF_H
+#define OS_PAGE_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 多写者协议的 run-length diff 编码
+// 以 4 字节字为粒度比较页面与其 twin，每个连续的不同区间编码为：
+//     uint16_t offset (网络字节序，页内字节偏移)
+//     uint16_t length (网络字节序，字节数)
+//     uint8_t  data[length]
+// 最坏情况（整页改动）编码长度为 size + 4
+#define DSM_DIFF_MAX_SIZE(size) ((size) + 4)
+
+// 编码 page 相对 twin 的改动，返回写入 out 的字节数（0 表示没有改动）
+// size 必须是 4 的倍数且不超过 65535；out 至少 DSM_DIFF_MAX_SIZE(size) 字节
+size_t dsm_diff_encode(const void *page, const void *twin, size_t size, uint8_t *out);
+
+// 把 diff 合并进 page，diff 越界或格式错误时返回 false
+bool dsm_diff_apply(void *page, size_t size, const uint8_t *diff, size_t diff_len);
+
+// 页面是否全为 0（PAGE_REP 零页省略），size 必须是 4 的倍数
+bool dsm_page_is_zero(const void *page, size_t size);
+
+#endif /* OS_PAGE_DIFF_H */
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <limits>
 #include <string>
+#include <vector>
 #include <pthread.h>
 
 #include "os/table_base.hpp"
@@ -15,6 +16,10 @@ struct PageRecord {
     std::string filepath;                 // 保存该页绑定的文件路径
     int offset { 0 };                     // 保存页的偏移页数，真实偏移量为 offset * PAGESIZE
     int fd { -1 };                        // 文件描述符，保持打开
+    const char *file_data { nullptr };    // Pod 0：该页在文件只读映射中的地址，映射失败时为空（退回 pread）
+    size_t file_len { 0 };                // 映射中属于该页的有效字节数，文件末页不足 PAGESIZE
+    std::vector<int> copyset;             // 持有只读副本的节点（仅 manager 维护）
+    uint32_t version { 0 };               // 所有权转移次数：owner 每次把页交给写者时加一并随页面发出；manager 中为目录已接受的最新值
 
     PageRecord() noexcept {
         ::pthread_mutex_init(&mutex, nullptr);
@@ -28,7 +33,11 @@ struct PageRecord {
         : owner_id(other.owner_id),
           filepath(other.filepath),
           offset(other.offset),
-          fd(other.fd)
+          fd(other.fd),
+          file_data(other.file_data),
+          file_len(other.file_len),
+          copyset(other.copyset),
+          version(other.version)
     {
         ::pthread_mutex_init(&mutex, nullptr);
     }
@@ -41,6 +50,10 @@ struct PageRecord {
             filepath = other.filepath;
             offset = other.offset;
             fd = other.fd;
+            file_data = other.file_data;
+            file_len = other.file_len;
+            copyset = other.copyset;
+            version = other.version;
         }
         return *this;
     }
@@ -49,7 +62,11 @@ struct PageRecord {
         : owner_id(other.owner_id),
           filepath(std::move(other.filepath)),
           offset(other.offset),
-          fd(other.fd)
+          fd(other.fd),
+          file_data(other.file_data),
+          file_len(other.file_len),
+          copyset(std::move(other.copyset)),
+          version(other.version)
     {
         ::pthread_mutex_init(&mutex, nullptr);
     }
@@ -62,9 +79,24 @@ struct PageRecord {
             filepath = std::move(other.filepath);
             offset = other.offset;
             fd = other.fd;
+            file_data = other.file_data;
+            file_len = other.file_len;
+            copyset = std::move(other.copyset);
+            version = other.version;
         }
         return *this;
     }
+
+    // manager 处理 WRITER 更新：new_version 不早于 version 时记下新 owner 并返回 true；
+    // 更早的更新是迟到的（之后的转移已先到达），目录不变，返回 false
+    bool AcceptWriter(int new_owner, uint32_t new_version) noexcept {
+        if (static_cast<int32_t>(new_version - version) < 0) {
+            return false;
+        }
+        owner_id = new_owner;
+        version = new_version;
+        return true;
+    }
 };
 
 //键int不是虚拟地址 是虚拟页号
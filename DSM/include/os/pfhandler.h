@@ -1,14 +1,37 @@
 #ifndef PFHANDLER_H
-#define PFHANDLER_H 
+#define PFHANDLER_H
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 extern size_t SharedPages;                  //
-extern int *InvalidPages ;     
+extern int *InvalidPages ;                  // 1: 本节点在当前临界区内写过该页（释放锁时作为失效页列表发出）
+extern int *BarrierPages ;                  // 1: 本节点自上次 barrier 以来写过该页（到达 barrier 时作为写通知发出）
+extern int *PageAccess ;                    // 一致性协议授予本节点的访问权限：PROT_NONE / PROT_READ / PROT_READ|PROT_WRITE
+extern int *ProbOwner ;                     // 页面的可能 owner（来自重定向、副本来源、所有权转移），-1 表示未知，缺页时先问它
+extern int *BlockFirst ;                    // 页面所在一致性块的首页（相对下标），同一块的页连续且值相同，缺页时整块调入
+extern char *TwinArea ;                     // 多写者模式：首次写缺页时保存的页面 twin，与共享区按页一一对应
+extern char *HomeArea ;                     // 多写者模式：本节点作为 home 时合并 diff 的主副本
 
-void install_handler(void* base_addr, size_t num_pages);
+// SIGSEGV 处理函数只把缺页交给 num_threads 个保护缺页服务线程，在 futex 上睡眠等待，
+// 信号上下文中不做网络 I/O、加锁与输出
+void install_handler(void* base_addr, size_t num_pages, int num_threads);
 
-void pull_remote_page(int VPN);
+// 用 userfaultfd 接管共享区的缺页（missing）：num_threads 个服务线程调页并以 UFFDIO_COPY 安装
+// 内核不支持时返回 false，继续由 SIGSEGV 的服务线程调页
+bool install_fault_service(void* base_addr, size_t num_pages, int num_threads);
+
+void pull_remote_page(int VPN, bool is_write);
+
+// 一次调入多页：按节点分组发送 DSM_MSG_PAGE_BATCH_REQ，重定向的页再按新目标分组重发
+void pull_remote_pages(const std::vector<int>& VPNs, bool is_write);
+
+// 等待此前排队的 OWNER_UPDATE 全部得到 Manager 确认：缺页路径只把所有权更新排队，由后台线程成批发出，
+// 锁的获取与释放、barrier 调用它，保证写者使只读副本失效、被拒绝的副本被丢弃都发生在同步点之前
+void flush_owner_updates();
+
+// 丢弃本地副本（Manager 的失效通知、锁获取时的失效页），下次访问重新调页
+void invalidate_local_page(int VPN);
 
 #endif
@@ -1,49 +1,71 @@
 #ifndef OS_SOCKET_TABLE_H
 #define OS_SOCKET_TABLE_H
 
+#include <atomic>
 #include <cstddef>
-#include <cstdint>
-#include <limits>
+#include <memory>
+#include <mutex>
 
-#include "os/table_base.hpp"
+#include "net/rpc_channel.h"
 
-struct SocketRecord {
-   int socket { -1 };
-   uint32_t next_seq { 1 };  // per-connection seq counter
+#define DSM_CONNECT_WAIT_MS 10000   // dsm_init 建立连接时等待尚未监听的节点的最长时间
 
-   uint32_t allocate_seq() noexcept {
-      uint32_t current = next_seq;
-      next_seq = (next_seq == std::numeric_limits<uint32_t>::max()) ? 1 : next_seq + 1;
-      return current;
+// 按节点号直接索引的连接表：每个节点一个槽位，保存到该节点的 RpcChannel（TCP 或同机共享内存），
+// seq_num 与发送锁都在 RpcChannel 内，各连接互不影响
+// 每个槽位有两条通道：BULK 承载页面请求与 PAGE_DIFF；CONTROL 承载锁、barrier 与 OWNER_UPDATE，
+// DSM_CONTROL_UDP 打开且 BULK 走 TCP 时是单独的 UDP 通道，否则与 BULK 是同一条
+// 连接在 dsm_init 时并行建立，之后的查找只是一次原子读，缺页与锁路径不再查地址、不再加全局锁
+// 连接随进程存在，建立后不再替换或删除
+class SocketTable final {
+public:
+   enum Lane { BULK = 0, CONTROL = 1, LANES = 2 };
+
+   explicit SocketTable(int nodes)
+        : nodes_(nodes > 0 ? nodes : 0), slots_(new Slot[nodes_])
+   {
    }
-};
 
-class SocketTable final : public TableBase<int, SocketRecord> {
-public:
-   using Base = TableBase<int, SocketRecord>;
+   SocketTable(const SocketTable &) = delete;
+   SocketTable &operator=(const SocketTable &) = delete;
+
+   int Size() const { return nodes_; }
 
-   explicit SocketTable(std::size_t capacity = 0)
-        : Base(capacity == 0 ? std::numeric_limits<std::size_t>::max() : capacity)
+   // 到 node 的连接，尚未建立（或 node 越界）时返回空
+   RpcChannel *Find(int node, Lane lane = BULK) const
    {
+      if (node < 0 || node >= nodes_)
+         return nullptr;
+      return slots_[node].channel[lane].load(std::memory_order_acquire);
    }
 
-   using Base::Clear;
-   using Base::Find;
-   using Base::Insert;
-   using Base::Remove;
-   using Base::Size;
-   using Base::Update;
-   using Base::GlobalMutexLock;
-   using Base::GlobalMutexUnlock;
-
-   // 为指定节点分配一个 seq 号，如果记录不存在返回 0
-   uint32_t NextSeq(int node_id) {
-        GlobalMutexLock();
-        auto *record = Find(node_id);
-        uint32_t seq = record ? record->allocate_seq() : 0;
-        GlobalMutexUnlock();
-        return seq;
+   // 建立到 node 的连接时持有，避免两个线程同时连接同一节点
+   std::mutex &SlotMutex(int node) { return slots_[node].mutex; }
+
+   // 在 SlotMutex(node) 下调用，返回装入的连接
+   RpcChannel *Install(int node, std::unique_ptr<RpcChannel> channel, Lane lane = BULK)
+   {
+      RpcChannel *raw = channel.get();
+      slots_[node].owner[lane] = std::move(channel);
+      slots_[node].channel[lane].store(raw, std::memory_order_release);
+      return raw;
+   }
+
+   // 同 Install，但该通道由另一条 lane 持有
+   RpcChannel *Alias(int node, Lane lane, RpcChannel *channel)
+   {
+      slots_[node].channel[lane].store(channel, std::memory_order_release);
+      return channel;
    }
+
+private:
+   struct Slot {
+      std::mutex mutex;                          // 建立连接时持有
+      std::unique_ptr<RpcChannel> owner[LANES];
+      std::atomic<RpcChannel *> channel[LANES] {};
+   };
+
+   int nodes_;
+   std::unique_ptr<Slot[]> slots_;
 };
 
 #endif /* OS_SOCKET_TABLE_H */
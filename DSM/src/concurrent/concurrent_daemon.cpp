@@ -3,142 +3,185 @@
 #include <vector>
 #include <mutex>
 #include <map>
+#include <deque>
+#include <memory>
+#include <condition_variable>
+#include <algorithm>
+#include <tuple>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <cerrno>
 #include <sys/mman.h>
+#include <sys/epoll.h>
 
 #include "concurrent/concurrent_core.h"
 #include "net/protocol.h"
+#include "os/barrier_tree.h"
+#include "os/pfhandler.h"
+#include "os/page_diff.h"
+#include "net/page_codec.h"
+#include "net/msg_builder.h"
+#include "net/shm_transport.h"
+#include "net/uring_engine.h"
+#include "net/udp_transport.h"
+#include "net/rpc_channel.h"
+#include "os/socket_table.h"
 #include "dsm.h"
 
+extern int SAB_VPNumber;  // Base virtual page number of shared region
+extern bool PodSharesHost(int pod_id);
 
 
-std::mutex join_mutex;                  // Protects shared state
-std::vector<int> joined_fds;           // Connected client sockets (bidirectional channels)
-bool barrier_ready = false;            // Whether all processes have joined
-int joined_count = 0;                  // Counter for joined processes (protected by join_mutex)
+// A JOIN_REQ waiting for the release: from our own pod or from a child
+// daemon in the barrier tree
+struct JoinArrival {
+    PeerRef peer;
+    uint32_t seq_num;
+    uint16_t node;
+};
 
+std::mutex join_mutex;                   // Protects join_arrivals and join_notices
+std::vector<JoinArrival> join_arrivals;  // Arrivals of the barrier in progress
+BarrierNotices join_notices;             // Pages the arrivals' subtrees wrote
 
-void process_join_req(int sock, const dsm_header_t &head) {
-    // Extract source node ID from header
-    uint16_t src_node = ntohs(head.src_node_id);
-    
-    std::cout << "[DSM Daemon] Received JOIN_REQ: NodeId=" << src_node << std::endl;
+extern RpcChannel* getcontrol(int node);
 
-    // Acquire the join mutex to protect shared state
-    join_mutex.lock();
-    
-    // Check if this fd is already in the joined list
-    bool already_joined = false;
-    for (int fd : joined_fds) {
-        if (fd == sock) {
-            already_joined = true;
-            break;
+// This pod's place in the barrier tree, fixed once the configuration is read
+static const BarrierLinks &barrier_links() {
+    static const BarrierLinks links = [] {
+        std::vector<std::string> hosts;
+        for (int pod = 0; pod < ProcNum; pod++) {
+            hosts.push_back(PodHostIp(pod));
+        }
+        return dsm_barrier_links(PodId, hosts, BarrierFanout);
+    }();
+    return links;
+}
+
+// Send JOIN_ACK with the write notices of all pods to every arrival. Our own
+// pod is released last: after the final barrier it exits, and the daemon
+// with it, which must not cut the release of the subtree short
+static void release_barrier(const std::vector<JoinArrival> &arrivals, uint8_t flags, const std::vector<char> &notices) {
+    std::vector<const JoinArrival *> release_order;
+    for (const JoinArrival &arrival : arrivals) {
+        if (arrival.node != PodId) {
+            release_order.push_back(&arrival);
         }
     }
-    
-    // Add to joined_fds if not already present
-    if (!already_joined) {
-        joined_fds.push_back(sock);
+    for (const JoinArrival &arrival : arrivals) {
+        if (arrival.node == PodId) {
+            release_order.push_back(&arrival);
+        }
     }
-    
-    joined_count++;
-    
-    std::cout << "[DSM Daemon] Currently connected: socket number " << sock << std::endl;
 
-    // Check if all processes have joined
-    if (joined_count < ProcNum) {
-        join_mutex.unlock();
-        return;  // Keep connection open and continue processing
-    }
-    
-    // All processes have joined, broadcast JOIN_ACK to all
-    std::cout << "[DSM Daemon] All processes ready, broadcasting JOIN_ACK..." << std::endl;
-    
-    joined_count = 0;  // Reset for potential future barriers
-    
-    for (int fd : joined_fds) {
+    for (const JoinArrival *arrival : release_order) {
         dsm_header_t ack = {
             DSM_MSG_ACK,
-            0,
+            flags,
             htons(PodId),
-            htonl(1),
+            htonl(arrival->seq_num),
             0
         };
+        MsgBuilder rep(ack);
+        rep.Add(notices.data(), notices.size());
         
-        ssize_t sent = ::send(fd, &ack, sizeof(ack), 0);
-        if (sent == sizeof(ack)) {
-            std::cout << "[DSM Daemon] Sent JOIN_ACK to fd=" << fd << std::endl;
+        if (arrival->peer->Send(rep)) {
+            std::cout << "[DSM Daemon] Sent JOIN_ACK to " << arrival->peer->Name() << std::endl;
         } else {
-            std::cerr << "[DSM Daemon] Failed to send JOIN_ACK to fd=" << fd << std::endl;
+            std::cerr << "[DSM Daemon] Failed to send JOIN_ACK to " << arrival->peer->Name() << std::endl;
         }
     }
     
     std::cout << "[DSM Daemon] Barrier synchronization complete!" << std::endl;
-    
-    join_mutex.unlock();
 }
 
-void process_lock_acq(int sock, const dsm_header_t &head, rio_t &rp) {
-    /*pseudo code:
-    //请你查看以下代码是否按照以下原则进行：
-    1.对大表的增删查改必须获取全局锁
-    2.一旦查到某个数据存在,想要读/修改某个值,必须释放全局锁,获取局部锁
-    所以锁的调用链是这样:
-    获取全局锁-查表某个原子是否存在-释放全局锁-获取局部锁-等待对应进程再发送消息(释放锁)并更新-释放局部锁
-    */
-
-
-
-    // Read the payload to get lock_id
-    uint32_t payload_len = ntohl(head.payload_len);
-    if (payload_len < sizeof(payload_lock_req_t)) {
-        std::cerr << "[DSM Daemon] Invalid LOCK_ACQ payload length" << std::endl;
-        return;
-    }
-
-    payload_lock_req_t req_payload;
-    if (rio_readn(&rp, &req_payload, sizeof(req_payload)) != sizeof(req_payload)) {
-        std::cerr << "[DSM Daemon] Failed to read LOCK_ACQ payload" << std::endl;
+// Our subtree has arrived: report it to the parent as one JOIN_REQ with the
+// pages the subtree wrote. The request is only posted; the parent's release
+// is passed on to the subtree from the channel's reader thread.
+static void forward_barrier(std::vector<JoinArrival> arrivals, const BarrierNotices &notices, int parent) {
+    RpcChannel *channel = getcontrol(parent);
+    if (channel == nullptr) {
+        std::cerr << "[DSM Daemon] Failed to connect to barrier parent Pod " << parent << std::endl;
         return;
     }
+    std::vector<char> payload = notices.Encode();
+    dsm_header_t req = {
+        DSM_MSG_JOIN_REQ,
+        notices.Flags(),
+        htons(PodId),
+        0,
+        htonl(static_cast<uint32_t>(payload.size()))
+    };
+    channel->Post(req, { { payload.data(), payload.size() } },
+                  [arrivals = std::move(arrivals), parent](bool ok, RpcMessage &ack) {
+        if (!ok) {
+            std::cerr << "[DSM Daemon] No JOIN_ACK from barrier parent Pod " << parent << std::endl;
+            return;
+        }
+        release_barrier(arrivals, ack.header.unused, ack.payload);
+    });
+}
 
-    uint32_t lock_id = ntohl(req_payload.lock_id);
-    uint16_t requester_id = ntohs(head.src_node_id);
-    uint32_t seq_num = ntohl(head.seq_num);
-
-    std::cout << "[DSM Daemon] Received LOCK_ACQ for lock " << lock_id 
-              << " from NodeId=" << requester_id << std::endl;
+void process_join_req(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    // Extract source node ID from header
+    uint16_t src_node = ntohs(head.src_node_id);
+    
+    std::cout << "[DSM Daemon] Received JOIN_REQ: NodeId=" << src_node << std::endl;
 
-    // Prepare or create lock record under table mutex
-    LockTable->GlobalMutexLock();
-    LockRecord* record = LockTable->Find(lock_id);
-    if (record == nullptr) {
-        LockRecord new_record;
-        LockTable->Insert(lock_id, new_record);
-        record = LockTable->Find(lock_id);
+    // Our own pod and each child daemon arrive once per barrier
+    const BarrierLinks &links = barrier_links();
+    std::vector<JoinArrival> arrivals;
+    BarrierNotices notices;
+    {
+        std::lock_guard<std::mutex> guard(join_mutex);
+        if (!join_notices.Merge(msg)) {
+            // Unknown writes: every pod revokes the whole region
+            std::cerr << "[DSM Daemon] Malformed write notices from NodeId=" << src_node << std::endl;
+            join_notices.overflow = true;
+            join_notices.pages.clear();
+        }
+        join_arrivals.push_back({ peer, ntohl(head.seq_num), src_node });
+        if (join_arrivals.size() < links.children.size() + 1) {
+            return;  // Keep connection open and continue processing
+        }
+        // The next barrier cannot start here before this one is released:
+        // our own pod is part of it
+        arrivals.swap(join_arrivals);
+        std::swap(notices, join_notices);
     }
-    LockTable->GlobalMutexUnlock();
 
-    // Block until we acquire the pthread mutex for this lock
-    if (!LockTable->LocalMutexLock(lock_id)) {
-        std::cerr << "[DSM Daemon] LocalMutexLock failed for lock " << lock_id << std::endl;
+    if (links.parent == -1) {
+        std::cout << "[DSM Daemon] All processes ready, broadcasting JOIN_ACK with "
+                  << notices.pages.size() << " written pages..." << std::endl;
+        release_barrier(arrivals, notices.Flags(), notices.Encode());
         return;
     }
 
-    
-    // Prepare invalid page list from the record
-    uint32_t invalid_count = record->invalid_page_list.size();
-    uint32_t payload_len_rep = sizeof(uint32_t) + invalid_count * sizeof(uint32_t);
+    // Waiting for the parent would hold up the reactor
+    std::cout << "[DSM Daemon] Subtree ready, reporting to Pod " << links.parent << std::endl;
+    forward_barrier(std::move(arrivals), notices, links.parent);
+}
+
+static void start_recall(uint32_t lock_id);
+
+// Send LOCK_REP for a lock the table has just given to requester_id, with
+// the pages the previous holder wrote
+static void grant_lock(const PeerRef &peer, uint32_t lock_id, uint16_t requester_id, uint32_t seq_num,
+                       const std::vector<int> &invalid_pages) {
+    uint32_t invalid_count = invalid_pages.size();
 
     std::cout << "[DSM Daemon] Granting lock " << lock_id << " to NodeId=" << requester_id 
               << " with " << invalid_count << " invalid pages" << std::endl;
 
-    // Copy invalid page list before releasing table lock
-    std::vector<int> invalid_pages = record->invalid_page_list;
+    // The invalid page list goes out as one segment in network byte order
+    std::vector<uint32_t> invalid_pages_net(invalid_count);
+    for (uint32_t i = 0; i < invalid_count; i++) {
+        invalid_pages_net[i] = htonl(static_cast<uint32_t>(invalid_pages[i]));
+    }
 
     // Send LOCK_REP with unused=1 to indicate lock is granted
     dsm_header_t rep_header = {
@@ -146,40 +189,54 @@ void process_lock_acq(int sock, const dsm_header_t &head, rio_t &rp) {
         1,  // unused=1: lock is granted
         htons(PodId),
         htonl(seq_num),
-        htonl(payload_len_rep)
+        0
     };
+    uint32_t invalid_count_net = htonl(invalid_count);
+    MsgBuilder rep(rep_header);
+    rep.Add(invalid_count_net).Add(invalid_pages_net.data(), invalid_count * sizeof(uint32_t));
 
-    if (::send(sock, &rep_header, sizeof(rep_header), 0) != sizeof(rep_header)) {
-        std::cerr << "[DSM Daemon] Failed to send LOCK_REP header" << std::endl;
-        // Unlock the mutex before returning
-        LockTable->LocalMutexUnlock(lock_id);
+    if (!peer->Send(rep)) {
+        std::cerr << "[DSM Daemon] Failed to send LOCK_REP" << std::endl;
         return;
     }
 
-    // Send invalid_set_count
-    uint32_t invalid_count_net = htonl(invalid_count);
-    if (::send(sock, &invalid_count_net, sizeof(invalid_count_net), 0) != sizeof(invalid_count_net)) {
-        std::cerr << "[DSM Daemon] Failed to send invalid_set_count" << std::endl;
-        // Unlock the mutex before returning
-        LockTable->LocalMutexUnlock(lock_id);
+    std::cout << "[DSM Daemon] Lock " << lock_id << " granted and held by NodeId=" << requester_id << std::endl;
+}
+
+void process_lock_acq(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    // Read the payload to get lock_id
+    uint32_t payload_len = ntohl(head.payload_len);
+    if (payload_len < sizeof(payload_lock_req_t)) {
+        std::cerr << "[DSM Daemon] Invalid LOCK_ACQ payload length" << std::endl;
         return;
     }
 
-    // Send invalid page list
-    for (int page_idx : invalid_pages) {
-        uint32_t page_idx_net = htonl(page_idx);
-        if (::send(sock, &page_idx_net, sizeof(page_idx_net), 0) != sizeof(page_idx_net)) {
-            std::cerr << "[DSM Daemon] Failed to send invalid page index" << std::endl;
-            // Unlock the mutex before returning
-            LockTable->LocalMutexUnlock(lock_id);
-            return;
-        }
+    payload_lock_req_t req_payload;
+    if (!msg.Read(&req_payload, sizeof(req_payload))) {
+        std::cerr << "[DSM Daemon] Failed to read LOCK_ACQ payload" << std::endl;
+        return;
     }
 
-    std::cout << "[DSM Daemon] Lock " << lock_id << " granted and held by NodeId=" << requester_id << std::endl;
+    uint32_t lock_id = ntohl(req_payload.lock_id);
+    uint16_t requester_id = ntohs(head.src_node_id);
+    uint32_t seq_num = ntohl(head.seq_num);
+    uint8_t mode = head.unused;
+
+    std::cout << "[DSM Daemon] Received LOCK_ACQ for lock " << lock_id 
+              << " from NodeId=" << requester_id << (mode == DSM_LOCK_READ ? " (shared)" : "") << std::endl;
+
+    // A busy lock queues the request and returns at once: the requester is
+    // granted by the holder's LOCK_RLS, so a waiting pod holds no daemon thread
+    std::vector<int> invalid_pages;
+    if (!LockTable->Acquire(lock_id, { peer, requester_id, seq_num, mode }, invalid_pages)) {
+        std::cout << "[DSM Daemon] Lock " << lock_id << " busy, NodeId=" << requester_id << " queued" << std::endl;
+        start_recall(lock_id);
+        return;
+    }
+    grant_lock(peer, lock_id, requester_id, seq_num, invalid_pages);
 }
 
-void process_lock_rls(int sock, const dsm_header_t &head, rio_t &rp) {
+void process_lock_rls(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
     // Read the release payload
     uint32_t payload_len = ntohl(head.payload_len);
     if (payload_len < sizeof(payload_lock_rls_t)) {
@@ -189,7 +246,7 @@ void process_lock_rls(int sock, const dsm_header_t &head, rio_t &rp) {
 
     // Read the payload structure (invalid_set_count and lock_id)
     payload_lock_rls_t rls_payload;
-    if (rio_readn(&rp, &rls_payload, sizeof(rls_payload)) != sizeof(rls_payload)) {
+    if (!msg.Read(&rls_payload, sizeof(rls_payload))) {
         std::cerr << "[DSM Daemon] Failed to read LOCK_RLS payload" << std::endl;
         return;
     }
@@ -203,7 +260,7 @@ void process_lock_rls(int sock, const dsm_header_t &head, rio_t &rp) {
     std::vector<int> new_invalid_pages;
     for (uint32_t i = 0; i < rls_invalid_count; i++) {
         uint32_t page_idx;
-        if (rio_readn(&rp, &page_idx, sizeof(page_idx)) != sizeof(page_idx)) {
+        if (!msg.Read(&page_idx, sizeof(page_idx))) {
             std::cerr << "[DSM Daemon] Failed to read invalid page index" << std::endl;
             break;
         }
@@ -213,20 +270,17 @@ void process_lock_rls(int sock, const dsm_header_t &head, rio_t &rp) {
     std::cout << "[DSM Daemon] Received LOCK_RLS from NodeId=" << src_node 
               << " with " << rls_invalid_count << " invalid pages" << std::endl;
 
-    
-        
-    LockRecord* record = LockTable->Find(lock_id);
-    if (record != nullptr) {
-        // Update invalid page list
-        record->invalid_page_list = new_invalid_pages;
-        record->invalid_set_count = rls_invalid_count;
-        
+    // Free the lock or pass it straight to the first queued LOCK_ACQ, or to
+    // every reader queued at the head
+    std::vector<LockWaiter> granted;
+    std::vector<int> grant_pages;
+    LockTable::ReleaseResult result = LockTable->Release(lock_id, src_node, new_invalid_pages, granted, grant_pages);
+    if (result == LockTable::NOT_HELD) {
+        std::cerr << "[DSM Daemon] NodeId=" << src_node << " released lock " << lock_id
+                  << " it does not hold" << std::endl;
+    } else {
         std::cout << "[DSM Daemon] Released lock " << lock_id << std::endl;
     }
-    
-    // 3. Release the local lock (acquired in handle_lock_acquire)
-    LockTable->LocalMutexUnlock(lock_id);
-    
 
     // Send ACK for the release
     dsm_header_t ack = {
@@ -237,42 +291,382 @@ void process_lock_rls(int sock, const dsm_header_t &head, rio_t &rp) {
         0
     };
     
-    if (::send(sock, &ack, sizeof(ack), 0) != sizeof(ack)) {
+    if (!peer->Send(MsgBuilder(ack))) {
         std::cerr << "[DSM Daemon] Failed to send ACK for LOCK_RLS" << std::endl;
+    } else {
+        std::cout << "[DSM Daemon] Sent ACK for LOCK_RLS" << std::endl;
+    }
+
+    // The hand-over is this one message; the next holder is granted even if
+    // the releaser has gone away
+    if (result == LockTable::HANDED_OVER) {
+        for (const LockWaiter &next : granted) {
+            grant_lock(next.peer, lock_id, next.requester_id, next.seq_num, grant_pages);
+        }
+        start_recall(lock_id);
+    }
+}
+
+void process_lock_recall(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    payload_lock_req_t req_payload;
+    if (ntohl(head.payload_len) < sizeof(req_payload) || !msg.Read(&req_payload, sizeof(req_payload))) {
+        std::cerr << "[DSM Daemon] Failed to read LOCK_RECALL payload" << std::endl;
         return;
     }
+    uint32_t lock_id = ntohl(req_payload.lock_id);
 
-    std::cout << "[DSM Daemon] Sent ACK for LOCK_RLS" << std::endl;
+    std::vector<int> pages;
+    bool returned = SurrenderLockToken(static_cast<int>(lock_id), pages);
+    std::cout << "[DSM Daemon] Lock " << lock_id << (returned ? " token returned" : " in use, returned at unlock")
+              << " on recall" << std::endl;
+
+    std::vector<uint32_t> pages_net;
+    for (int page : pages) {
+        pages_net.push_back(htonl(static_cast<uint32_t>(page)));
+    }
+    dsm_header_t ack = {
+        DSM_MSG_ACK,
+        static_cast<uint8_t>(returned ? DSM_LOCK_RECALL_RETURNED : DSM_LOCK_RECALL_DEFERRED),
+        htons(PodId),
+        head.seq_num,
+        0
+    };
+    MsgBuilder rep(ack);
+    if (returned) {
+        uint32_t count_net = htonl(static_cast<uint32_t>(pages_net.size()));
+        rep.Add(count_net).Add(pages_net.data(), pages_net.size() * sizeof(uint32_t));
+    }
+    if (!peer->Send(rep)) {
+        std::cerr << "[DSM Daemon] Failed to send ACK for LOCK_RECALL" << std::endl;
+    }
 }
 
-static bool handle_unknown_message(int connfd, const dsm_header_t &header) {
+static bool handle_unknown_message(const PeerRef &peer, const dsm_header_t &header) {
     std::cerr << "[DSM Daemon] Received unknown message type: 0x"
-              << std::hex << static_cast<int>(header.type) << std::dec << std::endl;
-    close(connfd);
+              << std::hex << static_cast<int>(header.type) << std::dec
+              << ", dropping connection " << peer->Name() << std::endl;
     return false;
 }
 
-void process_page_req(int sock, const dsm_header_t &head, rio_t &rp) {
-    // Read payload to get VPN
-    uint32_t payload_len = ntohl(head.payload_len);
-    if (payload_len < sizeof(payload_page_req_t)) {
-        std::cerr << "[DSM Daemon] Invalid PAGE_REQ payload length" << std::endl;
+// Daemon-to-daemon traffic stays off the getchannel() connections: the peer
+// serves one connection's requests in order, and a handler waiting there for
+// another daemon could queue behind requests that wait for this one
+static int connect_to_pod(int pod_id) {
+    std::string pod_ip = GetPodIp(pod_id);
+    int pod_port = GetPodPort(pod_id);
+
+    int pod_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (pod_sock < 0) {
+        std::cerr << "[DSM Daemon] Failed to create socket for Pod " << pod_id << std::endl;
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    std::memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(pod_port);
+    inet_pton(AF_INET, pod_ip.c_str(), &server_addr.sin_addr);
+
+    if (connect(pod_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        std::cerr << "[DSM Daemon] Failed to connect to Pod " << pod_id << std::endl;
+        close(pod_sock);
+        return -1;
+    }
+    int nodelay = 1;
+    setsockopt(pod_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return pod_sock;
+}
+
+// One channel to every other daemon, opened on first use and kept for the
+// life of the process. Only PAGE_INV, LOCK_RECALL and the home's initial
+// page fetch from Pod 0 travel on it; the peer answers all of them without
+// waiting for another daemon, so a reply never queues behind a request that
+// waits for this one. Never destroyed: the
+// channels' reader threads and pending invalidations outlive exit().
+static RpcChannel* daemon_channel(int pod_id) {
+    static class SocketTable& links = *new class SocketTable(ProcNum);
+    if (pod_id < 0 || pod_id >= links.Size()) {
+        return nullptr;
+    }
+    RpcChannel* channel = links.Find(pod_id);
+    if (channel != nullptr) {
+        return channel;
+    }
+
+    std::lock_guard<std::mutex> guard(links.SlotMutex(pod_id));
+    channel = links.Find(pod_id);
+    if (channel != nullptr) {
+        return channel;
+    }
+    int pod_sock = connect_to_pod(pod_id);
+    if (pod_sock < 0) {
+        return nullptr;
+    }
+    return links.Install(pod_id, std::make_unique<RpcChannel>(std::make_unique<TcpTransport>(pod_sock)));
+}
+
+// Tell the copyset members to drop their read-only replicas of VPN. Every
+// PAGE_INV is sent before any ACK is waited for, so the round trips overlap.
+static void send_page_invs(uint32_t VPN, const std::vector<int> &readers) {
+    dsm_header_t inv_header = {
+        DSM_MSG_PAGE_INV,
+        0,
+        htons(PodId),
+        0,
+        htonl(sizeof(payload_page_inv_t))
+    };
+    payload_page_inv_t inv_payload = {
+        htonl(VPN)
+    };
+
+    std::vector<std::tuple<int, RpcChannel*, uint32_t>> sent;   // reader, channel, seq
+    for (int reader : readers) {
+        if (reader == PodId) {
+            invalidate_local_page(static_cast<int>(VPN));
+            continue;
+        }
+        RpcChannel* channel = daemon_channel(reader);
+        uint32_t seq = channel != nullptr ? channel->Send(inv_header, { { &inv_payload, sizeof(inv_payload) } }) : 0;
+        if (seq == 0) {
+            std::cerr << "[DSM Daemon] Failed to send PAGE_INV of page " << VPN << " to Pod " << reader << std::endl;
+            continue;
+        }
+        sent.emplace_back(reader, channel, seq);
+    }
+
+    for (auto &inv : sent) {
+        RpcMessage ack;
+        if (!std::get<1>(inv)->Wait(std::get<2>(inv), ack) || ack.header.type != DSM_MSG_ACK) {
+            std::cerr << "[DSM Daemon] No ACK for PAGE_INV of page " << VPN << " from Pod " << std::get<0>(inv) << std::endl;
+        }
+    }
+}
+
+// Read LOCK_RECALL's answer: whether the token came back, with the pages
+// written under it
+static bool read_recall_ack(RpcMessage &ack, bool &returned, std::vector<int> &pages) {
+    if (ack.header.type != DSM_MSG_ACK) {
+        return false;
+    }
+    returned = ack.header.unused == DSM_LOCK_RECALL_RETURNED;
+    if (!returned) {
+        return true;
+    }
+    uint32_t count = 0;
+    if (!ack.Read(&count, sizeof(count))) {
+        return false;
+    }
+    count = ntohl(count);
+    std::vector<uint32_t> pages_net(count);
+    if (!ack.Read(pages_net.data(), count * sizeof(uint32_t))) {
+        return false;
+    }
+    for (uint32_t page : pages_net) {
+        pages.push_back(static_cast<int>(ntohl(page)));
+    }
+    return true;
+}
+
+// Pass the token holder gave back to the first pod queued for it, then see
+// whether the next holder has to give it up as well
+static void hand_over_token(uint32_t lock_id, int holder, const std::vector<int> &pages) {
+    std::vector<LockWaiter> granted;
+    std::vector<int> grant_pages;
+    if (LockTable->Release(static_cast<int>(lock_id), holder, pages, granted, grant_pages) == LockTable::HANDED_OVER) {
+        for (const LockWaiter &next : granted) {
+            grant_lock(next.peer, lock_id, next.requester_id, next.seq_num, grant_pages);
+        }
+        start_recall(lock_id);
+    }
+}
+
+// With token caching a holder keeps the lock after its unlock; once a pod
+// queues behind it, ask for the token back. The handlers of lock messages
+// must not wait for another daemon, so LOCK_RECALL is only posted and its
+// answer handled on the channel's reader thread. A token in use or still on
+// its way comes back with the holder's LOCK_RLS instead.
+static void start_recall(uint32_t lock_id) {
+    if (!LockCache) {
         return;
     }
-    
-    payload_page_req_t req_payload;
-    if (rio_readn(&rp, &req_payload, sizeof(req_payload)) != sizeof(req_payload)) {
-        std::cerr << "[DSM Daemon] Failed to read PAGE_REQ payload" << std::endl;
+    int holder = LockTable->TakeRecall(static_cast<int>(lock_id));
+    if (holder == -1) {
         return;
     }
-    
-    uint32_t VPN = ntohl(req_payload.page_index);
-    uint16_t requester_id = ntohs(head.src_node_id);
-    uint32_t seq_num = ntohl(head.seq_num);
-    
-    std::cout << "[DSM Daemon] Received PAGE_REQ for page " << VPN 
-              << " from NodeId=" << requester_id << std::endl;
-    
+    if (holder == PodId) {
+        std::vector<int> pages;
+        if (SurrenderLockToken(static_cast<int>(lock_id), pages)) {
+            hand_over_token(lock_id, holder, pages);
+        }
+        return;
+    }
+
+    RpcChannel* channel = daemon_channel(holder);
+    if (channel == nullptr) {
+        std::cerr << "[DSM Daemon] Failed to connect to Pod " << holder << " for LOCK_RECALL" << std::endl;
+        return;
+    }
+    dsm_header_t recall_header = {
+        DSM_MSG_LOCK_RECALL,
+        0,
+        htons(PodId),
+        0,
+        htonl(sizeof(payload_lock_req_t))
+    };
+    payload_lock_req_t recall_payload = {
+        htonl(lock_id)
+    };
+    channel->Post(recall_header, { { &recall_payload, sizeof(recall_payload) } },
+                  [lock_id, holder](bool ok, RpcMessage &ack) {
+        bool returned = false;
+        std::vector<int> pages;
+        if (!ok || !read_recall_ack(ack, returned, pages)) {
+            std::cerr << "[DSM Daemon] No answer to LOCK_RECALL of lock " << lock_id << " from Pod " << holder << std::endl;
+            return;
+        }
+        if (returned) {
+            hand_over_token(lock_id, holder, pages);
+        }
+    });
+}
+
+// Pod 0 only: the initial contents of a page, zeros past EOF or for pages
+// that are not bound to a file. A full page of a mapped file is returned in
+// place so it is sent straight from the page cache; anything else is built
+// in page_buffer.
+static const char* read_page_from_file(uint32_t VPN, char* page_buffer) {
+    // Copy the binding out under the global lock, the I/O runs without it
+    PageTable->GlobalMutexLock();
+    PageRecord* rec = PageTable->Find(VPN);
+    bool bound = (rec != nullptr && rec->fd >= 0 && !rec->filepath.empty());
+    int fd = bound ? rec->fd : -1;
+    int offset = bound ? rec->offset : 0;
+    const char* file_data = bound ? rec->file_data : nullptr;
+    size_t file_len = bound ? rec->file_len : 0;
+    PageTable->GlobalMutexUnlock();
+
+    if (!bound) {
+        std::cout << "[DSM Daemon] Page not bound to file, sending zero-filled page" << std::endl;
+        std::memset(page_buffer, 0, DSM_PAGE_SIZE);
+        return page_buffer;
+    }
+
+    if (file_data != nullptr) {
+        if (file_len == DSM_PAGE_SIZE) {
+            return file_data;
+        }
+        // Last page of the file: the mapping past EOF is not readable
+        std::memcpy(page_buffer, file_data, file_len);
+        std::memset(page_buffer + file_len, 0, DSM_PAGE_SIZE - file_len);
+        return page_buffer;
+    }
+
+    // No mapping: offset is the page number within the file
+    off_t file_offset = static_cast<off_t>(offset) * DSM_PAGE_SIZE;
+    ssize_t bytes_read = pread(fd, page_buffer, DSM_PAGE_SIZE, file_offset);
+    if (bytes_read < 0) {
+        std::cerr << "[DSM Daemon] Failed to read file data for page " << VPN << std::endl;
+        bytes_read = 0;
+    }
+    std::memset(page_buffer + bytes_read, 0, DSM_PAGE_SIZE - bytes_read);
+    return page_buffer;
+}
+
+// Ask Pod 0 for the initial contents of an untouched page; used by the
+// multiple-writer home, requesters go to Pod 0 themselves (see Case 2)
+static bool fetch_page_from_pod0(uint32_t VPN, uint8_t access, uint16_t& real_owner_id, char* page_buffer) {
+    RpcChannel* pod0 = daemon_channel(0);
+    if (pod0 == nullptr) {
+        return false;
+    }
+
+    dsm_header_t fwd_header = {
+        DSM_MSG_PAGE_REQ,
+        access,    // keep the requester's access type, no codec
+        htons(PodId),
+        0,
+        htonl(sizeof(payload_page_req_t))
+    };
+    payload_page_req_t fwd_payload = {
+        htonl(VPN)
+    };
+
+    RpcMessage rep;
+    uint32_t version;
+    if (!pod0->Call(fwd_header, { { &fwd_payload, sizeof(fwd_payload) } }, rep)
+        || rep.header.type != DSM_MSG_PAGE_REP
+        || !rep.Read(&real_owner_id, sizeof(real_owner_id)) || !rep.Read(&version, sizeof(version))) {
+        std::cerr << "[DSM Daemon] Failed to receive response from Pod 0" << std::endl;
+        return false;
+    }
+    real_owner_id = ntohs(real_owner_id);
+
+    const char* page_data = nullptr;
+    if (rep.header.unused == DSM_PAGE_REP_ZERO) {
+        std::memset(page_buffer, 0, DSM_PAGE_SIZE);
+    } else if ((page_data = rep.TakePage()) == nullptr) {
+        std::cerr << "[DSM Daemon] Failed to read page data from Pod 0" << std::endl;
+        return false;
+    } else {
+        std::memcpy(page_buffer, page_data, DSM_PAGE_SIZE);
+    }
+    return true;
+}
+
+// Multiple-writer pages live at their home (the manager) in HomeArea; the
+// first request or diff for a page loads its initial contents there.
+// Caller holds the page's local mutex.
+static char* load_home_copy(uint32_t VPN) {
+    char* home_copy = HomeArea + static_cast<size_t>(static_cast<int>(VPN) - SAB_VPNumber) * PAGESIZE;
+
+    PageTable->GlobalMutexLock();
+    PageRecord* record = PageTable->Find(VPN);
+    bool loaded = (record != nullptr && record->owner_id == PodId);
+    PageTable->GlobalMutexUnlock();
+    if (loaded) {
+        return home_copy;
+    }
+
+    if (PodId == 0) {
+        const char* file_page = read_page_from_file(VPN, home_copy);
+        if (file_page != home_copy) {
+            std::memcpy(home_copy, file_page, DSM_PAGE_SIZE);
+        }
+    } else {
+        uint16_t real_owner_id;
+        if (!fetch_page_from_pod0(VPN, DSM_PAGE_ACCESS_READ | DSM_PAGE_REQ_INITIAL, real_owner_id, home_copy)) {
+            return nullptr;
+        }
+    }
+
+    PageTable->GlobalMutexLock();
+    record = PageTable->Find(VPN);
+    if (record != nullptr) {
+        record->owner_id = PodId;
+    }
+    PageTable->GlobalMutexUnlock();
+    return home_copy;
+}
+
+// Outcome of serve_page for one requested page
+#define SERVE_PAGE_FAILED   -1
+#define SERVE_PAGE_REDIRECT  0
+#define SERVE_PAGE_DATA      1
+#define SERVE_PAGE_INITIAL   2
+
+// Look up one page on behalf of requester_id and either point page_data at
+// its contents (SERVE_PAGE_DATA) or name the node to ask next in
+// real_owner_id (SERVE_PAGE_REDIRECT, or SERVE_PAGE_INITIAL for an untouched
+// page that Pod 0 hands out). page_data is page_buffer unless the page comes
+// straight from a file mapping. initial is set when the manager sent the
+// requester here. version is the page's transfer count as the requester
+// should record it, bumped when a write takes the page from us. Shared by
+// PAGE_REQ and PAGE_BATCH_REQ.
+static int serve_page(uint32_t VPN, uint16_t requester_id, bool is_write, bool initial,
+                      uint16_t& real_owner_id, uint32_t& version, char* page_buffer, const char*& page_data) {
+    page_data = page_buffer;
+    version = 0;
+
     // Follow the locking principle:
     // 1. Acquire global lock to access the table
     PageTable->GlobalMutexLock();
@@ -280,275 +674,307 @@ void process_page_req(int sock, const dsm_header_t &head, rio_t &rp) {
     if (record == nullptr) {
         std::cerr << "[DSM Daemon] Error: page " << VPN << " beyond shared space" << std::endl;
         PageTable->GlobalMutexUnlock();
-        return;
+        return SERVE_PAGE_FAILED;
     }
-    int owner_id = record->owner_id;
-    // 2. Release global lock
-   
+    // 2. Release global lock before blocking on the page, the home path
+    //    below re-takes it while holding the local lock
+    PageTable->GlobalMutexUnlock();
 
     // 3. Acquire local lock to ensure sequential access
     if (!PageTable->LocalMutexLock(VPN)) {
         std::cerr << "[DSM Daemon] Failed to lock page " << VPN << std::endl;
-        return;
+        return SERVE_PAGE_FAILED;
     }
+    PageTable->GlobalMutexLock();
+    int owner_id = record->owner_id;
     PageTable->GlobalMutexUnlock();
-    
-    
+
+    int result = SERVE_PAGE_DATA;
+
+    // Case 0: Multiple-writer page and we are its home, serve the merged copy
+    if (MultiWriter && static_cast<int>(VPN % ProcNum) == PodId) {
+        char* home_copy = load_home_copy(VPN);
+        if (home_copy == nullptr) {
+            result = SERVE_PAGE_FAILED;
+        } else {
+            std::memcpy(page_buffer, home_copy, DSM_PAGE_SIZE);
+            real_owner_id = PodId;
+        }
+    }
     // Case 1: We are the real owner (owner_id == PodId)
-    if (owner_id == PodId) {
+    else if (owner_id == PodId) {
         std::cout << "[DSM Daemon] We are the owner of page " << VPN << ", sending page data" << std::endl;
         
-        // Prepare a buffer for page data
-        
-        // Compute page virtual address and ensure it's readable so we can memcpy
+        // Compute page virtual address and write-protect it before copying,
+        // so no local store can slip in between the copy and the downgrade
         void* page_addr = reinterpret_cast<void*>(static_cast<uintptr_t>(VPN) << 12);
+        int idx = static_cast<int>(VPN) - SAB_VPNumber;
         size_t total_size = PAGESIZE;
         if (mprotect(page_addr, total_size, PROT_READ) == -1) {
-            std::cerr << "[dsm_mutex_lock] mprotect failed: " << std::strerror(errno) << std::endl;
-        } else {
-            std::cerr << "[dsm_mutex_lock] mprotect succeed" << std::endl;
+            std::cerr << "[DSM Daemon] mprotect failed: " << std::strerror(errno) << std::endl;
         }
 
-        char page_buffer[PAGESIZE];
-        std::memset(page_buffer, 0, PAGESIZE);
-
         std::memcpy(page_buffer, page_addr, PAGESIZE);
 
-        if (mprotect(page_addr, total_size, PROT_NONE) == -1) {
-            std::cerr << "[dsm_mutex_lock] mprotect failed: " << std::strerror(errno) << std::endl;
-        } else {
-            std::cerr << "[dsm_mutex_lock] mprotect succeed" << std::endl;
-        }
-        
-        // Send page data
-        dsm_header_t rep_header = {
-            DSM_MSG_PAGE_REP,
-            1,  // unused=1: we have the page data
-            htons(PodId),
-            htonl(seq_num),
-            htonl(sizeof(uint16_t) + DSM_PAGE_SIZE)
-        };
-        
-        if (::send(sock, &rep_header, sizeof(rep_header), 0) != sizeof(rep_header)) {
-            std::cerr << "[DSM Daemon] Failed to send PAGE_REP header" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
+        if (is_write) {
+            // Ownership moves to the requester, our copy is stale from now on
+            PageAccess[idx] = PROT_NONE;
+            ProbOwner[idx] = requester_id;
+            PageTable->GlobalMutexLock();
+            record->owner_id = requester_id;
+            version = ++record->version;
+            PageTable->GlobalMutexUnlock();
+        } else if (PageAccess[idx] != PROT_NONE) {
+            // Keep ownership but share the page: our next store must go
+            // through the manager so the new reader gets invalidated
+            PageAccess[idx] = PROT_READ;
         }
-        
-        // Send real_owner_id (ourselves)
-        uint16_t real_owner_net = htons(PodId);
-        if (::send(sock, &real_owner_net, sizeof(real_owner_net), 0) != sizeof(real_owner_net)) {
-            std::cerr << "[DSM Daemon] Failed to send real_owner_id" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
+        if (mprotect(page_addr, total_size, PageAccess[idx]) == -1) {
+            std::cerr << "[DSM Daemon] mprotect failed: " << std::strerror(errno) << std::endl;
         }
-        
-        // Send page data from buffer
-        if (::send(sock, page_buffer, DSM_PAGE_SIZE, 0) != DSM_PAGE_SIZE) {
-            std::cerr << "[DSM Daemon] Failed to send page data" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
+        if (!is_write) {
+            PageTable->GlobalMutexLock();
+            version = record->version;
+            PageTable->GlobalMutexUnlock();
         }
+        real_owner_id = PodId;
+    }
+    // Stale hint: we never owned the page and are not its manager, so only
+    // the manager may decide it is untouched (Pod 0 still serves the requests
+    // the manager sent on, below)
+    else if (owner_id == -1 && static_cast<int>(VPN % ProcNum) != PodId
+             && !(PodId == 0 && initial)) {
+        std::cout << "[DSM Daemon] Page " << VPN << " never owned here, redirecting to its manager" << std::endl;
         
-        PageTable->LocalMutexUnlock(VPN);
-        return;
+        real_owner_id = static_cast<uint16_t>(VPN % ProcNum);
+        result = SERVE_PAGE_REDIRECT;
     }
     // Case 2: First access and we are not Pod 0 (owner_id == -1 && PodId != 0)
+    // Send the requester to Pod 0 instead of relaying the page, it still
+    // reports the new copy to us with OWNER_UPDATE
     else if (owner_id == -1 && PodId != 0) {
-        std::cout << "[DSM Daemon] First access, requesting page from Pod 0" << std::endl;
+        std::cout << "[DSM Daemon] First access, sending requester to Pod 0" << std::endl;
         
-        // Forward request to Pod 0
-        std::string pod0_ip = GetPodIp(0);
-        int pod0_port = GetPodPort(0);
+        real_owner_id = 0;
+        result = SERVE_PAGE_INITIAL;
+    }
+    // Case 3: First access and we are Pod 0 (owner_id == -1 && PodId == 0)
+    else if (owner_id == -1 && PodId == 0) {
+        std::cout << "[DSM Daemon] First access on Pod 0, loading from file" << std::endl;
         
-        int pod0_sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (pod0_sock < 0) {
-            std::cerr << "[DSM Daemon] Failed to create socket for Pod 0" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
+        page_data = read_page_from_file(VPN, page_buffer);
+        real_owner_id = 0;
+        // Writers racing for an untouched page are still told apart
+        if (is_write) {
+            PageTable->GlobalMutexLock();
+            version = ++record->version;
+            PageTable->GlobalMutexUnlock();
         }
-        
-        struct sockaddr_in server_addr;
-        std::memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(pod0_port);
-        inet_pton(AF_INET, pod0_ip.c_str(), &server_addr.sin_addr);
-        
-        if (connect(pod0_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            std::cerr << "[DSM Daemon] Failed to connect to Pod 0" << std::endl;
-            close(pod0_sock);
-            PageTable->LocalMutexUnlock(VPN);
-            return;
-        }
-        
-        // Send PAGE_REQ to Pod 0
-        dsm_header_t fwd_header = {
-            DSM_MSG_PAGE_REQ,
-            0,
-            htons(PodId),
-            htonl(1),
-            htonl(sizeof(payload_page_req_t))
-        };
-        
-        ::send(pod0_sock, &fwd_header, sizeof(fwd_header), 0);
-        ::send(pod0_sock, &req_payload, sizeof(req_payload), 0);
-        
-        // Receive response from Pod 0
-        rio_t pod0_rio;
-        rio_readinit(&pod0_rio, pod0_sock);
-        
-        dsm_header_t pod0_rep;
-        if (rio_readn(&pod0_rio, &pod0_rep, sizeof(pod0_rep)) != sizeof(pod0_rep)) {
-            std::cerr << "[DSM Daemon] Failed to receive response from Pod 0" << std::endl;
-            close(pod0_sock);
-            PageTable->LocalMutexUnlock(VPN);
-            return;
-        }
-        
-        // Read page data from Pod 0
-        uint16_t real_owner_id;
-        rio_readn(&pod0_rio, &real_owner_id, sizeof(real_owner_id));
-        
-        char page_buffer[DSM_PAGE_SIZE];
-        if (rio_readn(&pod0_rio, page_buffer, DSM_PAGE_SIZE) != DSM_PAGE_SIZE) {
-            std::cerr << "[DSM Daemon] Failed to read page data from Pod 0" << std::endl;
-            close(pod0_sock);
-            PageTable->LocalMutexUnlock(VPN);
-            return;
-        }
-        
-        close(pod0_sock);
-        
-        // Forward page data to requester
-        dsm_header_t rep_header = {
-            DSM_MSG_PAGE_REP,
-            1,  // unused=1: we have the page data
-            htons(PodId),
-            htonl(seq_num),
-            htonl(sizeof(uint16_t) + DSM_PAGE_SIZE)
-        };
-        
-        ::send(sock, &rep_header, sizeof(rep_header), 0);
-        ::send(sock, &real_owner_id, sizeof(real_owner_id), 0);
-        ::send(sock, page_buffer, DSM_PAGE_SIZE, 0);
-        
-        PageTable->LocalMutexUnlock(VPN);
-        return;
-    }
-    // Case 3: First access and we are Pod 0 (owner_id == -1 && PodId == 0)
-    else if (owner_id == -1 && PodId == 0) {
-        std::cout << "[DSM Daemon] First access on Pod 0, loading from file" << std::endl;
-        
-        // Prepare page buffer
-        char page_buffer[DSM_PAGE_SIZE];
-        std::memset(page_buffer, 0, DSM_PAGE_SIZE);
-        
-        // Try to read from file if this page is bound to a file
-        PageTable->GlobalMutexLock();
-        PageRecord* rec = PageTable->Find(VPN);
-        if (rec != nullptr && rec->fd >= 0 && !rec->filepath.empty()) {
-            // This page is bound to a file, read data from file
-            // rec->offset is the page number, need to multiply by page size
-            off_t file_offset = static_cast<off_t>(rec->offset) * DSM_PAGE_SIZE;
-            std::cout << "[DSM Daemon] Reading from file: " << rec->filepath 
-                     << " at page " << rec->offset << " (byte offset " << file_offset << ")" << std::endl;
-            
-            if (lseek(rec->fd, file_offset, SEEK_SET) >= 0) {
-                ssize_t bytes_read = read(rec->fd, page_buffer, DSM_PAGE_SIZE);
-                if (bytes_read < 0) {
-                    std::cerr << "[DSM Daemon] Failed to read file data for page " << VPN << std::endl;
-                } else {
-                    std::cout << "[DSM Daemon] Successfully read " << bytes_read 
-                             << " bytes from file" << std::endl;
-                }
-                // If less than page size, rest is already zero-filled
-            } else {
-                std::cerr << "[DSM Daemon] Failed to seek in file for page " << VPN << std::endl;
-            }
-            
-            // Update owner to Pod 0 after loading
-
-            //rec->owner_id = 0;
-        } else {
-            std::cout << "[DSM Daemon] Page not bound to file, sending zero-filled page" << std::endl;
-        }
-        PageTable->GlobalMutexUnlock();
-        
-        // Send page data
-        dsm_header_t rep_header = {
-            DSM_MSG_PAGE_REP,
-            1,  // unused=1: we have the page data
-            htons(PodId),
-            htonl(seq_num),
-            htonl(sizeof(uint16_t) + DSM_PAGE_SIZE)
-        };
-        
-        ::send(sock, &rep_header, sizeof(rep_header), 0);
-        
-        uint16_t real_owner_net = htons(0);
-        ::send(sock, &real_owner_net, sizeof(real_owner_net), 0);
-        ::send(sock, page_buffer, DSM_PAGE_SIZE, 0);
-        
-        PageTable->LocalMutexUnlock(VPN);
-        return;
     }
     // Case 4: We are not the owner (owner_id != PodId and owner_id != -1)
     else {
         std::cout << "[DSM Daemon] We are not the owner, redirecting to NodeId=" << owner_id << std::endl;
         
-        // Return real owner ID to requester
-        dsm_header_t rep_header = {
-            DSM_MSG_PAGE_REP,
-            0,  // unused=0: redirect to real owner
-            htons(PodId),
-            htonl(seq_num),
-            htonl(sizeof(uint16_t))  // Only sending real_owner_id, no page data
-        };
-        
-        if (::send(sock, &rep_header, sizeof(rep_header), 0) != sizeof(rep_header)) {
-            std::cerr << "[DSM Daemon] Failed to send PAGE_REP header (redirect)" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
-        }
-        
-        // Send real_owner_id
-        uint16_t real_owner_net = htons(owner_id);
-        if (::send(sock, &real_owner_net, sizeof(real_owner_net), 0) != sizeof(real_owner_net)) {
-            std::cerr << "[DSM Daemon] Failed to send real_owner_id (redirect)" << std::endl;
-            PageTable->LocalMutexUnlock(VPN);
-            return;
+        real_owner_id = static_cast<uint16_t>(owner_id);
+        result = SERVE_PAGE_REDIRECT;
+
+        // Path compression: a writer we point on becomes the owner, so later
+        // requests reaching us skip the rest of the chain. The manager's
+        // entry is the directory and only moves on OWNER_UPDATE.
+        if (is_write && static_cast<int>(VPN % ProcNum) != PodId) {
+            PageTable->GlobalMutexLock();
+            record->owner_id = requester_id;
+            PageTable->GlobalMutexUnlock();
         }
-        
-        PageTable->LocalMutexUnlock(VPN);
-        return;
     }
+
+    PageTable->LocalMutexUnlock(VPN);
+    return result;
 }
 
-void process_owner_update(int sock, const dsm_header_t &head, rio_t &rp) {
-    // Read payload to get VPN and new_owner_id
+void process_page_req(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    // Read payload to get VPN
     uint32_t payload_len = ntohl(head.payload_len);
-    if (payload_len < sizeof(payload_owner_update_t)) {
-        std::cerr << "[DSM Daemon] Invalid OWNER_UPDATE payload length" << std::endl;
+    if (payload_len < sizeof(payload_page_req_t)) {
+        std::cerr << "[DSM Daemon] Invalid PAGE_REQ payload length" << std::endl;
         return;
     }
     
-    payload_owner_update_t update_payload;
-    if (rio_readn(&rp, &update_payload, sizeof(update_payload)) != sizeof(update_payload)) {
-        std::cerr << "[DSM Daemon] Failed to read OWNER_UPDATE payload" << std::endl;
+    payload_page_req_t req_payload;
+    if (!msg.Read(&req_payload, sizeof(req_payload))) {
+        std::cerr << "[DSM Daemon] Failed to read PAGE_REQ payload" << std::endl;
         return;
     }
     
-    uint32_t VPN = ntohl(update_payload.resource_id);
-    uint16_t new_owner = ntohs(update_payload.new_owner_id);
+    uint32_t VPN = ntohl(req_payload.page_index);
+    uint16_t requester_id = ntohs(head.src_node_id);
     uint32_t seq_num = ntohl(head.seq_num);
+    bool is_write = (DSM_PAGE_REQ_ACCESS(head.unused) == DSM_PAGE_ACCESS_WRITE);
+    bool initial = DSM_PAGE_REQ_IS_INITIAL(head.unused);
+    int codec = DSM_PAGE_REQ_CODEC(head.unused);
+    
+    std::cout << "[DSM Daemon] Received PAGE_REQ (" << (is_write ? "write" : "read") << ") for page " << VPN 
+              << " from NodeId=" << requester_id << std::endl;
     
+    uint16_t real_owner_id = 0;
+    uint32_t version = 0;
+    char page_buffer[DSM_PAGE_SIZE];
+    const char* page_data = nullptr;
+    int result = serve_page(VPN, requester_id, is_write, initial, real_owner_id, version, page_buffer, page_data);
+    if (result == SERVE_PAGE_FAILED) {
+        return;
+    }
+    // Untouched and sparse pages travel as a bare header, compressible ones
+    // in the codec the requester asked for
+    uint8_t kind = (result == SERVE_PAGE_INITIAL) ? DSM_PAGE_REP_INITIAL : DSM_PAGE_REP_REDIRECT;
+    uint8_t packed[DSM_PAGE_SIZE];
+    size_t packed_len = 0;
+    if (result == SERVE_PAGE_DATA) {
+        kind = dsm_page_is_zero(page_data, DSM_PAGE_SIZE) ? DSM_PAGE_REP_ZERO : DSM_PAGE_REP_DATA;
+        if (kind == DSM_PAGE_REP_DATA && codec != DSM_CODEC_NONE) {
+            packed_len = dsm_codec_compress(codec, page_data, DSM_PAGE_SIZE, packed);
+            if (packed_len > 0) {
+                kind = DSM_PAGE_REP_PACKED;
+            }
+        }
+    }
+    dsm_header_t rep_header = {
+        DSM_MSG_PAGE_REP,
+        kind,
+        htons(PodId),
+        htonl(seq_num),
+        0
+    };
+    uint16_t real_owner_net = htons(real_owner_id);
+    uint32_t version_net = htonl(version);
+    payload_page_packed_t prefix = {
+        static_cast<uint8_t>(codec),
+        htons(static_cast<uint16_t>(packed_len))
+    };
+
+    // Header, owner id, version and page body leave in one sendmsg
+    MsgBuilder rep(rep_header);
+    rep.Add(real_owner_net).Add(version_net);
+    if (kind == DSM_PAGE_REP_DATA) {
+        rep.Add(page_data, DSM_PAGE_SIZE);
+    } else if (kind == DSM_PAGE_REP_PACKED) {
+        rep.Add(prefix).Add(packed, packed_len);
+    }
+
+    if (!peer->Send(rep)) {
+        std::cerr << "[DSM Daemon] Failed to send PAGE_REP" << std::endl;
+    }
+}
+
+void process_page_batch_req(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    uint32_t payload_len = ntohl(head.payload_len);
+    payload_page_batch_req_t req_payload;
+    if (payload_len < sizeof(req_payload)
+        || !msg.Read(&req_payload, sizeof(req_payload))) {
+        std::cerr << "[DSM Daemon] Failed to read PAGE_BATCH_REQ payload" << std::endl;
+        return;
+    }
+
+    uint32_t count = ntohl(req_payload.count);
+    if (count == 0 || count > DSM_PAGE_BATCH_MAX
+        || payload_len != sizeof(req_payload) + count * sizeof(uint32_t)) {
+        std::cerr << "[DSM Daemon] Invalid PAGE_BATCH_REQ page count " << count << std::endl;
+        return;
+    }
+
+    std::vector<uint32_t> pages(count);
+    if (!msg.Read(pages.data(), count * sizeof(uint32_t))) {
+        std::cerr << "[DSM Daemon] Failed to read PAGE_BATCH_REQ page list" << std::endl;
+        return;
+    }
+
+    uint16_t requester_id = ntohs(head.src_node_id);
+    uint32_t seq_num = ntohl(head.seq_num);
+    bool is_write = (DSM_PAGE_REQ_ACCESS(head.unused) == DSM_PAGE_ACCESS_WRITE);
+    bool initial = DSM_PAGE_REQ_IS_INITIAL(head.unused);
+    int codec = DSM_PAGE_REQ_CODEC(head.unused);
+
+    std::cout << "[DSM Daemon] Received PAGE_BATCH_REQ (" << (is_write ? "write" : "read") << ") for " << count
+              << " pages from NodeId=" << requester_id << std::endl;
+
+    // Every entry is answered in request order: data for the pages we can
+    // serve, the next hop for the rest. Raw pages go after all the entries,
+    // so the requester can read them straight into page-aligned buffers.
+    std::vector<char> reply;
+    reply.reserve(count * sizeof(payload_page_batch_entry_t));
+    std::vector<char> raw;
+    char page_buffer[DSM_PAGE_SIZE];
+    uint8_t packed[DSM_PAGE_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t VPN = ntohl(pages[i]);
+        uint16_t real_owner_id = 0;
+        uint32_t version = 0;
+        const char* page_data = nullptr;
+        int result = serve_page(VPN, requester_id, is_write, initial, real_owner_id, version, page_buffer, page_data);
+
+        uint8_t status = DSM_PAGE_BATCH_FAILED;
+        size_t packed_len = 0;
+        if (result == SERVE_PAGE_DATA) {
+            status = dsm_page_is_zero(page_data, DSM_PAGE_SIZE) ? DSM_PAGE_BATCH_ZERO : DSM_PAGE_BATCH_DATA;
+            if (status == DSM_PAGE_BATCH_DATA && codec != DSM_CODEC_NONE) {
+                packed_len = dsm_codec_compress(codec, page_data, DSM_PAGE_SIZE, packed);
+                if (packed_len > 0) {
+                    status = DSM_PAGE_BATCH_PACKED;
+                }
+            }
+        } else if (result == SERVE_PAGE_REDIRECT) {
+            status = DSM_PAGE_BATCH_REDIRECT;
+        } else if (result == SERVE_PAGE_INITIAL) {
+            status = DSM_PAGE_BATCH_INITIAL;
+        }
+
+        payload_page_batch_entry_t entry = {
+            htonl(VPN),
+            status,
+            htons(real_owner_id),
+            htonl(version)
+        };
+        const char* entry_bytes = reinterpret_cast<const char*>(&entry);
+        reply.insert(reply.end(), entry_bytes, entry_bytes + sizeof(entry));
+        if (status == DSM_PAGE_BATCH_DATA) {
+            raw.insert(raw.end(), page_data, page_data + DSM_PAGE_SIZE);
+        } else if (status == DSM_PAGE_BATCH_PACKED) {
+            payload_page_packed_t prefix = {
+                static_cast<uint8_t>(codec),
+                htons(static_cast<uint16_t>(packed_len))
+            };
+            const char* prefix_bytes = reinterpret_cast<const char*>(&prefix);
+            reply.insert(reply.end(), prefix_bytes, prefix_bytes + sizeof(prefix));
+            reply.insert(reply.end(), packed, packed + packed_len);
+        }
+    }
+
+    dsm_header_t rep_header = {
+        DSM_MSG_PAGE_BATCH_REP,
+        static_cast<uint8_t>(raw.size() / DSM_PAGE_SIZE),
+        htons(PodId),
+        htonl(seq_num),
+        0
+    };
+
+    if (!peer->Send(MsgBuilder(rep_header).Add(reply.data(), reply.size()).Add(raw.data(), raw.size()))) {
+        std::cerr << "[DSM Daemon] Failed to send PAGE_BATCH_REP" << std::endl;
+    }
+}
+
+// Apply one ownership update from src_node to the directory entry of VPN.
+// Returns 0 for a reader whose copy source is no longer the owner.
+static uint8_t apply_owner_update(uint32_t VPN, uint8_t kind, uint16_t new_owner, uint32_t version, uint16_t src_node) {
+    bool is_reader = (kind == DSM_OWNER_UPDATE_READER);
+
     std::cout << "[DSM Daemon] Received OWNER_UPDATE for page " << VPN 
-              << ", new owner: NodeId=" << new_owner << std::endl;
+              << (is_reader ? ", new reader: NodeId=" : ", new owner: NodeId=")
+              << (is_reader ? src_node : new_owner) << std::endl;
     
     // Lock the page for exclusive access
     if (!PageTable->LocalMutexLock(VPN)) {
         std::cerr << "[DSM Daemon] Failed to lock page " << VPN << std::endl;
-        return;
+        return 0;
     }
     
     // Update page table with new owner
@@ -557,22 +983,91 @@ void process_owner_update(int sock, const dsm_header_t &head, rio_t &rp) {
     PageRecord* record = PageTable->Find(VPN);
     if (record == nullptr) {
         // Create new record
-        PageRecord new_record;
-        new_record.owner_id = new_owner;
-        PageTable->Insert(VPN, new_record);
+        PageTable->Insert(VPN, PageRecord());
+        record = PageTable->Find(VPN);
+    }
+
+    uint8_t accepted = 1;
+    bool superseded = false;
+    std::vector<int> stale_readers;
+    if (is_reader) {
+        // new_owner is where the replica came from; if ownership has moved on
+        // since, a writer may already have skipped this reader's invalidation.
+        // Untouched file pages are served by Pod 0 while owner_id is still -1.
+        bool source_current = (record->owner_id == new_owner)
+                              || (record->owner_id == -1 && new_owner == 0);
+        if (!source_current) {
+            accepted = 0;
+        } else if (std::find(record->copyset.begin(), record->copyset.end(), src_node) == record->copyset.end()) {
+            record->copyset.push_back(src_node);
+        }
+    } else if (record->AcceptWriter(new_owner, version)) {
+        stale_readers.swap(record->copyset);
     } else {
-        // Update existing record
-        record->owner_id = new_owner;
+        // Updates from different writers travel on different channels; a
+        // later transfer already reported must not be undone. The copy the
+        // late writer announced has moved on, so there is nothing to reject.
+        superseded = true;
     }
     
     PageTable->GlobalMutexUnlock();
+
+    // The writer's next release waits for this ACK, so every replica is gone
+    // before its changes can be seen
+    stale_readers.erase(std::remove(stale_readers.begin(), stale_readers.end(), new_owner), stale_readers.end());
+    send_page_invs(VPN, stale_readers);
     
     // Unlock the page
     PageTable->LocalMutexUnlock(VPN);
     
-    std::cout << "[DSM Daemon] Updated owner of page " << VPN << " to NodeId=" << new_owner << std::endl;
+    if (is_reader) {
+        std::cout << "[DSM Daemon] " << (accepted ? "Added" : "Rejected") << " reader NodeId=" << src_node
+                  << " of page " << VPN << std::endl;
+    } else if (superseded) {
+        std::cout << "[DSM Daemon] Ignored stale owner NodeId=" << new_owner << " of page " << VPN
+                  << " at version " << version << std::endl;
+    } else {
+        std::cout << "[DSM Daemon] Updated owner of page " << VPN << " to NodeId=" << new_owner
+                  << ", invalidated " << stale_readers.size() << " replicas" << std::endl;
+    }
+    return accepted;
+}
+
+// Requests that reach the old owner while an update is still on its way are
+// not lost: the old owner's own entry already names the new one and
+// redirects them (serve_page), so the directory may lag behind.
+void process_owner_update(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    uint32_t payload_len = ntohl(head.payload_len);
+    payload_owner_update_batch_t batch;
+    if (payload_len < sizeof(batch) || !msg.Read(&batch, sizeof(batch))) {
+        std::cerr << "[DSM Daemon] Failed to read OWNER_UPDATE payload" << std::endl;
+        return;
+    }
+
+    uint32_t count = ntohl(batch.count);
+    if (count == 0 || count > DSM_OWNER_UPDATE_BATCH_MAX
+        || payload_len != sizeof(batch) + count * sizeof(payload_owner_update_t)) {
+        std::cerr << "[DSM Daemon] Invalid OWNER_UPDATE count " << count << std::endl;
+        return;
+    }
+
+    std::vector<payload_owner_update_t> updates(count);
+    if (!msg.Read(updates.data(), count * sizeof(payload_owner_update_t))) {
+        std::cerr << "[DSM Daemon] Failed to read OWNER_UPDATE entries" << std::endl;
+        return;
+    }
+
+    // In order: a reader's update followed by its own upgrade to writer
+    // must not be reversed
+    uint16_t src_node = ntohs(head.src_node_id);
+    uint32_t seq_num = ntohl(head.seq_num);
+    std::vector<uint8_t> accepted(count);
+    for (uint32_t i = 0; i < count; i++) {
+        accepted[i] = apply_owner_update(ntohl(updates[i].resource_id), updates[i].kind,
+                                         ntohs(updates[i].new_owner_id), ntohl(updates[i].version), src_node);
+    }
     
-    // Send ACK back to sender
+    // Send ACK back to sender, one verdict per update
     dsm_header_t ack = {
         DSM_MSG_ACK,
         0,
@@ -581,57 +1076,306 @@ void process_owner_update(int sock, const dsm_header_t &head, rio_t &rp) {
         0
     };
     
-    if (::send(sock, &ack, sizeof(ack), 0) != sizeof(ack)) {
+    if (!peer->Send(MsgBuilder(ack).Add(accepted.data(), accepted.size()))) {
         std::cerr << "[DSM Daemon] Failed to send ACK for OWNER_UPDATE" << std::endl;
         return;
     }
 }
 
-void peer_handler(int connfd) {
-    rio_t rp;
-    rio_readinit(&rp, connfd);
+void process_page_inv(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    uint32_t payload_len = ntohl(head.payload_len);
+    if (payload_len < sizeof(payload_page_inv_t)) {
+        std::cerr << "[DSM Daemon] Invalid PAGE_INV payload length" << std::endl;
+        return;
+    }
+
+    payload_page_inv_t inv_payload;
+    if (!msg.Read(&inv_payload, sizeof(inv_payload))) {
+        std::cerr << "[DSM Daemon] Failed to read PAGE_INV payload" << std::endl;
+        return;
+    }
+
+    uint32_t VPN = ntohl(inv_payload.page_index);
+    uint32_t seq_num = ntohl(head.seq_num);
+
+    // No page lock here: the manager holds its own while waiting for this ACK
+    invalidate_local_page(static_cast<int>(VPN));
+    std::cout << "[DSM Daemon] Dropped replica of page " << VPN << std::endl;
+
+    dsm_header_t ack = {
+        DSM_MSG_ACK,
+        1,
+        htons(PodId),
+        htonl(seq_num),
+        0
+    };
+
+    if (!peer->Send(MsgBuilder(ack))) {
+        std::cerr << "[DSM Daemon] Failed to send ACK for PAGE_INV" << std::endl;
+    }
+}
+
+void process_page_diff(const PeerRef &peer, const dsm_header_t &head, RpcMessage &msg) {
+    uint32_t payload_len = ntohl(head.payload_len);
+    uint16_t src_node = ntohs(head.src_node_id);
+    uint32_t seq_num = ntohl(head.seq_num);
+
+    // The reactor has already read the whole payload, merge from it in place
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(msg.payload.data());
+
+    // The payload is a sequence of (payload_page_diff_t, diff bytes) segments
+    size_t pos = 0;
+    int merged = 0;
+    while (pos + sizeof(payload_page_diff_t) <= payload_len) {
+        payload_page_diff_t seg;
+        std::memcpy(&seg, payload + pos, sizeof(seg));
+        pos += sizeof(seg);
+        uint32_t VPN = ntohl(seg.page_index);
+        uint32_t diff_len = ntohl(seg.diff_len);
+        PageTable->GlobalMutexLock();
+        bool known_page = (PageTable->Find(VPN) != nullptr);
+        PageTable->GlobalMutexUnlock();
+        if (diff_len > payload_len - pos || !known_page) {
+            std::cerr << "[DSM Daemon] Malformed PAGE_DIFF segment from NodeId=" << src_node << std::endl;
+            break;
+        }
+
+        PageTable->LocalMutexLock(VPN);
+        char* home_copy = load_home_copy(VPN);
+        if (home_copy == nullptr || !dsm_diff_apply(home_copy, DSM_PAGE_SIZE, payload + pos, diff_len)) {
+            std::cerr << "[DSM Daemon] Failed to merge diff of page " << VPN << std::endl;
+        } else {
+            merged++;
+        }
+        PageTable->LocalMutexUnlock(VPN);
+        pos += diff_len;
+    }
+
+    std::cout << "[DSM Daemon] Merged " << merged << " page diffs from NodeId=" << src_node << std::endl;
+
+    dsm_header_t ack = {
+        DSM_MSG_ACK,
+        1,
+        htons(PodId),
+        htonl(seq_num),
+        0
+    };
+
+    if (!peer->Send(MsgBuilder(ack))) {
+        std::cerr << "[DSM Daemon] Failed to send ACK for PAGE_DIFF" << std::endl;
+    }
+}
+
+// ---- Event loop -------------------------------------------------------------
+// One reactor thread accepts connections and reads every socket without
+// blocking; complete frames go to a fixed pool of DaemonThreads workers, so
+// the daemon's thread count does not grow with the number of pods. PAGE_INV,
+// JOIN_REQ and the lock messages never wait on another node and run on the
+// reactor itself: a pool full of requests waiting for page locks can then
+// still take the invalidations those locks are waiting for.
 
-    // Process messages in a loop for this connection
+#define DAEMON_READ_CHUNK (64 * 1024)
+#define DAEMON_MAX_EVENTS 64
+
+// An accepted connection. Replies are written by whichever thread handled
+// the request, so the socket is closed (~TcpTransport) only once the reactor
+// has dropped the connection and no queued or running request still holds it.
+struct PeerConn {
+    std::shared_ptr<TcpTransport> transport;
+    FrameBuffer in;             // received bytes not yet forming a whole frame (reactor only)
+};
+
+struct DaemonTask {
+    PeerRef peer;
+    RpcMessage msg;
+};
+
+// Never destroyed: the workers are still waiting on it when the process
+// exits, and destroying a condition variable with waiters blocks in glibc
+struct TaskQueue {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<DaemonTask> tasks;
+};
+static TaskQueue* g_task_queue = new TaskQueue;
+
+static void dispatch_message(const PeerRef &peer, RpcMessage &msg) {
+    const dsm_header_t &header = msg.header;
+    switch (header.type) {
+        case DSM_MSG_JOIN_REQ:
+            process_join_req(peer, header, msg);
+            break;
+        case DSM_MSG_LOCK_ACQ:
+            process_lock_acq(peer, header, msg);
+            break;
+        case DSM_MSG_LOCK_RLS:
+            process_lock_rls(peer, header, msg);
+            break;
+        case DSM_MSG_LOCK_RECALL:
+            process_lock_recall(peer, header, msg);
+            break;
+        case DSM_MSG_OWNER_UPDATE:
+            process_owner_update(peer, header, msg);
+            break;
+        case DSM_MSG_PAGE_REQ:
+            process_page_req(peer, header, msg);
+            break;
+        case DSM_MSG_PAGE_BATCH_REQ:
+            process_page_batch_req(peer, header, msg);
+            break;
+        case DSM_MSG_PAGE_INV:
+            process_page_inv(peer, header, msg);
+            break;
+        case DSM_MSG_PAGE_DIFF:
+            process_page_diff(peer, header, msg);
+            break;
+    }
+}
+
+static void daemon_worker() {
     while (true) {
-        dsm_header_t header;
-
-        // Read message header
-        ssize_t n = rio_readn(&rp, &header, sizeof(dsm_header_t));
-        if (n != sizeof(dsm_header_t)) {
-            if (n == 0) {
-                // Connection closed cleanly
-                std::cout << "[DSM Daemon] Connection closed by peer" << std::endl;
-            } else {
-                std::cerr << "[DSM Daemon] Failed to read header, closing connection" << std::endl;
+        DaemonTask task;
+        {
+            std::unique_lock<std::mutex> lock(g_task_queue->mutex);
+            g_task_queue->cond.wait(lock, [] { return !g_task_queue->tasks.empty(); });
+            task = std::move(g_task_queue->tasks.front());
+            g_task_queue->tasks.pop_front();
+        }
+        dispatch_message(task.peer, task.msg);
+    }
+}
+
+// Run a complete frame on the reading thread or queue it for the pool.
+// Returns false for a message type the daemon does not know.
+static bool route_message(const PeerRef &peer, RpcMessage &msg) {
+    switch (msg.header.type) {
+        case DSM_MSG_JOIN_REQ:
+        case DSM_MSG_LOCK_ACQ:
+        case DSM_MSG_LOCK_RLS:
+        case DSM_MSG_LOCK_RECALL:
+        case DSM_MSG_PAGE_INV:
+            dispatch_message(peer, msg);
+            return true;
+        case DSM_MSG_OWNER_UPDATE:
+        case DSM_MSG_PAGE_REQ:
+        case DSM_MSG_PAGE_BATCH_REQ:
+        case DSM_MSG_PAGE_DIFF: {
+            std::lock_guard<std::mutex> guard(g_task_queue->mutex);
+            g_task_queue->tasks.push_back({ peer, std::move(msg) });
+            g_task_queue->cond.notify_one();
+            return true;
+        }
+        default:
+            return handle_unknown_message(peer, msg.header);
+    }
+}
+
+// Read what the socket has and route every frame completed by it. Returns
+// false when the connection should be dropped.
+static bool drain_conn(PeerConn &conn) {
+    static char buf[DAEMON_READ_CHUNK];   // reactor thread only
+    ssize_t n = recv(conn.transport->Fd(), buf, sizeof(buf), MSG_DONTWAIT);
+    if (n == 0) {
+        std::cout << "[DSM Daemon] Connection closed by peer" << std::endl;
+        return false;
+    }
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        std::cerr << "[DSM Daemon] Failed to read from " << conn.transport->Name() << ", closing connection" << std::endl;
+        return false;
+    }
+
+    conn.in.Append(buf, n);
+    RpcMessage msg;
+    while (conn.in.Next(msg)) {
+        if (!route_message(conn.transport, msg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pods on this machine send their requests through shared memory segments
+// rather than sockets. The rings cannot be polled by epoll, so one thread
+// serves all of them: it drains every ring without blocking, routes like the
+// reactor does, and sleeps on all the rings at once when they are idle. A
+// segment is dropped when its pod goes away.
+struct ShmPeer {
+    std::shared_ptr<ShmTransport> transport;
+    FrameBuffer in;             // received bytes not yet forming a whole frame
+};
+
+static void serve_shm_peers(std::vector<std::shared_ptr<ShmTransport>> segments) {
+    std::vector<ShmPeer> peers;
+    for (std::shared_ptr<ShmTransport> &segment : segments) {
+        peers.push_back({ std::move(segment), FrameBuffer() });
+    }
+    std::vector<char> buf(DAEMON_READ_CHUNK);
+
+    while (!peers.empty()) {
+        bool busy = false;
+        for (auto it = peers.begin(); it != peers.end();) {
+            size_t n = it->transport->TryRecv(buf.data(), buf.size());
+            bool keep = true;
+            if (n > 0) {
+                busy = true;
+                it->in.Append(buf.data(), n);
+                RpcMessage msg;
+                while (keep && it->in.Next(msg)) {
+                    keep = route_message(it->transport, msg);
+                }
             }
-            close(connfd);
-            return;
+            it = keep ? it + 1 : peers.erase(it);
+        }
+        if (busy) {
+            continue;
         }
 
-        bool keep_processing = true;
-        switch (header.type) {
-            case DSM_MSG_JOIN_REQ:
-                process_join_req(connfd, header);
-                break;
-            case DSM_MSG_LOCK_ACQ:
-                process_lock_acq(connfd, header, rp);
-                break;
-            case DSM_MSG_LOCK_RLS:
-                process_lock_rls(connfd, header, rp);
-                break;
-            case DSM_MSG_OWNER_UPDATE:
-                process_owner_update(connfd, header, rp);
-                break;
-            case DSM_MSG_PAGE_REQ:
-                process_page_req(connfd, header, rp);
-                break;
-            default:
-                keep_processing = handle_unknown_message(connfd, header);
-                break;
-        }
-
-        if (!keep_processing) {
-            return;
+        std::vector<ShmTransport *> rings;
+        for (ShmPeer &peer : peers) {
+            rings.push_back(peer.transport.get());
+        }
+        if (!ShmTransport::WaitAny(rings)) {
+            // Timed out: check for pods that have exited
+            for (auto it = peers.begin(); it != peers.end();) {
+                if (it->transport->Closed()) {
+                    std::cout << "[DSM Daemon] " << it->transport->Name() << " closed by peer" << std::endl;
+                    it = peers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+}
+
+// Control messages sent over UDP (DSM_CONTROL_UDP) arrive on one socket for
+// all pods. Each source address is a peer of its own, which reassembles the
+// requests and drops the ones it has already seen; new requests are routed
+// like those of any connection.
+static void serve_udp_peers(int sock) {
+    std::map<std::pair<uint32_t, uint16_t>, std::shared_ptr<UdpPeer>> peers;
+    char buf[sizeof(dsm_dgram_t) + DSM_UDP_FRAGMENT];
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t n = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+        if (n < 0) {
+            if (errno != EINTR) {
+                perror("[DSM Daemon] recvfrom failed");
+            }
+            continue;
+        }
+
+        std::shared_ptr<UdpPeer> &peer = peers[{ from.sin_addr.s_addr, from.sin_port }];
+        if (peer == nullptr) {
+            peer = std::make_shared<UdpPeer>(sock, from);
+        }
+        RpcMessage msg;
+        if (peer->Deliver(buf, static_cast<size_t>(n), msg)) {
+            route_message(peer, msg);
         }
     }
 }
@@ -679,6 +1423,41 @@ void dsm_start_daemon(int port) {
         return;
     }
 
+    // Segments are created before listen(): a pod whose TCP connect succeeds
+    // and still finds no segment (or LocalShm off) stays on TCP
+    if (LocalShm) {
+        std::vector<std::shared_ptr<ShmTransport>> segments;
+        for (int pod = 0; pod < ProcNum; pod++) {
+            if (!PodSharesHost(pod)) {
+                continue;
+            }
+            std::string name = ShmTransport::SegmentName(port, pod);
+            std::shared_ptr<ShmTransport> segment = ShmTransport::Create(name);
+            if (segment == nullptr) {
+                std::cerr << "[DSM Daemon] Failed to create " << name << ": " << std::strerror(errno) << std::endl;
+                continue;
+            }
+            segments.push_back(std::move(segment));
+        }
+        if (!segments.empty()) {
+            std::thread(serve_shm_peers, std::move(segments)).detach();
+        }
+    }
+
+    // Bound before listen() as well, so a pod that reached us over TCP can
+    // send control messages at once
+    if (ControlUdp) {
+        int udpfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (udpfd < 0 || bind(udpfd, (struct sockaddr *)&serveraddr, sizeof(serveraddr)) < 0) {
+            perror("[DSM Daemon] UDP control socket failed");
+            if (udpfd >= 0) {
+                close(udpfd);
+            }
+        } else {
+            std::thread(serve_udp_peers, udpfd).detach();
+        }
+    }
+
     // 4. Start listening
     if (listen(listenfd, 1024) < 0) {
         perror("[DSM Daemon] listen failed");
@@ -688,15 +1467,81 @@ void dsm_start_daemon(int port) {
 
     std::cout << "[DSM Daemon] Listening on port " << port << "..." << std::endl;
 
-    // 5. Accept incoming connections in a loop
+    // 5. Start the worker pool and the reactor
+    int workers = DaemonThreads > 0 ? DaemonThreads : 1;
+    for (int i = 0; i < workers; i++) {
+        std::thread(daemon_worker).detach();
+    }
+
+    if (DaemonUring) {
+        std::unique_ptr<UringEngine> engine = UringEngine::Create();
+        if (engine != nullptr) {
+            std::cout << "[DSM Daemon] Serving connections from io_uring" << std::endl;
+            engine->Run(listenfd, route_message);
+            // The engine owns the listening socket for good, epoll must not take it over
+            return;
+        }
+        std::cerr << "[DSM Daemon] io_uring not available, using epoll" << std::endl;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("[DSM Daemon] epoll_create1 failed");
+        close(listenfd);
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0) {
+        perror("[DSM Daemon] epoll_ctl failed");
+        close(epfd);
+        close(listenfd);
+        return;
+    }
+
+    // 6. Accept connections and read requests as they become readable
+    std::map<int, PeerConn> conns;
+    struct epoll_event events[DAEMON_MAX_EVENTS];
     while (1) {
-        clientlen = sizeof(clientaddr);
-        connfd = accept(listenfd, (struct sockaddr *)&clientaddr, &clientlen);
-        if (connfd < 0) {
-            continue;  // accept failed, retry
+        int ready = epoll_wait(epfd, events, DAEMON_MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                perror("[DSM Daemon] epoll_wait failed");
+            }
+            continue;
         }
 
-        std::thread t(peer_handler, connfd);
-        t.detach();  
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenfd) {
+                clientlen = sizeof(clientaddr);
+                connfd = accept(listenfd, (struct sockaddr *)&clientaddr, &clientlen);
+                if (connfd < 0) {
+                    continue;  // accept failed, retry
+                }
+                // Replies are single writes (MsgBuilder), send them at once
+                int nodelay = 1;
+                setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                ev.events = EPOLLIN;
+                ev.data.fd = connfd;
+                if (epoll_ctl(epfd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+                    perror("[DSM Daemon] epoll_ctl failed");
+                    close(connfd);
+                    continue;
+                }
+                conns[connfd].transport = std::make_shared<TcpTransport>(connfd);
+                continue;
+            }
+
+            auto it = conns.find(fd);
+            if (it == conns.end()) {
+                continue;
+            }
+            if (!drain_conn(it->second)) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+                conns.erase(it);
+            }
+        }
     }
 }
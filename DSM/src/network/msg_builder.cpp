@@ -0,0 +1,70 @@
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net/msg_builder.h"
+
+MsgBuilder::MsgBuilder(const dsm_header_t &header)
+	: header_(header), iovcnt_(1), payload_len_(0), overflow_(false)
+{
+}
+
+MsgBuilder &MsgBuilder::Add(const void *data, size_t len)
+{
+	if (len == 0)
+		return *this;
+	if (iovcnt_ > DSM_MSG_MAX_PARTS) {
+		overflow_ = true;
+		return *this;
+	}
+	iov_[iovcnt_].iov_base = const_cast<void *>(data);
+	iov_[iovcnt_].iov_len = len;
+	iovcnt_++;
+	payload_len_ += len;
+	return *this;
+}
+
+int MsgBuilder::Gather(dsm_header_t *header, struct iovec *iov) const
+{
+	if (overflow_)
+		return 0;
+	*header = header_;
+	header->payload_len = htonl((uint32_t)payload_len_);
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(*header);
+	for (int i = 1; i < iovcnt_; i++)
+		iov[i] = iov_[i];
+	return iovcnt_;
+}
+
+bool MsgBuilder::Send(int sock) const
+{
+	dsm_header_t header;
+	struct iovec iov[DSM_MSG_MAX_PARTS + 1];
+	int iovcnt = Gather(&header, iov);
+	if (iovcnt == 0)
+		return false;
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	while (msg.msg_iovlen > 0) {
+		ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		/* Partial write: skip what went out and resume mid segment */
+		while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+			sent -= (ssize_t)msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen > 0) {
+			msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+			msg.msg_iov->iov_len -= (size_t)sent;
+		}
+	}
+	return true;
+}
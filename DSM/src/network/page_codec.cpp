@@ -0,0 +1,284 @@
+#include <string.h>
+
+#include "net/page_codec.h"
+
+/* ---- LZ: LZ4-style sequences ------------------------------------------
+ * token (4 bit literal count | 4 bit match length - 4), extra length bytes
+ * when a nibble is 15, the literals, then a 16 bit little endian offset and
+ * extra match length bytes. The last sequence carries literals only.
+ */
+
+#define LZ_MIN_MATCH   4
+#define LZ_HASH_BITS   12
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static bool put_length(uint8_t *out, size_t cap, size_t *op, size_t len)
+{
+	while (len >= 255) {
+		if (*op >= cap)
+			return false;
+		out[(*op)++] = 255;
+		len -= 255;
+	}
+	if (*op >= cap)
+		return false;
+	out[(*op)++] = (uint8_t)len;
+	return true;
+}
+
+static bool lz_emit(uint8_t *out, size_t cap, size_t *op, const uint8_t *lit, size_t lit_len,
+		    size_t offset, size_t match_len)
+{
+	size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+	if (*op >= cap)
+		return false;
+	out[(*op)++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+	if (lit_len >= 15 && !put_length(out, cap, op, lit_len - 15))
+		return false;
+	if (*op + lit_len > cap)
+		return false;
+	memcpy(out + *op, lit, lit_len);
+	*op += lit_len;
+
+	if (match_len == 0)
+		return true;
+	if (*op + 2 > cap)
+		return false;
+	out[(*op)++] = (uint8_t)(offset & 0xFF);
+	out[(*op)++] = (uint8_t)(offset >> 8);
+	if (ml >= 15 && !put_length(out, cap, op, ml - 15))
+		return false;
+	return true;
+}
+
+static size_t lz_compress(const uint8_t *src, size_t size, uint8_t *out, size_t cap)
+{
+	uint32_t table[1 << LZ_HASH_BITS];
+	size_t ip = 0, anchor = 0, op = 0;
+
+	memset(table, 0xFF, sizeof(table));
+	while (ip + LZ_MIN_MATCH <= size) {
+		uint32_t seq = read32(src + ip);
+		uint32_t h = lz_hash(seq);
+		uint32_t ref = table[h];
+		table[h] = (uint32_t)ip;
+
+		if (ref == UINT32_MAX || ip - ref > 0xFFFF || read32(src + ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		size_t len = LZ_MIN_MATCH;
+		while (ip + len < size && src[ref + len] == src[ip + len])
+			len++;
+		if (!lz_emit(out, cap, &op, src + anchor, ip - anchor, ip - ref, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (anchor < size && !lz_emit(out, cap, &op, src + anchor, size - anchor, 0, 0))
+		return 0;
+	return op;
+}
+
+static bool get_length(const uint8_t *in, size_t len, size_t *ip, size_t *value)
+{
+	uint8_t b;
+	do {
+		if (*ip >= len)
+			return false;
+		b = in[(*ip)++];
+		*value += b;
+	} while (b == 255);
+	return true;
+}
+
+static bool lz_decompress(const uint8_t *in, size_t len, uint8_t *dst, size_t size)
+{
+	size_t ip = 0, op = 0;
+
+	while (ip < len) {
+		uint8_t token = in[ip++];
+		size_t lit_len = token >> 4;
+		if (lit_len == 15 && !get_length(in, len, &ip, &lit_len))
+			return false;
+		if (lit_len > len - ip || lit_len > size - op)
+			return false;
+		memcpy(dst + op, in + ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == len)
+			break;
+
+		if (len - ip < 2)
+			return false;
+		size_t offset = (size_t)in[ip] | ((size_t)in[ip + 1] << 8);
+		ip += 2;
+		size_t match_len = token & 0x0F;
+		if (match_len == 15 && !get_length(in, len, &ip, &match_len))
+			return false;
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || match_len > size - op)
+			return false;
+		/* Byte by byte: the source may overlap the bytes being written */
+		for (size_t i = 0; i < match_len; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == size;
+}
+
+/* ---- SHUFFLE: byte planes + RLE ---------------------------------------
+ * Byte j of the shuffled stream is byte j / nw of word j % nw, so the high
+ * bytes of small integers line up into long runs of zeros. The stream is
+ * coded as control bytes: c < 0x80 copies c + 1 literal bytes, c >= 0x80
+ * repeats the next byte (c - 0x80) + 3 times. The decoder writes straight
+ * into the page so nothing page sized lands on the signal stack.
+ */
+
+#define RLE_MIN_RUN    3
+#define RLE_MAX_RUN    (0x7F + RLE_MIN_RUN)
+#define RLE_MAX_LIT    0x80
+
+static size_t run_length(const uint8_t *buf, size_t size, size_t j)
+{
+	size_t run = 1;
+	while (j + run < size && run < RLE_MAX_RUN && buf[j + run] == buf[j])
+		run++;
+	return run;
+}
+
+static size_t shuffle_compress(const uint8_t *src, size_t size, uint8_t *out, size_t cap)
+{
+	uint8_t planes[DSM_CODEC_MAX_SIZE];
+	size_t nw = size / 4;
+	size_t j = 0, op = 0;
+
+	for (size_t w = 0; w < nw; w++) {
+		planes[w] = src[w * 4];
+		planes[nw + w] = src[w * 4 + 1];
+		planes[2 * nw + w] = src[w * 4 + 2];
+		planes[3 * nw + w] = src[w * 4 + 3];
+	}
+
+	while (j < size) {
+		size_t run = run_length(planes, size, j);
+		if (run >= RLE_MIN_RUN) {
+			if (op + 2 > cap)
+				return 0;
+			out[op++] = (uint8_t)(0x80 | (run - RLE_MIN_RUN));
+			out[op++] = planes[j];
+			j += run;
+			continue;
+		}
+
+		/* Literals until the next worthwhile run */
+		size_t start = j;
+		while (j < size && j - start < RLE_MAX_LIT && run_length(planes, size, j) < RLE_MIN_RUN)
+			j++;
+		size_t lit = j - start;
+		if (op + 1 + lit > cap)
+			return 0;
+		out[op++] = (uint8_t)(lit - 1);
+		memcpy(out + op, planes + start, lit);
+		op += lit;
+	}
+	return op;
+}
+
+static bool shuffle_decompress(const uint8_t *in, size_t len, uint8_t *dst, size_t size)
+{
+	size_t nw = size / 4;
+	size_t ip = 0, j = 0;
+	size_t w = 0, plane = 0;   /* j == plane * nw + w */
+
+	while (ip < len) {
+		uint8_t c = in[ip++];
+		size_t count;
+		bool repeat = (c & 0x80) != 0;
+		if (repeat) {
+			count = (size_t)(c & 0x7F) + RLE_MIN_RUN;
+			if (ip >= len)
+				return false;
+		} else {
+			count = (size_t)c + 1;
+			if (count > len - ip)
+				return false;
+		}
+		if (count > size - j)
+			return false;
+
+		for (size_t k = 0; k < count; k++) {
+			dst[w * 4 + plane] = repeat ? in[ip] : in[ip + k];
+			if (++w == nw) {
+				w = 0;
+				plane++;
+			}
+		}
+		ip += repeat ? 1 : count;
+		j += count;
+	}
+	return j == size;
+}
+
+/* ---- API --------------------------------------------------------------- */
+
+size_t dsm_codec_compress(int codec, const void *page, size_t size, uint8_t *out)
+{
+	const uint8_t *src = (const uint8_t *)page;
+	size_t cap = DSM_CODEC_THRESHOLD(size);
+
+	switch (codec) {
+	case DSM_CODEC_LZ:
+		if (size > DSM_CODEC_MAX_SIZE)
+			return 0;
+		return lz_compress(src, size, out, cap);
+	case DSM_CODEC_SHUFFLE:
+		if (size % 4 != 0 || size > DSM_CODEC_MAX_SIZE)
+			return 0;
+		return shuffle_compress(src, size, out, cap);
+	default:
+		return 0;
+	}
+}
+
+bool dsm_codec_decompress(int codec, const uint8_t *in, size_t len, void *page, size_t size)
+{
+	uint8_t *dst = (uint8_t *)page;
+
+	switch (codec) {
+	case DSM_CODEC_LZ:
+		return lz_decompress(in, len, dst, size);
+	case DSM_CODEC_SHUFFLE:
+		if (size % 4 != 0)
+			return false;
+		return shuffle_decompress(in, len, dst, size);
+	default:
+		return false;
+	}
+}
+
+const char *dsm_codec_name(int codec)
+{
+	switch (codec) {
+	case DSM_CODEC_NONE:
+		return "none";
+	case DSM_CODEC_LZ:
+		return "lz";
+	case DSM_CODEC_SHUFFLE:
+		return "shuffle";
+	default:
+		return "unknown";
+	}
+}
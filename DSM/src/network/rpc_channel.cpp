@@ -0,0 +1,138 @@
+#include <arpa/inet.h>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "net/msg_builder.h"
+#include "net/rpc_channel.h"
+
+/* Channels live as long as the process: the reader thread keeps using the
+ * object after the last caller is gone, so they are never destroyed. */
+RpcChannel::RpcChannel(std::unique_ptr<Transport> transport) : transport_(std::move(transport))
+{
+	std::thread(&RpcChannel::ReaderLoop, this).detach();
+}
+
+uint32_t RpcChannel::Send(dsm_header_t header, std::initializer_list<RpcPart> parts)
+{
+	ReplyHandler none;
+	return Start(header, parts, none);
+}
+
+/* The waiter, and with it on_reply, is registered before the request goes
+ * out, so the reply cannot overtake it. When the send fails, on_reply is
+ * handed back unless the reader, closing, has already taken it. */
+uint32_t RpcChannel::Start(dsm_header_t header, std::initializer_list<RpcPart> parts, ReplyHandler &on_reply)
+{
+	uint32_t seq;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		if (closed_)
+			return 0;
+		/* 0 means "no request", and a seq still waiting must not be reused */
+		do {
+			seq = next_seq_++;
+		} while (seq == 0 || waiters_.count(seq) != 0);
+		waiters_[seq].on_reply = std::move(on_reply);
+		on_reply = nullptr;
+	}
+
+	header.seq_num = htonl(seq);
+	MsgBuilder msg(header);
+	for (const RpcPart &part : parts)
+		msg.Add(part.data, part.len);
+	if (!transport_->Send(msg)) {
+		std::lock_guard<std::mutex> guard(mutex_);
+		auto it = waiters_.find(seq);
+		if (it != waiters_.end()) {
+			on_reply = std::move(it->second.on_reply);
+			waiters_.erase(it);
+		}
+		return 0;
+	}
+	return seq;
+}
+
+bool RpcChannel::Wait(uint32_t seq, RpcMessage &reply)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto it = waiters_.find(seq);
+	if (it == waiters_.end())
+		return false;
+
+	cond_.wait(lock, [&] { return it->second.done || closed_; });
+	bool done = it->second.done;
+	if (done)
+		reply = std::move(it->second.reply);
+	waiters_.erase(it);
+	return done;
+}
+
+bool RpcChannel::Call(const dsm_header_t &header, std::initializer_list<RpcPart> parts, RpcMessage &reply)
+{
+	uint32_t seq = Send(header, parts);
+	return seq != 0 && Wait(seq, reply);
+}
+
+void RpcChannel::Post(const dsm_header_t &header, std::initializer_list<RpcPart> parts, ReplyHandler on_reply)
+{
+	if (Start(header, parts, on_reply) == 0 && on_reply) {
+		RpcMessage none;
+		on_reply(false, none);
+	}
+}
+
+void RpcChannel::ReaderLoop()
+{
+	/* Payloads are read straight into the reply handed to the waiter */
+	MessageReader reader(*transport_);
+
+	while (true) {
+		RpcMessage reply;
+		if (!reader.Next(reply))
+			break;
+
+		uint32_t seq = ntohl(reply.header.seq_num);
+		ReplyHandler on_reply;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto it = waiters_.find(seq);
+			if (it == waiters_.end() || it->second.done) {
+				std::cerr << "[RpcChannel] Dropping reply type 0x" << std::hex << (int)reply.header.type
+					  << std::dec << " with unexpected seq_num " << seq << std::endl;
+				continue;
+			}
+			if (it->second.on_reply) {
+				on_reply = std::move(it->second.on_reply);
+				waiters_.erase(it);
+			} else {
+				it->second.reply = std::move(reply);
+				it->second.done = true;
+				cond_.notify_all();
+			}
+		}
+		/* Outside the lock: the handler may send on this channel */
+		if (on_reply)
+			on_reply(true, reply);
+	}
+
+	std::vector<ReplyHandler> orphaned;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		closed_ = true;
+		for (auto it = waiters_.begin(); it != waiters_.end();) {
+			if (it->second.on_reply) {
+				orphaned.push_back(std::move(it->second.on_reply));
+				it = waiters_.erase(it);
+			} else {
+				++it;
+			}
+		}
+		cond_.notify_all();
+	}
+	for (ReplyHandler &on_reply : orphaned) {
+		RpcMessage none;
+		on_reply(false, none);
+	}
+}
@@ -0,0 +1,305 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include "net/shm_transport.h"
+
+#define SHM_MAGIC    0x44534d52u   /* "DSMR" */
+#define SHM_SPIN     64            /* yields before sleeping on the futex */
+#define SHM_WAIT_MS  100           /* futex sleep between peer liveness checks */
+#define SHM_POLL_US  200           /* WaitAny's nap on kernels without futex_waitv (before 5.16) */
+
+static_assert((DSM_SHM_RING_SIZE & (DSM_SHM_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock free to be shared");
+
+/* Shared (not FUTEX_PRIVATE) futexes: waiter and waker are different processes */
+static bool futex_wait(std::atomic<uint32_t> *addr, uint32_t val)
+{
+	struct timespec ts = { 0, SHM_WAIT_MS * 1000000L };
+	long rc = syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT, val, &ts, nullptr, 0);
+	return !(rc < 0 && errno == ETIMEDOUT);
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+static bool process_alive(pid_t pid)
+{
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/* Segments this daemon created and nobody attached to are removed at exit */
+static std::vector<std::string> *g_created;
+
+static void unlink_created()
+{
+	for (const std::string &name : *g_created)
+		shm_unlink(name.c_str());
+}
+
+std::string ShmTransport::SegmentName(int daemon_port, int client_pod)
+{
+	return "/dsm_" + std::to_string(daemon_port) + "_" + std::to_string(client_pod);
+}
+
+ShmTransport::ShmTransport(const std::string &name, ShmSegment *seg, bool daemon_side)
+	: name_(name), seg_(seg), daemon_side_(daemon_side),
+	  tx_(daemon_side ? &seg->to_client : &seg->to_daemon),
+	  rx_(daemon_side ? &seg->to_daemon : &seg->to_client)
+{
+}
+
+ShmTransport::~ShmTransport()
+{
+	munmap(seg_, sizeof(ShmSegment));
+}
+
+std::unique_ptr<ShmTransport> ShmTransport::Create(const std::string &name)
+{
+	/* A segment left behind by an earlier run on the same port */
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return nullptr;
+	if (ftruncate(fd, sizeof(ShmSegment)) < 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+	void *addr = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+
+	/* ftruncate zero-filled the counters; the magic goes last */
+	ShmSegment *seg = new (addr) ShmSegment;
+	seg->daemon_pid = getpid();
+	seg->client_pid.store(0);
+	std::atomic_thread_fence(std::memory_order_release);
+	seg->magic = SHM_MAGIC;
+
+	if (g_created == nullptr) {
+		g_created = new std::vector<std::string>;
+		atexit(unlink_created);
+	}
+	g_created->push_back(name);
+	return std::unique_ptr<ShmTransport>(new ShmTransport(name, seg, true));
+}
+
+std::unique_ptr<ShmTransport> ShmTransport::Open(const std::string &name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(ShmSegment)) {
+		close(fd);
+		return nullptr;
+	}
+	void *addr = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return nullptr;
+
+	ShmSegment *seg = static_cast<ShmSegment *>(addr);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	int32_t nobody = 0;
+	if (seg->magic != SHM_MAGIC || !process_alive(seg->daemon_pid)
+	    || !seg->client_pid.compare_exchange_strong(nobody, getpid())) {
+		munmap(addr, sizeof(ShmSegment));
+		return nullptr;
+	}
+	/* Both sides have it mapped, the name is no longer needed */
+	shm_unlink(name.c_str());
+	return std::unique_ptr<ShmTransport>(new ShmTransport(name, seg, false));
+}
+
+bool ShmTransport::PeerAlive() const
+{
+	pid_t pid = daemon_side_ ? seg_->client_pid.load() : seg_->daemon_pid;
+	return pid == 0 || process_alive(pid);
+}
+
+bool ShmTransport::Write(const void *data, size_t len)
+{
+	const char *p = static_cast<const char *>(data);
+	int spins = 0;
+
+	while (len > 0) {
+		uint64_t head = tx_->head.load(std::memory_order_relaxed);
+		uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+		size_t space = DSM_SHM_RING_SIZE - (size_t)(head - tail);
+		if (space == 0) {
+			if (spins++ < SHM_SPIN) {
+				sched_yield();
+				continue;
+			}
+			uint32_t seq = tx_->space_seq.load();
+			tx_->writer_waiting.store(1);
+			bool woken = true;
+			if (tx_->tail.load() == tail)
+				woken = futex_wait(&tx_->space_seq, seq);
+			tx_->writer_waiting.store(0);
+			if (!woken && !PeerAlive())
+				return false;
+			continue;
+		}
+
+		size_t n = std::min(space, len);
+		size_t off = (size_t)head & (DSM_SHM_RING_SIZE - 1);
+		size_t first = std::min(n, (size_t)DSM_SHM_RING_SIZE - off);
+		memcpy(tx_->data + off, p, first);
+		memcpy(tx_->data, p + first, n - first);
+		tx_->head.store(head + n, std::memory_order_release);
+		tx_->data_seq.fetch_add(1);
+		if (tx_->reader_waiting.load())
+			futex_wake(&tx_->data_seq);
+		p += n;
+		len -= n;
+		spins = 0;
+	}
+	return true;
+}
+
+bool ShmTransport::Send(const MsgBuilder &msg)
+{
+	dsm_header_t header;
+	struct iovec iov[DSM_MSG_MAX_PARTS + 1];
+	int iovcnt = msg.Gather(&header, iov);
+	if (iovcnt == 0)
+		return false;
+
+	std::lock_guard<std::mutex> guard(send_mutex_);
+	for (int i = 0; i < iovcnt; i++) {
+		if (!Write(iov[i].iov_base, iov[i].iov_len))
+			return false;
+	}
+	return true;
+}
+
+/* Copy out what the ring holds, up to the iovec capacity; 0 when empty */
+size_t ShmTransport::Drain(const struct iovec *iov, int iovcnt)
+{
+	uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+	uint64_t head = rx_->head.load(std::memory_order_acquire);
+	if (head == tail)
+		return 0;
+
+	size_t avail = (size_t)(head - tail);
+	size_t n = 0;
+	for (int i = 0; i < iovcnt && n < avail; i++) {
+		size_t len = std::min(iov[i].iov_len, avail - n);
+		size_t off = (size_t)(tail + n) & (DSM_SHM_RING_SIZE - 1);
+		size_t first = std::min(len, (size_t)DSM_SHM_RING_SIZE - off);
+		char *dst = static_cast<char *>(iov[i].iov_base);
+		memcpy(dst, rx_->data + off, first);
+		memcpy(dst + first, rx_->data, len - first);
+		n += len;
+	}
+	rx_->tail.store(tail + n, std::memory_order_release);
+	rx_->space_seq.fetch_add(1);
+	if (rx_->writer_waiting.load())
+		futex_wake(&rx_->space_seq);
+	return n;
+}
+
+ssize_t ShmTransport::RecvV(const struct iovec *iov, int iovcnt)
+{
+	int spins = 0;
+
+	while (true) {
+		size_t n = Drain(iov, iovcnt);
+		if (n > 0)
+			return (ssize_t)n;
+
+		if (spins++ < SHM_SPIN) {
+			sched_yield();
+			continue;
+		}
+		uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+		uint32_t seq = rx_->data_seq.load();
+		rx_->reader_waiting.store(1);
+		bool woken = true;
+		if (rx_->head.load() == tail)
+			woken = futex_wait(&rx_->data_seq, seq);
+		rx_->reader_waiting.store(0);
+		/* Whatever the peer wrote before it died is still delivered */
+		if (!woken && !PeerAlive() && rx_->head.load() == tail)
+			return 0;
+	}
+}
+
+size_t ShmTransport::TryRecv(void *buf, size_t len)
+{
+	struct iovec iov = { buf, len };
+	return Drain(&iov, 1);
+}
+
+bool ShmTransport::Closed() const
+{
+	return !PeerAlive() && rx_->head.load() == rx_->tail.load();
+}
+
+bool ShmTransport::WaitAny(const std::vector<ShmTransport *> &segments)
+{
+	/* Spin like RecvV before going to sleep */
+	for (int spins = 0; spins < SHM_SPIN; spins++) {
+		for (ShmTransport *segment : segments) {
+			if (segment->rx_->head.load() != segment->rx_->tail.load(std::memory_order_relaxed))
+				return true;
+		}
+		sched_yield();
+	}
+
+	/* Beyond FUTEX_WAITV_MAX rings the rest are only looked at after the timeout */
+	size_t count = std::min(segments.size(), (size_t)FUTEX_WAITV_MAX);
+	std::vector<struct futex_waitv> waiters(count);
+	bool ready = false;
+	for (size_t i = 0; i < count; i++) {
+		ShmRing *rx = segments[i]->rx_;
+		waiters[i] = {};
+		waiters[i].val = rx->data_seq.load();
+		waiters[i].uaddr = reinterpret_cast<uintptr_t>(&rx->data_seq);
+		waiters[i].flags = FUTEX_32;
+		rx->reader_waiting.store(1);
+		if (rx->head.load() != rx->tail.load(std::memory_order_relaxed))
+			ready = true;
+	}
+
+	bool woken = true;
+	if (!ready && count > 0) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += SHM_WAIT_MS * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		long rc = syscall(SYS_futex_waitv, waiters.data(), (unsigned int)count, 0, &deadline, CLOCK_MONOTONIC);
+		if (rc < 0 && errno == ENOSYS) {
+			struct timespec nap = { 0, SHM_POLL_US * 1000L };
+			nanosleep(&nap, nullptr);
+		} else {
+			woken = !(rc < 0 && errno == ETIMEDOUT);
+		}
+	}
+
+	for (size_t i = 0; i < count; i++)
+		segments[i]->rx_->reader_waiting.store(0);
+	return woken;
+}
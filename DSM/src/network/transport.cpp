@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "net/transport.h"
+
+bool RpcMessage::Read(void *buf, size_t n)
+{
+	if (n > payload.size() - pos)
+		return false;
+	memcpy(buf, payload.data() + pos, n);
+	pos += n;
+	return true;
+}
+
+const char *RpcMessage::Take(size_t n)
+{
+	if (n > payload.size() - pos)
+		return nullptr;
+	const char *data = payload.data() + pos;
+	pos += n;
+	return data;
+}
+
+char *RpcMessage::TakePage()
+{
+	if (next_page == page_count)
+		return nullptr;
+	return pages.get() + (size_t)DSM_PAGE_SIZE * next_page++;
+}
+
+size_t RpcMessage::ResetPages(size_t payload_len)
+{
+	/* A header announcing more pages than the payload holds keeps them all in payload */
+	page_count = DSM_RAW_PAGES(header);
+	if ((size_t)page_count * DSM_PAGE_SIZE > payload_len)
+		page_count = 0;
+	next_page = 0;
+	pages.reset();
+	if (page_count > 0)
+		pages.reset(static_cast<char *>(aligned_alloc(DSM_PAGE_SIZE, (size_t)page_count * DSM_PAGE_SIZE)), free);
+	return payload_len - (size_t)page_count * DSM_PAGE_SIZE;
+}
+
+void FrameBuffer::Append(const char *data, size_t len)
+{
+	/* Drop the consumed prefix before it grows past what is still pending */
+	if (pos_ > 0 && pos_ >= buf_.size() - pos_) {
+		buf_.erase(buf_.begin(), buf_.begin() + pos_);
+		pos_ = 0;
+	}
+	buf_.insert(buf_.end(), data, data + len);
+}
+
+bool FrameBuffer::Next(RpcMessage &msg)
+{
+	size_t avail = buf_.size() - pos_;
+	if (avail < sizeof(dsm_header_t))
+		return false;
+
+	dsm_header_t header;
+	memcpy(&header, buf_.data() + pos_, sizeof(header));
+	size_t payload_len = ntohl(header.payload_len);
+	if (avail - sizeof(header) < payload_len)
+		return false;
+
+	const char *payload = buf_.data() + pos_ + sizeof(header);
+	msg.header = header;
+	size_t head_len = msg.ResetPages(payload_len);
+	msg.payload.assign(payload, payload + head_len);
+	if (msg.page_count > 0)
+		memcpy(msg.pages.get(), payload + head_len, payload_len - head_len);
+	msg.pos = 0;
+	pos_ += sizeof(header) + payload_len;
+	return true;
+}
+
+TcpTransport::~TcpTransport()
+{
+	close(sock_);
+}
+
+bool TcpTransport::Send(const MsgBuilder &msg)
+{
+	std::lock_guard<std::mutex> guard(send_mutex_);
+	return msg.Send(sock_);
+}
+
+ssize_t TcpTransport::RecvV(const struct iovec *iov, int iovcnt)
+{
+	while (true) {
+		ssize_t n = readv(sock_, iov, iovcnt);
+		if (n < 0 && errno == EINTR)
+			continue;
+		return n;
+	}
+}
+
+std::string TcpTransport::Name() const
+{
+	return "fd=" + std::to_string(sock_);
+}
+
+MessageReader::MessageReader(Transport &transport)
+	: transport_(transport), buf_(sizeof(dsm_header_t))
+{
+}
+
+bool MessageReader::ReadInto(struct iovec *iov, int iovcnt, bool read_ahead)
+{
+	int first = 0;
+	for (; first < iovcnt; first++) {
+		size_t buffered = std::min(iov[first].iov_len, end_ - pos_);
+		memcpy(iov[first].iov_base, buf_.data() + pos_, buffered);
+		pos_ += buffered;
+		iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + buffered;
+		iov[first].iov_len -= buffered;
+		if (iov[first].iov_len > 0)
+			break;
+	}
+
+	/* The rest lands in place directly, followed at most by the next header */
+	while (first < iovcnt) {
+		struct iovec vec[3];
+		int cnt = 0;
+		for (int i = first; i < iovcnt; i++)
+			vec[cnt++] = iov[i];
+		if (read_ahead)
+			vec[cnt++] = { buf_.data(), buf_.size() };
+		ssize_t got = transport_.RecvV(vec, cnt);
+		if (got <= 0)
+			return false;
+
+		size_t left = (size_t)got;
+		for (; first < iovcnt; first++) {
+			size_t n = std::min(iov[first].iov_len, left);
+			iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + n;
+			iov[first].iov_len -= n;
+			left -= n;
+			if (iov[first].iov_len > 0)
+				break;
+		}
+		if (left > 0) {
+			pos_ = 0;
+			end_ = left;
+		}
+	}
+	return true;
+}
+
+bool MessageReader::Next(RpcMessage &msg)
+{
+	struct iovec head = { &msg.header, sizeof(msg.header) };
+	if (!ReadInto(&head, 1, false))
+		return false;
+	size_t payload_len = ntohl(msg.header.payload_len);
+	msg.payload.resize(msg.ResetPages(payload_len));
+	msg.pos = 0;
+
+	struct iovec body[2] = {
+		{ msg.payload.data(), msg.payload.size() },
+		{ msg.pages.get(), payload_len - msg.payload.size() }
+	};
+	return ReadInto(body, 2, true);
+}
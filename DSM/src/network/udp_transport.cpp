@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+#include "net/udp_transport.h"
+
+/* Header and payload of a message in one buffer, kept for retransmission */
+static bool flatten(const MsgBuilder &msg, std::vector<char> &bytes)
+{
+	dsm_header_t header;
+	struct iovec iov[DSM_MSG_MAX_PARTS + 1];
+	int iovcnt = msg.Gather(&header, iov);
+	if (iovcnt == 0)
+		return false;
+
+	bytes.clear();
+	bytes.reserve(sizeof(header) + msg.PayloadLen());
+	for (int i = 0; i < iovcnt; i++) {
+		const char *base = static_cast<const char *>(iov[i].iov_base);
+		bytes.insert(bytes.end(), base, base + iov[i].iov_len);
+	}
+	return true;
+}
+
+/* Cut a flattened message into datagrams of at most DSM_UDP_FRAGMENT payload
+ * bytes, each led by the message header. to is null on a connected socket. */
+static bool send_datagrams(int sock, const struct sockaddr_in *to, const std::vector<char> &bytes, uint32_t low_seq)
+{
+	dsm_dgram_t prefix;
+	memcpy(&prefix.header, bytes.data(), sizeof(prefix.header));
+	prefix.low_seq = htonl(low_seq);
+	const char *payload = bytes.data() + sizeof(dsm_header_t);
+	size_t total = bytes.size() - sizeof(dsm_header_t);
+
+	size_t offset = 0;
+	do {
+		size_t n = std::min<size_t>(DSM_UDP_FRAGMENT, total - offset);
+		prefix.offset = htonl(static_cast<uint32_t>(offset));
+		struct iovec iov[2] = { { &prefix, sizeof(prefix) }, { const_cast<char *>(payload + offset), n } };
+		struct msghdr mh;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_name = const_cast<struct sockaddr_in *>(to);
+		mh.msg_namelen = to != nullptr ? sizeof(*to) : 0;
+		mh.msg_iov = iov;
+		mh.msg_iovlen = 2;
+		ssize_t sent;
+		do {
+			sent = sendmsg(sock, &mh, MSG_NOSIGNAL);
+		} while (sent < 0 && errno == EINTR);
+		if (sent < 0)
+			return false;
+		offset += n;
+	} while (offset < total);
+	return true;
+}
+
+bool DatagramAssembler::Add(const char *data, size_t len, RpcMessage &msg)
+{
+	dsm_dgram_t prefix;
+	if (len < sizeof(prefix))
+		return false;
+	memcpy(&prefix, data, sizeof(prefix));
+	const char *part = data + sizeof(prefix);
+	size_t n = len - sizeof(prefix);
+	size_t total = ntohl(prefix.header.payload_len);
+	size_t offset = ntohl(prefix.offset);
+	if (offset % DSM_UDP_FRAGMENT != 0 || offset > total || n != std::min<size_t>(DSM_UDP_FRAGMENT, total - offset))
+		return false;
+
+	/* Control messages almost always fit in one datagram */
+	size_t frags = total == 0 ? 1 : (total + DSM_UDP_FRAGMENT - 1) / DSM_UDP_FRAGMENT;
+	if (frags == 1) {
+		msg.header = prefix.header;
+		msg.payload.assign(part, part + n);
+		msg.pos = 0;
+		return true;
+	}
+
+	uint32_t seq = ntohl(prefix.header.seq_num);
+	auto it = partial_.find(seq);
+	if (it == partial_.end()) {
+		/* A peer that stopped halfway leaves its pieces behind, drop the oldest */
+		if (partial_.size() >= DSM_UDP_MAX_PARTIAL)
+			partial_.erase(partial_.begin());
+		Partial &fresh = partial_[seq];
+		fresh.msg.header = prefix.header;
+		fresh.msg.payload.resize(total);
+		fresh.got.assign(frags, false);
+		fresh.missing = frags;
+		it = partial_.find(seq);
+	} else if (it->second.msg.payload.size() != total) {
+		return false;
+	}
+
+	Partial &p = it->second;
+	size_t index = offset / DSM_UDP_FRAGMENT;
+	if (p.got[index])
+		return false;
+	p.got[index] = true;
+	memcpy(p.msg.payload.data() + offset, part, n);
+	if (--p.missing > 0)
+		return false;
+
+	msg = std::move(p.msg);
+	msg.pos = 0;
+	partial_.erase(it);
+	return true;
+}
+
+UdpTransport::UdpTransport(int sock)
+	: sock_(sock), wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+}
+
+UdpTransport::~UdpTransport()
+{
+	close(sock_);
+	if (wake_fd_ >= 0)
+		close(wake_fd_);
+}
+
+bool UdpTransport::Send(const MsgBuilder &msg)
+{
+	std::vector<char> bytes;
+	if (!flatten(msg, bytes))
+		return false;
+	dsm_header_t header;
+	memcpy(&header, bytes.data(), sizeof(header));
+	uint32_t seq = ntohl(header.seq_num);
+
+	bool wake;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		Pending &p = pending_[seq];
+		p.bytes = std::move(bytes);
+		p.rto_ms = DSM_UDP_RTO_MS;
+		p.deadline = Clock::now() + std::chrono::milliseconds(p.rto_ms);
+		/* A datagram the kernel could not queue is retransmitted like a lost one */
+		if (!send_datagrams(sock_, nullptr, p.bytes, pending_.begin()->first) && errno == ECONNREFUSED) {
+			pending_.erase(seq);
+			return false;
+		}
+		/* The reader sleeps until the earliest retransmission it knew of */
+		wake = p.deadline < wake_at_;
+	}
+
+	if (wake && wake_fd_ >= 0) {
+		uint64_t one = 1;
+		ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+		(void)ignored;
+	}
+	return true;
+}
+
+int UdpTransport::RetransmitDue()
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	Clock::time_point now = Clock::now();
+	if (pending_.empty()) {
+		wake_at_ = Clock::time_point::max();
+		return wake_fd_ >= 0 ? -1 : DSM_UDP_RTO_MS;
+	}
+
+	Clock::time_point next = now + std::chrono::milliseconds(DSM_UDP_RTO_MAX_MS);
+	uint32_t low_seq = pending_.begin()->first;
+	for (auto &entry : pending_) {
+		Pending &p = entry.second;
+		if (p.deadline <= now) {
+			/* A lost datagram or a request still being served (a lock or barrier
+			 * wait); the peer answers the first and ignores the second */
+			send_datagrams(sock_, nullptr, p.bytes, low_seq);
+			p.rto_ms = std::min(p.rto_ms * 2, DSM_UDP_RTO_MAX_MS);
+			p.deadline = now + std::chrono::milliseconds(p.rto_ms);
+		}
+		next = std::min(next, p.deadline);
+	}
+	wake_at_ = next;
+	auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+	return static_cast<int>(std::max<long long>(wait, 1));
+}
+
+ssize_t UdpTransport::RecvV(const struct iovec *iov, int iovcnt)
+{
+	while (ready_pos_ == ready_.size()) {
+		ready_.clear();
+		ready_pos_ = 0;
+
+		struct pollfd fds[2] = { { sock_, POLLIN, 0 }, { wake_fd_, POLLIN, 0 } };
+		int rc = poll(fds, wake_fd_ >= 0 ? 2 : 1, RetransmitDue());
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (wake_fd_ >= 0 && (fds[1].revents & POLLIN)) {
+			uint64_t count;
+			ssize_t ignored = read(wake_fd_, &count, sizeof(count));
+			(void)ignored;
+		}
+		if (fds[0].revents == 0)
+			continue;
+
+		char buf[sizeof(dsm_dgram_t) + DSM_UDP_FRAGMENT];
+		ssize_t n = recv(sock_, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n < 0) {
+			/* The error from one refused retransmission is reported ahead of
+			 * replies already queued (the daemon may have answered and exited),
+			 * only a daemon that keeps refusing is gone */
+			if (errno == ECONNREFUSED && ++refused_ < DSM_UDP_REFUSED_MAX)
+				continue;
+			if (errno == ECONNREFUSED)
+				return 0;
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			return -1;
+		}
+		refused_ = 0;
+
+		RpcMessage reply;
+		if (!in_.Add(buf, static_cast<size_t>(n), reply))
+			continue;
+		{
+			/* A resent reply to a request that was already answered */
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (pending_.erase(ntohl(reply.header.seq_num)) == 0)
+				continue;
+		}
+		const char *header = reinterpret_cast<const char *>(&reply.header);
+		ready_.insert(ready_.end(), header, header + sizeof(reply.header));
+		ready_.insert(ready_.end(), reply.payload.begin(), reply.payload.end());
+	}
+
+	size_t copied = 0;
+	for (int i = 0; i < iovcnt && ready_pos_ < ready_.size(); i++) {
+		size_t n = std::min(iov[i].iov_len, ready_.size() - ready_pos_);
+		memcpy(iov[i].iov_base, ready_.data() + ready_pos_, n);
+		ready_pos_ += n;
+		copied += n;
+	}
+	return static_cast<ssize_t>(copied);
+}
+
+std::string UdpTransport::Name() const
+{
+	return "udp fd=" + std::to_string(sock_);
+}
+
+bool UdpPeer::Deliver(const char *data, size_t len, RpcMessage &msg)
+{
+	if (!in_.Add(data, len, msg))
+		return false;
+	dsm_dgram_t prefix;
+	memcpy(&prefix, data, sizeof(prefix));
+	uint32_t seq = ntohl(msg.header.seq_num);
+	uint32_t low_seq = ntohl(prefix.low_seq);
+
+	std::vector<char> reply;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		/* Everything below low_seq has been answered and seen */
+		if (low_seq > low_seq_) {
+			low_seq_ = low_seq;
+			served_.erase(served_.begin(), served_.lower_bound(low_seq_));
+		}
+		if (seq < low_seq_)
+			return false;
+		auto it = served_.find(seq);
+		if (it == served_.end()) {
+			served_[seq];
+			return true;
+		}
+		if (it->second.empty())
+			return false;   /* still being handled, the reply follows */
+		reply = it->second;
+	}
+	send_datagrams(sock_, &addr_, reply, 0);
+	return false;
+}
+
+bool UdpPeer::Send(const MsgBuilder &msg)
+{
+	std::vector<char> bytes;
+	if (!flatten(msg, bytes))
+		return false;
+	dsm_header_t header;
+	memcpy(&header, bytes.data(), sizeof(header));
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		auto it = served_.find(ntohl(header.seq_num));
+		if (it != served_.end())
+			it->second = bytes;
+	}
+	return send_datagrams(sock_, &addr_, bytes, 0);
+}
+
+ssize_t UdpPeer::RecvV(const struct iovec *, int)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+std::string UdpPeer::Name() const
+{
+	char ip[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &addr_.sin_addr, ip, sizeof(ip));
+	return "udp " + std::string(ip) + ":" + std::to_string(ntohs(addr_.sin_port));
+}
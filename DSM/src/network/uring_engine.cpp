@@ -0,0 +1,380 @@
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "net/uring_engine.h"
+
+/* Replies produced on the loop thread wait for the loop's next io_uring_enter */
+static thread_local bool t_on_loop = false;
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+struct UringEngine::Op {
+	enum Kind { ACCEPT, RECV, SEND } kind;
+	std::shared_ptr<UringConn> conn;
+	std::vector<char> data;     // SEND: the message, kept until the kernel is done with it
+};
+
+UringConn::~UringConn()
+{
+	close(sock_);
+}
+
+bool UringConn::Send(const MsgBuilder &msg)
+{
+	dsm_header_t header;
+	struct iovec iov[DSM_MSG_MAX_PARTS + 1];
+	int iovcnt = msg.Gather(&header, iov);
+	if (iovcnt == 0)
+		return false;
+
+	std::vector<char> bytes;
+	bytes.reserve(sizeof(header) + msg.PayloadLen());
+	for (int i = 0; i < iovcnt; i++) {
+		const char *base = static_cast<const char *>(iov[i].iov_base);
+		bytes.insert(bytes.end(), base, base + iov[i].iov_len);
+	}
+
+	std::deque<std::vector<char>> chain;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		if (broken_)
+			return false;
+		queued_.push_back(std::move(bytes));
+		/* Goes out with the chain submitted when the current one completes */
+		if (inflight_ > 0)
+			return true;
+		while (!queued_.empty() && chain.size() < DSM_URING_CHAIN_MAX) {
+			chain.push_back(std::move(queued_.front()));
+			queued_.pop_front();
+		}
+		inflight_ = chain.size();
+	}
+	engine_->SubmitChain(shared_from_this(), std::move(chain));
+	return true;
+}
+
+void UringConn::SendDone(int res, size_t len)
+{
+	std::deque<std::vector<char>> chain;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		/* MSG_WAITALL: anything short of the whole message is a failure, and
+		 * the rest of its chain completes with -ECANCELED */
+		if (res != (int)len && !broken_) {
+			std::cerr << "[UringConn] Send on fd=" << sock_ << " failed: "
+				  << (res < 0 ? strerror(-res) : "short write") << std::endl;
+			broken_ = true;
+			queued_.clear();
+		}
+		if (--inflight_ > 0 || broken_ || queued_.empty())
+			return;
+		while (!queued_.empty() && chain.size() < DSM_URING_CHAIN_MAX) {
+			chain.push_back(std::move(queued_.front()));
+			queued_.pop_front();
+		}
+		inflight_ = chain.size();
+	}
+	engine_->SubmitChain(shared_from_this(), std::move(chain));
+}
+
+ssize_t UringConn::RecvV(const struct iovec *, int)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+std::string UringConn::Name() const
+{
+	return "uring fd=" + std::to_string(sock_);
+}
+
+std::unique_ptr<UringEngine> UringEngine::Create()
+{
+	std::unique_ptr<UringEngine> engine(new UringEngine);
+	if (!engine->Setup())
+		return nullptr;
+	return engine;
+}
+
+bool UringEngine::Setup()
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	ring_fd_ = uring_setup(DSM_URING_ENTRIES, &p);
+	if (ring_fd_ < 0)
+		return false;
+	/* Without NODROP a burst of multishot completions could be lost */
+	if (!(p.features & IORING_FEAT_NODROP))
+		return false;
+
+	sq_ring_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_ring_len_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap)
+		sq_ring_len_ = cq_ring_len_ = std::max(sq_ring_len_, cq_ring_len_);
+
+	sq_ring_ = mmap(nullptr, sq_ring_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+	if (sq_ring_ == MAP_FAILED) {
+		sq_ring_ = nullptr;
+		return false;
+	}
+	if (single_mmap) {
+		cq_ring_ = sq_ring_;
+	} else {
+		cq_ring_ = mmap(nullptr, cq_ring_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+		if (cq_ring_ == MAP_FAILED) {
+			cq_ring_ = nullptr;
+			return false;
+		}
+	}
+	sqes_len_ = p.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		return false;
+	sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+	char *sq = static_cast<char *>(sq_ring_);
+	sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+	sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+	sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+	sq_entries_ = p.sq_entries;
+	sq_local_tail_ = *sq_tail_;
+	char *cq = static_cast<char *>(cq_ring_);
+	cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+	/* Hand every receive buffer to the kernel, which picks one for each
+	 * multishot recv completion. Waiting for this first one also tells
+	 * whether the kernel supports buffer selection at all. */
+	buffers_ = new char[(size_t)DSM_URING_BUFFERS * DSM_URING_BUFFER_SIZE];
+	struct io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = DSM_URING_BUFFERS;
+	sqe->addr = reinterpret_cast<uint64_t>(buffers_);
+	sqe->len = DSM_URING_BUFFER_SIZE;
+	sqe->off = 0;
+	sqe->buf_group = 0;
+	if (uring_enter(ring_fd_, PublishLocked(), 1, IORING_ENTER_GETEVENTS) < 0)
+		return false;
+	unsigned head = *cq_head_;
+	if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+		return false;
+	int res = cqes_[head & cq_mask_].res;
+	__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+	return res >= 0;
+}
+
+UringEngine::~UringEngine()
+{
+	delete[] buffers_;
+	if (sqes_ != nullptr)
+		munmap(sqes_, sqes_len_);
+	if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+		munmap(cq_ring_, cq_ring_len_);
+	if (sq_ring_ != nullptr)
+		munmap(sq_ring_, sq_ring_len_);
+	if (ring_fd_ >= 0)
+		close(ring_fd_);
+}
+
+struct io_uring_sqe *UringEngine::GetSqe()
+{
+	/* The kernel takes entries at submit time, so a flush always makes room */
+	while (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+		FlushLocked();
+		sched_yield();
+	}
+	unsigned idx = sq_local_tail_ & sq_mask_;
+	struct io_uring_sqe *sqe = &sqes_[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array_[idx] = idx;
+	sq_local_tail_++;
+	return sqe;
+}
+
+unsigned UringEngine::PublishLocked()
+{
+	__atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+	return sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+}
+
+void UringEngine::FlushLocked()
+{
+	unsigned to_submit = PublishLocked();
+	/* Another thread's enter may take our entries as well, the kernel submits
+	 * at most what is there */
+	while (to_submit > 0 && uring_enter(ring_fd_, to_submit, 0, 0) < 0 && errno == EINTR)
+		;
+}
+
+void UringEngine::SubmitChain(const std::shared_ptr<UringConn> &conn, std::deque<std::vector<char>> chain)
+{
+	std::lock_guard<std::mutex> guard(sq_mutex_);
+	size_t count = chain.size();
+	for (size_t i = 0; i < count; i++) {
+		struct io_uring_sqe *sqe = GetSqe();
+		Op *op = new Op { Op::SEND, conn, std::move(chain[i]) };
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = conn->sock_;
+		sqe->addr = reinterpret_cast<uint64_t>(op->data.data());
+		sqe->len = (uint32_t)op->data.size();
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->user_data = reinterpret_cast<uint64_t>(op);
+		/* Linked so the messages reach the socket in order */
+		if (i + 1 < count)
+			sqe->flags |= IOSQE_IO_LINK;
+	}
+	if (!t_on_loop)
+		FlushLocked();
+}
+
+void UringEngine::ArmAccept()
+{
+	std::lock_guard<std::mutex> guard(sq_mutex_);
+	struct io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listenfd_;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = reinterpret_cast<uint64_t>(new Op { Op::ACCEPT, nullptr, {} });
+}
+
+void UringEngine::ArmRecv(const std::shared_ptr<UringConn> &conn)
+{
+	std::lock_guard<std::mutex> guard(sq_mutex_);
+	struct io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->sock_;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = reinterpret_cast<uint64_t>(new Op { Op::RECV, conn, {} });
+}
+
+/* Queued ahead of anything the loop submits next, so a recv re-armed after
+ * ENOBUFS finds the buffer back */
+void UringEngine::ReturnBuffer(uint16_t bid)
+{
+	std::lock_guard<std::mutex> guard(sq_mutex_);
+	struct io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = 1;
+	sqe->addr = reinterpret_cast<uint64_t>(buffers_ + (size_t)bid * DSM_URING_BUFFER_SIZE);
+	sqe->len = DSM_URING_BUFFER_SIZE;
+	sqe->off = bid;
+	sqe->buf_group = 0;
+	sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+	sqe->user_data = 0;
+}
+
+void UringEngine::HandleRecv(Op *op, int res, uint32_t flags)
+{
+	UringConn &conn = *op->conn;
+	if (flags & IORING_CQE_F_BUFFER) {
+		uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+		if (res > 0 && !conn.dropped_)
+			conn.in_.Append(buffers_ + (size_t)bid * DSM_URING_BUFFER_SIZE, (size_t)res);
+		ReturnBuffer(bid);
+
+		RpcMessage msg;
+		while (res > 0 && !conn.dropped_ && conn.in_.Next(msg)) {
+			if (!handler_(op->conn, msg)) {
+				/* Ends the multishot recv, pending replies still drain */
+				conn.dropped_ = true;
+				shutdown(conn.sock_, SHUT_RD);
+			}
+		}
+	}
+	if (flags & IORING_CQE_F_MORE)
+		return;
+
+	/* The multishot recv has ended: out of buffers, or the connection is done */
+	if (!conn.dropped_ && (res > 0 || res == -ENOBUFS)) {
+		ArmRecv(op->conn);
+	} else if (res == 0) {
+		std::cout << "[UringEngine] Connection closed by peer" << std::endl;
+	} else if (res < 0) {
+		std::cerr << "[UringEngine] Failed to read from fd=" << conn.sock_ << ": " << strerror(-res) << std::endl;
+	}
+	/* Queued requests keep the connection until they have replied */
+	delete op;
+}
+
+void UringEngine::Run(int listenfd, MessageHandler handler)
+{
+	t_on_loop = true;
+	listenfd_ = listenfd;
+	handler_ = handler;
+	ArmAccept();
+
+	while (true) {
+		/* Replies from the last batch go out in the same call that waits */
+		unsigned to_submit;
+		{
+			std::lock_guard<std::mutex> guard(sq_mutex_);
+			to_submit = PublishLocked();
+		}
+		if (uring_enter(ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EBUSY) {
+			perror("[UringEngine] io_uring_enter failed");
+			continue;
+		}
+
+		unsigned head = *cq_head_;
+		unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe cqe = cqes_[head & cq_mask_];
+			__atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+			Op *op = reinterpret_cast<Op *>(cqe.user_data);
+			if (op == nullptr) {
+				/* A returned buffer that the kernel could not take back */
+				std::cerr << "[UringEngine] Failed to return a receive buffer: " << strerror(-cqe.res) << std::endl;
+				continue;
+			}
+
+			switch (op->kind) {
+			case Op::ACCEPT:
+				if (cqe.res >= 0) {
+					int nodelay = 1;
+					setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+					ArmRecv(std::make_shared<UringConn>(this, cqe.res));
+				}
+				if (!(cqe.flags & IORING_CQE_F_MORE)) {
+					if (cqe.res < 0)
+						std::cerr << "[UringEngine] accept failed: " << strerror(-cqe.res) << std::endl;
+					delete op;
+					ArmAccept();
+				}
+				break;
+			case Op::RECV:
+				HandleRecv(op, cqe.res, cqe.flags);
+				break;
+			case Op::SEND:
+				op->conn->SendDone(cqe.res, op->data.size());
+				delete op;
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <arpa/inet.h>
+
+#include "os/barrier_tree.h"
+
+namespace {
+
+// Links of members[index] in the tree of fan-out fanout laid over members
+void link_within(const std::vector<int> &members, size_t index, size_t fanout, BarrierLinks &links)
+{
+    if (index > 0) {
+        links.parent = members[(index - 1) / fanout];
+    }
+    size_t first = index * fanout + 1;
+    for (size_t i = first; i < members.size() && i - first < fanout; i++) {
+        links.children.push_back(members[i]);
+    }
+}
+
+} // namespace
+
+BarrierLinks dsm_barrier_links(int pod, const std::vector<std::string> &pod_hosts, int fanout)
+{
+    size_t width = fanout > 0 ? static_cast<size_t>(fanout) : std::numeric_limits<size_t>::max() / 2;
+
+    // Pods of each host in ascending order; hosts ordered by their lowest pod,
+    // so the host of Pod 0 comes first and Pod 0 is its root
+    std::vector<std::vector<int>> hosts;
+    std::vector<std::string> names;
+    for (int i = 0; i < static_cast<int>(pod_hosts.size()); i++) {
+        auto it = std::find(names.begin(), names.end(), pod_hosts[i]);
+        if (it == names.end()) {
+            names.push_back(pod_hosts[i]);
+            hosts.emplace_back();
+            it = names.end() - 1;
+        }
+        hosts[it - names.begin()].push_back(i);
+    }
+
+    std::vector<int> roots;
+    for (const std::vector<int> &members : hosts) {
+        roots.push_back(members.front());
+    }
+
+    BarrierLinks links;
+    for (const std::vector<int> &members : hosts) {
+        auto it = std::find(members.begin(), members.end(), pod);
+        if (it == members.end()) {
+            continue;
+        }
+        size_t index = it - members.begin();
+        link_within(members, index, width, links);
+        if (index == 0) {
+            // The host's root also links the hosts together
+            BarrierLinks across;
+            link_within(roots, std::find(roots.begin(), roots.end(), pod) - roots.begin(), width, across);
+            links.parent = across.parent;
+            links.children.insert(links.children.end(), across.children.begin(), across.children.end());
+        }
+    }
+    return links;
+}
+
+void BarrierNotices::Add(uint32_t page, uint16_t writer)
+{
+    if (overflow) {
+        return;
+    }
+    auto it = pages.find(page);
+    if (it == pages.end()) {
+        if (pages.size() >= DSM_BARRIER_NOTICE_MAX) {
+            // Past this size revoking the whole region is as cheap
+            overflow = true;
+            pages.clear();
+            return;
+        }
+        pages[page] = writer;
+    } else if (it->second != writer) {
+        it->second = DSM_BARRIER_WRITER_MANY;
+    }
+}
+
+bool BarrierNotices::Merge(RpcMessage &msg)
+{
+    if (msg.header.unused == DSM_BARRIER_ALL) {
+        overflow = true;
+        pages.clear();
+        return true;
+    }
+    // A JOIN_REQ without a payload reports no writes
+    if (msg.payload.size() == msg.pos) {
+        return true;
+    }
+    payload_barrier_notice_t notice;
+    if (!msg.Read(&notice, sizeof(notice))) {
+        return false;
+    }
+    uint32_t count = ntohl(notice.page_count);
+    const char *entries = msg.Take(static_cast<size_t>(count) * sizeof(payload_barrier_page_t));
+    if (entries == nullptr) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        payload_barrier_page_t entry;
+        std::memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+        Add(ntohl(entry.page_index), ntohs(entry.writer_id));
+    }
+    return true;
+}
+
+uint8_t BarrierNotices::Flags() const
+{
+    return overflow ? DSM_BARRIER_ALL : 0;
+}
+
+std::vector<char> BarrierNotices::Encode() const
+{
+    if (overflow) {
+        return {};
+    }
+    std::vector<char> out(sizeof(payload_barrier_notice_t) + pages.size() * sizeof(payload_barrier_page_t));
+    payload_barrier_notice_t notice = { htonl(static_cast<uint32_t>(pages.size())) };
+    std::memcpy(out.data(), &notice, sizeof(notice));
+    char *at = out.data() + sizeof(notice);
+    for (const auto &page : pages) {
+        payload_barrier_page_t entry = { htonl(page.first), htons(page.second) };
+        std::memcpy(at, &entry, sizeof(entry));
+        at += sizeof(entry);
+    }
+    return out;
+}
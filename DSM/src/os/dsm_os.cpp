@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cerrno>
+#include <condition_variable>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
@@ -15,18 +17,25 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 
 #include "dsm.h"
 #include "net/protocol.h"
+#include "os/barrier_tree.h"
 #include "os/bind_table.h"
 #include "os/lock_table.h"
 #include "os/page_table.h"
 #include "os/socket_table.h"
 #include "os/pfhandler.h"
+#include "os/page_diff.h"
 
 // 声明来自 dsm_os_cond.cpp 的辅助函数
-extern int getsocket(const std::string& ip, int port);
+extern RpcChannel* getchannel(int node);
+extern RpcChannel* getcontrol(int node);
+extern bool ConnectMesh();
 extern bool LaunchListenerThread(int Port);
 extern bool FetchGlobalData(int dsm_pagenum, std::string& LeaderNodeIp, int& LeaderNodePort);
 extern bool InitDataStructs(int dsm_pagenum);
@@ -50,7 +59,23 @@ int SAC_VPNumber = 0;           //共享区下一次分配的空间的虚拟页
 int ProcNum = 0;
 int WorkerNodeNum = 0;
 std::vector<std::string> WorkerNodeIps;  // worker IP list
-int* InvalidPages = nullptr;            //0: valid, 1: invalid
+int* InvalidPages = nullptr;            //0: clean, 1: written since the last release
+int* BarrierPages = nullptr;            //0: clean, 1: written since the last barrier
+int* PageAccess = nullptr;              //access granted by the coherence protocol (PROT_*)
+int* ProbOwner = nullptr;               //last node seen holding the page, -1 when unknown
+int* BlockFirst = nullptr;              //first page (relative index) of the page's coherence block
+int MultiWriter = 0;                    //1: twin/diff multiple-writer protocol
+int PrefetchMax = 8;                    //max pages fetched ahead of a strided fault stream, 0 disables
+int PageCodec = 0;                      //codec offered for page payloads (net/page_codec.h), 0 sends pages raw
+int FaultThreads = 2;                   //userfaultfd service threads, 0 leaves every fault to the SIGSEGV service threads
+int DaemonThreads = 4;                  //daemon worker pool size for page, ownership and diff requests
+int DaemonUring = 0;                    //1: serve daemon TCP connections from io_uring instead of epoll
+int LocalShm = 1;                       //1: reach daemons on the same host through shared memory rings
+int ControlUdp = 0;                     //1: lock, barrier and OWNER_UPDATE messages go over reliable UDP
+int LockCache = 1;                      //1: a released lock stays with this pod until another pod asks for it
+int BarrierFanout = 4;                  //children per pod in the barrier combining tree, 0: no limit
+char* TwinArea = nullptr;               //twins of pages written since the last release
+char* HomeArea = nullptr;               //home copies of the pages this pod manages
 
 
 std::string LeaderNodeIp;
@@ -59,23 +84,50 @@ int LeaderNodeSocket = -1;
 int LockNum = 0;
 
 
-std::string GetPodIp(int pod_id) {
+// Address the pod's host is known by in the cluster configuration
+std::string PodHostIp(int pod_id) {
     if (pod_id == 0) {
         // Leader Pod
         return LeaderNodeIp;
-    } else if (pod_id == PodId) {
-        return "127.0.0.1";
-    }else if (pod_id > 0 && WorkerNodeNum > 0) {
+    } else if (pod_id > 0 && WorkerNodeNum > 0) {
         // Worker Pod: pod_id % WorkerNodeNum
         int worker_index = pod_id % WorkerNodeNum;
         if (worker_index < static_cast<int>(WorkerNodeIps.size())) {
             return WorkerNodeIps[worker_index];
         }
     }
-    std::cerr << "[DSM Warning] Invalid PodID " << pod_id << " or empty Worker IP list" << std::endl;
     return "";
 }
 
+std::string GetPodIp(int pod_id) {
+    if (pod_id != 0 && pod_id == PodId) {
+        return "127.0.0.1";
+    }
+    std::string ip = PodHostIp(pod_id);
+    if (ip.empty()) {
+        std::cerr << "[DSM Warning] Invalid PodID " << pod_id << " or empty Worker IP list" << std::endl;
+    }
+    return ip;
+}
+
+static bool IsLoopback(const std::string& ip) {
+    return ip.compare(0, 4, "127.") == 0 || ip == "localhost";
+}
+
+// Whether pod_id runs on this machine, so its daemon can be reached through
+// shared memory (net/shm_transport.h) instead of TCP
+bool PodSharesHost(int pod_id) {
+    if (pod_id == PodId) {
+        return true;
+    }
+    std::string mine = PodHostIp(PodId);
+    std::string theirs = PodHostIp(pod_id);
+    if (mine.empty() || theirs.empty()) {
+        return false;
+    }
+    return mine == theirs || (IsLoopback(mine) && IsLoopback(theirs));
+}
+
 int GetPodPort(int pod_id) {
     if (pod_id == 0) {
         return LeaderNodePort;
@@ -86,42 +138,170 @@ int GetPodPort(int pod_id) {
     return -1;
 }
 
-bool dsm_barrier()
+// Multiple-writer release: turn every twinned page into a run-length diff,
+// ship the diffs to the pages' homes (one message per home) and wait until
+// they are merged. Written pages are write-protected again afterwards.
+static bool flush_diffs()
 {
-    if (SharedAddrBase != nullptr && SharedPages > 0) {
-        size_t total_size = SharedPages * PAGESIZE;
-        if (mprotect(SharedAddrBase, total_size, PROT_NONE) == -1) {
-            std::cerr << "[dsm_mutex_lock] mprotect failed: " << std::strerror(errno) << std::endl;
-        }else{
-            std::cerr << "[dsm_mutex_lock] mprotect succeed: " << std::endl;
+    if (!MultiWriter || PageAccess == nullptr) {
+        return true;
+    }
+
+    std::map<int, std::vector<uint8_t>> batches;   // home pod -> PAGE_DIFF payload
+    std::vector<uint8_t> diff(DSM_DIFF_MAX_SIZE(PAGESIZE));
+    for (size_t i = 0; i < SharedPages; i++) {
+        if (PageAccess[i] != (PROT_READ | PROT_WRITE)) {
+            continue;
+        }
+        char* page = reinterpret_cast<char*>(SharedAddrBase) + i * PAGESIZE;
+        mprotect(page, PAGESIZE, PROT_READ);
+        PageAccess[i] = PROT_READ;
+
+        size_t diff_len = dsm_diff_encode(page, TwinArea + i * PAGESIZE, PAGESIZE, diff.data());
+        if (diff_len == 0) {
+            continue;
+        }
+        int VPN = SAB_VPNumber + static_cast<int>(i);
+        payload_page_diff_t seg = {
+            htonl(static_cast<uint32_t>(VPN)),
+            htonl(static_cast<uint32_t>(diff_len))
+        };
+        std::vector<uint8_t>& batch = batches[VPN % ProcNum];
+        const uint8_t* seg_bytes = reinterpret_cast<const uint8_t*>(&seg);
+        batch.insert(batch.end(), seg_bytes, seg_bytes + sizeof(seg));
+        batch.insert(batch.end(), diff.begin(), diff.begin() + diff_len);
+    }
+
+    // Send every batch before waiting so the homes merge in parallel
+    bool ok = true;
+    std::vector<std::pair<RpcChannel*, uint32_t>> sent;   // channel, seq_num
+    for (auto& entry : batches) {
+        int home = entry.first;
+        std::vector<uint8_t>& payload = entry.second;
+        RpcChannel* channel = getchannel(home);
+        if (channel == nullptr) {
+            std::cerr << "[dsm_flush_diffs] Failed to connect to home " << home << std::endl;
+            ok = false;
+            continue;
+        }
+
+        dsm_header_t req_header = {
+            DSM_MSG_PAGE_DIFF,
+            0,                          // unused
+            htons(PodId),              // src_node_id
+            0,                          // seq_num: assigned by the channel
+            htonl(static_cast<uint32_t>(payload.size()))
+        };
+        uint32_t seq = channel->Send(req_header, { { payload.data(), payload.size() } });
+        if (seq == 0) {
+            std::cerr << "[dsm_flush_diffs] Failed to send PAGE_DIFF to home " << home << std::endl;
+            ok = false;
+            continue;
         }
+        sent.emplace_back(channel, seq);
     }
 
-    std::string target_ip = LeaderNodeIp;
+    for (auto& request : sent) {
+        RpcMessage ack;
+        if (!request.first->Wait(request.second, ack) || ack.header.type != DSM_MSG_ACK) {
+            std::cerr << "[dsm_flush_diffs] No ACK for PAGE_DIFF" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
 
-    // Connect to leader node for synchronization
-    int leader_sock = getsocket(LeaderNodeIp, LeaderNodePort);
-    if (leader_sock < 0) {
-        std::cerr << "[dsm_barrier] failed to connect to leader at "
-                  << LeaderNodeIp << ":" << LeaderNodePort << std::endl;
+// Revoke every shared page: the fallback when too many pages were written
+// for the barrier to list them
+static void revoke_shared_region()
+{
+    size_t total_size = SharedPages * PAGESIZE;
+    if (mprotect(SharedAddrBase, total_size, PROT_NONE) == -1) {
+        std::cerr << "[dsm_barrier] mprotect failed: " << std::strerror(errno) << std::endl;
+    }
+    // Multiple-writer replicas miss the other writers' diffs, refetch them
+    if (MultiWriter && PageAccess != nullptr) {
+        std::memset(PageAccess, 0, sizeof(int) * SharedPages);
+    }
+}
+
+bool dsm_barrier()
+{
+    // Publish local changes before anyone can pass the barrier; the
+    // managers' invalidations for our new pages are done as well
+    flush_diffs();
+    flush_owner_updates();
+
+    // Our write notices: the pages written since the last barrier, write-
+    // protected again so the next store is recorded for the next one
+    BarrierNotices written;
+    if (BarrierPages != nullptr) {
+        for (size_t i = 0; i < SharedPages; i++) {
+            if (BarrierPages[i] == 1) {
+                written.Add(static_cast<uint32_t>(i), static_cast<uint16_t>(PodId));
+                BarrierPages[i] = 0;
+                if (PageAccess[i] & PROT_WRITE) {
+                    mprotect(reinterpret_cast<char*>(SharedAddrBase) + i * PAGESIZE, PAGESIZE, PROT_READ);
+                }
+            }
+        }
+    }
+
+    // Arrive at our own daemon; it waits for its children in the barrier
+    // tree, reports to its parent, and releases us once Pod 0 has heard
+    // from everyone
+    RpcChannel* daemon = getcontrol(PodId);
+    if (daemon == nullptr) {
+        std::cerr << "[dsm_barrier] failed to connect to own daemon" << std::endl;
         return false;
     }
+    std::vector<char> payload = written.Encode();
     dsm_header_t req = {
         DSM_MSG_JOIN_REQ,                    
-        0,                       // unused
-    htons(PodId),            // src_node_id: source pod ID
-        htonl(1),                // seq_num: 1 
-        0                       // payload length
+        written.Flags(),         // unused: DSM_BARRIER_ALL when the pages were not listed
+        htons(PodId),            // src_node_id: source pod ID
+        0,                       // seq_num: assigned by the channel
+        htonl(static_cast<uint32_t>(payload.size()))
     };
-    ::send(leader_sock, &req, sizeof(req), 0);
 
-    // Wait for acknowledgment from leader node
-    rio_t rio;
-    rio_readinit(&rio, leader_sock);
-    
-    dsm_header_t ack_header;
-    rio_readn(&rio, &ack_header, sizeof(ack_header));
-    
+    // Wait for the release, which brings the pages every pod wrote
+    RpcMessage ack;
+    if (!daemon->Call(req, { { payload.data(), payload.size() } }, ack)) {
+        std::cerr << "[dsm_barrier] no JOIN_ACK from own daemon" << std::endl;
+        return false;
+    }
+    BarrierNotices notices;
+    if (!notices.Merge(ack)) {
+        std::cerr << "[dsm_barrier] malformed write notices, revoking the shared region" << std::endl;
+        notices.overflow = true;
+    }
+
+    if (SharedAddrBase == nullptr || SharedPages == 0) {
+        return true;
+    }
+    if (notices.overflow) {
+        revoke_shared_region();
+        return true;
+    }
+
+    // Drop only the pages another pod wrote; clean pages and pages only we
+    // wrote stay mapped. Single writer: a page we own now is current.
+    for (const auto& notice : notices.pages) {
+        if (notice.second == PodId || notice.first >= SharedPages) {
+            continue;
+        }
+        int VPN = SAB_VPNumber + static_cast<int>(notice.first);
+        if (!MultiWriter) {
+            PageTable->GlobalMutexLock();
+            PageRecord* page_rec = PageTable->Find(VPN);
+            bool owned = page_rec != nullptr && page_rec->owner_id == PodId;
+            PageTable->GlobalMutexUnlock();
+            if (owned) {
+                continue;
+            }
+        }
+        invalidate_local_page(VPN);
+    }
     return true;
 }
 
@@ -133,6 +313,9 @@ int dsm_init(int dsm_pagenum)
         return -2;
     if (!InitDataStructs(dsm_pagenum))
         return -3;
+    // Pods still missing afterwards are connected on first use
+    if (!ConnectMesh())
+        std::cerr << "[dsm_init] not every pod was reachable" << std::endl;
     return 0;
 }
 
@@ -149,6 +332,46 @@ int dsm_finalize(void){
     return 0;
 }
 
+// This pod's side of a lock token when DSM_LOCK_CACHE is on: a release keeps
+// the token here, and the manager recalls it (DSM_MSG_LOCK_RECALL) once
+// another pod queues for the lock
+#define TOKEN_NONE      0   // with the manager or another pod
+#define TOKEN_ACQUIRING 1   // LOCK_ACQ sent, grant not read yet
+#define TOKEN_HELD      2   // a thread of this pod is in the critical section
+#define TOKEN_CACHED    3   // released here and still ours
+
+struct LockToken {
+    int state = TOKEN_NONE;
+    bool recalled = false;      // the manager wants it back: the next unlock returns it
+    std::set<int> pages;        // written since the token arrived, handed on with it
+};
+
+static std::mutex g_token_mutex;                // protects g_tokens
+static std::condition_variable g_token_cond;    // a token stopped being ACQUIRING or HELD
+static std::map<int, LockToken> g_tokens;       // lock_id -> token
+
+bool SurrenderLockToken(int lock_id, std::vector<int>& pages)
+{
+    std::lock_guard<std::mutex> guard(g_token_mutex);
+    auto it = g_tokens.find(lock_id);
+    if (it == g_tokens.end()) {
+        return false;
+    }
+    LockToken& token = it->second;
+    if (token.state != TOKEN_CACHED) {
+        // In use or on its way here: the unlock returns it. With no token
+        // at all our LOCK_RLS is already on its way.
+        if (token.state != TOKEN_NONE) {
+            token.recalled = true;
+        }
+        return false;
+    }
+    pages.assign(token.pages.begin(), token.pages.end());
+    token.pages.clear();
+    token.state = TOKEN_NONE;
+    return true;
+}
+
 int dsm_mutex_init(){
     // Initialize a new lock in the LockTable
     LockTable->GlobalMutexLock();
@@ -167,36 +390,24 @@ int dsm_mutex_destroy(int *mutex){
     return 0;
 }
 
-int dsm_mutex_lock(int *mutex){
-
-    const int lockid = *mutex;
+// Ask the lock manager for the lock in the given mode (DSM_LOCK_*) and wait
+// for the grant
+static int request_lock(int lockid, uint8_t mode){
     int lockprobowner = lockid % ProcNum;
-    // Get or create socket connection to the probable owner
-    std::string target_ip = GetPodIp(lockprobowner);
-    int target_port = GetPodPort(lockprobowner);
-    
-    int sock = getsocket(target_ip, target_port);
-    if (sock < 0) {
-        std::cerr << "[dsm_mutex_lock] Failed to connect to lock manager at " 
-                  << target_ip << ":" << target_port << std::endl;
+    // Channel to the lock manager, opened in dsm_init
+    RpcChannel* channel = getcontrol(lockprobowner);
+    if (channel == nullptr) {
+        std::cerr << "[dsm_mutex_lock] Failed to connect to lock manager " 
+                  << lockprobowner << std::endl;
         return -1;
     }
 
-    // Get sequence number for this connection
-    uint32_t seq_num = 1;
-    SocketTable->GlobalMutexLock();
-    SocketRecord* record = SocketTable->Find(lockprobowner);
-    if (record != nullptr) {
-        seq_num = record->allocate_seq();
-    }
-    SocketTable->GlobalMutexUnlock();
-
     // Build and send LOCK_ACQ message
     dsm_header_t req_header = {
         DSM_MSG_LOCK_ACQ,
-        0,                          // unused
+        mode,                       // unused: exclusive or shared
         htons(PodId),              // src_node_id
-        htonl(seq_num),            // seq_num
+        0,                          // seq_num: assigned by the channel
         htonl(sizeof(payload_lock_req_t))  // payload_len
     };
 
@@ -204,56 +415,57 @@ int dsm_mutex_lock(int *mutex){
         htonl(lockid)              // lock_id
     };
 
-    // Send header and payload
-    if (::send(sock, &req_header, sizeof(req_header), 0) != sizeof(req_header)) {
-        std::cerr << "[dsm_mutex_lock] Failed to send request header" << std::endl;
-        return -1;
-    }
-    
-    if (::send(sock, &req_payload, sizeof(req_payload), 0) != sizeof(req_payload)) {
-        std::cerr << "[dsm_mutex_lock] Failed to send request payload" << std::endl;
+    uint32_t seq = channel->Send(req_header, { { &req_payload, sizeof(req_payload) } });
+    if (seq == 0) {
+        std::cerr << "[dsm_mutex_lock] Failed to send LOCK_ACQ" << std::endl;
         return -1;
     }
 
-    // Receive response
-    rio_t rio;
-    rio_readinit(&rio, sock);
+    // While the request is out, replicas the managers refused are dropped
+    // so none of them survives into the critical section
+    flush_owner_updates();
 
-    dsm_header_t rep_header;
-    if (rio_readn(&rio, &rep_header, sizeof(rep_header)) != sizeof(rep_header)) {
-        std::cerr << "[dsm_mutex_lock] Failed to receive response header" << std::endl;
+    // Wait for the grant; other threads keep using the connection meanwhile
+    RpcMessage rep;
+    if (!channel->Wait(seq, rep)) {
+        std::cerr << "[dsm_mutex_lock] Failed to receive response" << std::endl;
         return -1;
     }
 
     // Check if this is a LOCK_REP or if we need to wait/retry
-    if (rep_header.type == DSM_MSG_LOCK_REP ) {
+    if (rep.header.type == DSM_MSG_LOCK_REP ) {
         // Lock acquired successfully, read payload
-        uint32_t payload_len = ntohl(rep_header.payload_len);
-        
-        if (payload_len >= sizeof(uint32_t)) {
-            payload_lock_rep_t rep_payload;
-            if (rio_readn(&rio, &rep_payload, sizeof(uint32_t)) != sizeof(uint32_t)) {
-                std::cerr << "[dsm_mutex_lock] Failed to read invalid_set_count" << std::endl;
-                return -1;
-            }
-            
+        payload_lock_rep_t rep_payload;
+        if (rep.Read(&rep_payload, sizeof(uint32_t))) {
             uint32_t invalid_count = ntohl(rep_payload.invalid_set_count);
             
             // Read invalid page list if any
             if (invalid_count > 0 && InvalidPages != nullptr) {
                 std::vector<uint32_t> invalid_pages(invalid_count);
-                size_t bytes_to_read = invalid_count * sizeof(uint32_t);
-                if (rio_readn(&rio, invalid_pages.data(), bytes_to_read) != (ssize_t)bytes_to_read) {
+                if (!rep.Read(invalid_pages.data(), invalid_count * sizeof(uint32_t))) {
                     std::cerr << "[dsm_mutex_lock] Failed to read invalid page list" << std::endl;
                     return -1;
                 }
                 
-                // Mark pages as needing to be pulled (invalidated by previous owner)
-                // InvalidPages[i] = 0 means we need to pull from remote
+                // Local changes to those pages must reach the home before
+                // our replica is dropped
+                if (MultiWriter) {
+                    flush_diffs();
+                }
+
+                // Drop replicas of pages written by the previous holder so the
+                // next access pulls the new version; our own pages stay put
                 for (uint32_t i = 0; i < invalid_count; i++) {
                     uint32_t page_idx = ntohl(invalid_pages[i]);
                     if (page_idx < (uint32_t)SharedPages) {
-                        InvalidPages[page_idx] = 0;
+                        int VPN = SAB_VPNumber + static_cast<int>(page_idx);
+                        PageTable->GlobalMutexLock();
+                        PageRecord* page_rec = PageTable->Find(VPN);
+                        bool owned = !MultiWriter && page_rec != nullptr && page_rec->owner_id == PodId;
+                        PageTable->GlobalMutexUnlock();
+                        if (!owned) {
+                            invalidate_local_page(VPN);
+                        }
                     }
                 }
             }
@@ -262,45 +474,75 @@ int dsm_mutex_lock(int *mutex){
         return 0;  // Success
     } 
 
-    std::cerr << "[dsm_mutex_lock] Unexpected response type: " << (int)rep_header.type << std::endl;
+    std::cerr << "[dsm_mutex_lock] Unexpected response type: " << (int)rep.header.type << std::endl;
     return -1;
 }    
 
-int dsm_mutex_unlock(int *mutex){   
-
+int dsm_mutex_lock(int *mutex){
 
     const int lockid = *mutex;
-    int lockprobowner = lockid % ProcNum;
+    if (!LockCache) {
+        return request_lock(lockid, DSM_LOCK_MUTEX);
+    }
 
-    // Get socket connection to the probable owner
-    std::string target_ip = GetPodIp(lockprobowner);
-    int target_port = GetPodPort(lockprobowner);
-    
-    int sock = getsocket(target_ip, target_port);
-    if (sock < 0) {
-        std::cerr << "[dsm_mutex_unlock] Failed to connect to lock manager" << std::endl;
-        return -1;
+    {
+        // Threads of this pod wait for each other here, not at the manager
+        std::unique_lock<std::mutex> lock(g_token_mutex);
+        LockToken& token = g_tokens[lockid];
+        g_token_cond.wait(lock, [&token] { return token.state == TOKEN_NONE || token.state == TOKEN_CACHED; });
+        if (token.state == TOKEN_CACHED) {
+            token.state = TOKEN_HELD;
+            lock.unlock();
+            // No other pod held the lock since our release, so no page is
+            // stale on its account; only replicas refused since then go
+            flush_owner_updates();
+            return 0;
+        }
+        token.state = TOKEN_ACQUIRING;
     }
 
-    // Get sequence number
-    uint32_t seq_num = 1;
-    SocketTable->GlobalMutexLock();
-    SocketRecord* record = SocketTable->Find(lockprobowner);
-    if (record != nullptr) {
-        seq_num = record->allocate_seq();
+    int rc = request_lock(lockid, DSM_LOCK_MUTEX);
+    {
+        std::lock_guard<std::mutex> guard(g_token_mutex);
+        g_tokens[lockid].state = (rc == 0) ? TOKEN_HELD : TOKEN_NONE;
     }
-    SocketTable->GlobalMutexUnlock();
+    g_token_cond.notify_all();
+    return rc;
+}
+
+// Pages written since the last release, in network order; their write
+// protection is restored so the next store is recorded as well
+static std::vector<uint32_t> collect_written_pages(){
+    // Multiple writers: the homes must hold our changes before the lock moves on;
+    // single writer: the replicas of the pages we took over must be gone
+    flush_diffs();
+    flush_owner_updates();
 
-    // Collect invalid pages from InvalidPages array
     std::vector<uint32_t> invalid_pages;
     if (InvalidPages != nullptr) {
         for (size_t i = 0; i < SharedPages; i++) {
             if (InvalidPages[i] == 1) {
-                invalid_pages.push_back((uint32_t)i);  // Explicit cast
+                invalid_pages.push_back(htonl((uint32_t)i));  // network order, sent as is
                 InvalidPages[i] = 0;  // Reset after collecting
+                if (PageAccess[i] & PROT_WRITE) {
+                    mprotect(reinterpret_cast<char*>(SharedAddrBase) + i * PAGESIZE, PAGESIZE, PROT_READ);
+                }
             }
         }
     }
+    return invalid_pages;
+}
+
+// Send LOCK_RLS with the pages written under the lock and wait for the ACK
+static int release_lock(int lockid, const std::vector<uint32_t>& invalid_pages){
+    int lockprobowner = lockid % ProcNum;
+
+    // Channel to the lock manager, opened in dsm_init
+    RpcChannel* channel = getcontrol(lockprobowner);
+    if (channel == nullptr) {
+        std::cerr << "[dsm_mutex_unlock] Failed to connect to lock manager" << std::endl;
+        return -1;
+    }
 
     uint32_t invalid_count = invalid_pages.size();
     uint32_t payload_len = sizeof(payload_lock_rls_t) + invalid_count * sizeof(uint32_t);
@@ -310,54 +552,127 @@ int dsm_mutex_unlock(int *mutex){
         DSM_MSG_LOCK_RLS,
         0,                          // unused
         htons(PodId),              // src_node_id
-        htonl(seq_num),            // seq_num
+        0,                          // seq_num: assigned by the channel
         htonl(payload_len)         // payload_len
     };
 
-    // Send header
-    if (::send(sock, &req_header, sizeof(req_header), 0) != sizeof(req_header)) {
-        std::cerr << "[dsm_mutex_unlock] Failed to send release header" << std::endl;
-        return -1;
-    }
-
-    // Send payload structure (invalid_set_count and lock_id)
+    // Payload structure (invalid_set_count and lock_id), then the page list
     payload_lock_rls_t rls_payload = {
         htonl(invalid_count),      // invalid_set_count
         htonl(lockid)              // lock_id
     };
-    
-    if (::send(sock, &rls_payload, sizeof(rls_payload), 0) != sizeof(rls_payload)) {
-        std::cerr << "[dsm_mutex_unlock] Failed to send LOCK_RLS payload" << std::endl;
+
+    // Wait for ACK
+    RpcMessage ack;
+    if (!channel->Call(req_header, { { &rls_payload, sizeof(rls_payload) },
+                                     { invalid_pages.data(), invalid_count * sizeof(uint32_t) } }, ack)) {
+        std::cerr << "[dsm_mutex_unlock] Failed to receive ACK" << std::endl;
         return -1;
     }
 
-    // Send invalid page list
-    if (invalid_count > 0) {
-        for (uint32_t page_idx : invalid_pages) {
-            uint32_t page_idx_net = htonl(page_idx);
-            if (::send(sock, &page_idx_net, sizeof(page_idx_net), 0) != sizeof(page_idx_net)) {
-                std::cerr << "[dsm_mutex_unlock] Failed to send invalid page index" << std::endl;
-                return -1;
-            }
+    if (ack.header.type != DSM_MSG_ACK) {
+        std::cerr << "[dsm_mutex_unlock] Unexpected response type: " << (int)ack.header.type << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+int dsm_mutex_unlock(int *mutex){   
+
+    const int lockid = *mutex;
+    std::vector<uint32_t> invalid_pages = collect_written_pages();
+
+    if (LockCache) {
+        std::lock_guard<std::mutex> guard(g_token_mutex);
+        LockToken& token = g_tokens[lockid];
+        for (uint32_t page : invalid_pages) {
+            token.pages.insert(static_cast<int>(ntohl(page)));
+        }
+        if (!token.recalled) {
+            // Keep the token, the pages written under it leave with it
+            token.state = TOKEN_CACHED;
+            g_token_cond.notify_all();
+            return 0;
         }
+        // Recalled while we held it: hand it back with everything written
+        // since it arrived
+        invalid_pages.clear();
+        for (int page : token.pages) {
+            invalid_pages.push_back(htonl(static_cast<uint32_t>(page)));
+        }
+        token.pages.clear();
+        token.recalled = false;
+        token.state = TOKEN_NONE;
+        g_token_cond.notify_all();
     }
 
-    // Wait for ACK
-    rio_t rio;
-    rio_readinit(&rio, sock);
+    return release_lock(lockid, invalid_pages);
+}
 
-    dsm_header_t ack_header;
-    if (rio_readn(&rio, &ack_header, sizeof(ack_header)) != sizeof(ack_header)) {
-        std::cerr << "[dsm_mutex_unlock] Failed to receive ACK" << std::endl;
-        return -1;
+// Read-write locks share the lock ids and the manager of mutexes. Their
+// tokens are never cached: readers on several pods hold one at once.
+// The mode each thread holds a lock in, for dsm_rwlock_unlock
+static thread_local std::map<int, uint8_t> t_rwlock_modes;
+
+int dsm_rwlock_init(){
+    return dsm_mutex_init();
+}
+
+int dsm_rwlock_destroy(int *rwlock){
+    // The manager's record outlives it, as for mutexes; only forget a mode
+    // this thread never released
+    t_rwlock_modes.erase(*rwlock);
+    return 0;
+}
+
+int dsm_rwlock_rdlock(int *rwlock){
+    int rc = request_lock(*rwlock, DSM_LOCK_READ);
+    if (rc == 0) {
+        t_rwlock_modes[*rwlock] = DSM_LOCK_READ;
     }
+    return rc;
+}
 
-    if (ack_header.type != DSM_MSG_ACK) {
-        std::cerr << "[dsm_mutex_unlock] Unexpected response type: " << (int)ack_header.type << std::endl;
+int dsm_rwlock_wrlock(int *rwlock){
+    int rc = request_lock(*rwlock, DSM_LOCK_WRITE);
+    if (rc == 0) {
+        t_rwlock_modes[*rwlock] = DSM_LOCK_WRITE;
+    }
+    return rc;
+}
+
+int dsm_rwlock_unlock(int *rwlock){
+    const int lockid = *rwlock;
+    auto it = t_rwlock_modes.find(lockid);
+    if (it == t_rwlock_modes.end()) {
+        std::cerr << "[dsm_rwlock_unlock] Lock " << lockid << " is not held by this thread" << std::endl;
         return -1;
     }
+    uint8_t mode = it->second;
+    t_rwlock_modes.erase(it);
+
+    if (mode == DSM_LOCK_READ) {
+        // Readers write nothing, so only the writer's release carries write
+        // notices; pages written meanwhile under other locks stay with them
+        flush_owner_updates();
+        return release_lock(lockid, {});
+    }
+    return release_lock(lockid, collect_written_pages());
+}
 
-    return 0;
+// Group the pages from first_vpn to the end of the shared area into blocks
+// of block_pages; the next region allocated regroups its own pages. Non-zero
+// pods do not know the file size, so a region always reaches up to the next.
+static void set_region_blocks(int first_vpn, int block_pages)
+{
+    if (BlockFirst == nullptr) {
+        return;
+    }
+    int first = first_vpn - SAB_VPNumber;
+    for (int i = first; i >= 0 && i < static_cast<int>(SharedPages); i++) {
+        BlockFirst[i] = first + (i - first) / block_pages * block_pages;
+    }
 }
 
 //集成dsm_bind与dsm_malloc,
@@ -365,6 +680,17 @@ int dsm_mutex_unlock(int *mutex){
 //返回参数：数组的起始地址
 //目前共享区里的共享数据不支持字符串，对于数字默认int类型，所以返回的元素个数也是sizeof(int)为最小单位
 void* dsm_malloc(const char *name, int * num){
+    return dsm_malloc_block(name, num, PAGESIZE);
+}
+
+//Pod 0 打开、映射文件并在页表中绑定该区域；其他节点只推进分配位置
+static void* bind_region(const char *name, int * num, size_t block_size){
+    if (block_size < PAGESIZE || block_size > DSM_BLOCK_MAX || (block_size & (block_size - 1)) != 0) {
+        std::cerr << "[dsm_malloc] Invalid block size " << block_size << std::endl;
+        return nullptr;
+    }
+    int block_pages = static_cast<int>(block_size / PAGESIZE);
+
     // For non-leader processes, return the current allocation address
     // Note: In a distributed system, this assumes the allocation order is deterministic
     // and all processes call dsm_malloc in the same order with the same arguments
@@ -372,6 +698,7 @@ void* dsm_malloc(const char *name, int * num){
         // Non-Pod 0 processes: just return the current location and advance it
         // We need to calculate how much to advance based on file size
         // For now, advance by one page as a simple approximation
+        set_region_blocks(SAC_VPNumber, block_pages);
         void* result = SharedAddrCurrentLoc;
         SharedAddrCurrentLoc = reinterpret_cast<void*>(
             reinterpret_cast<uintptr_t>(SharedAddrCurrentLoc) + PAGESIZE
@@ -419,6 +746,21 @@ void* dsm_malloc(const char *name, int * num){
     if (page_required == 0) page_required = 1;  // At least one page
     
     int pagebasenumber = SAC_VPNumber;
+    set_region_blocks(pagebasenumber, block_pages);
+
+    // Map the file read-only once so the daemon serves first-touch pages
+    // straight from the page cache; without a mapping it falls back to pread
+    const char* file_map = nullptr;
+    if (filesize > 0) {
+        void* map = mmap(nullptr, filesize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "[dsm_malloc] Failed to map file: " << filepath
+                      << " - " << std::strerror(errno) << ", using pread" << std::endl;
+        } else {
+            madvise(map, filesize, MADV_SEQUENTIAL);
+            file_map = static_cast<const char*>(map);
+        }
+    }
     
     // Update page table entries for this file binding
     PageTable->GlobalMutexLock();
@@ -429,6 +771,11 @@ void* dsm_malloc(const char *name, int * num){
             record->fd = fd;
             record->offset = i;
             record->owner_id = -1;  
+            if (file_map != nullptr) {
+                size_t start = static_cast<size_t>(i) * PAGESIZE;
+                record->file_data = file_map + start;
+                record->file_len = std::min(static_cast<size_t>(PAGESIZE), filesize - start);
+            }
         } else {
             std::cout<<"error: no pagetable found!" << std::endl;
         }
@@ -447,3 +794,13 @@ void* dsm_malloc(const char *name, int * num){
     return result;
 }
 
+//同 dsm_malloc，额外指定该区域的一致性块大小（PAGESIZE 到 DSM_BLOCK_MAX 之间的 2 的幂）
+//缺页时整块调入、写缺页整块取得所有权，所有节点必须以相同参数按相同顺序调用
+//返回前所有节点经过一次 barrier：Pod 0 绑定完文件才发 JOIN_REQ，任何节点首次访问时都已能从文件取页
+void* dsm_malloc_block(const char *name, int * num, size_t block_size){
+    void* result = bind_region(name, num, block_size);
+    // Collective even on failure so a pod that could not bind never strands the others
+    dsm_barrier();
+    return result;
+}
+
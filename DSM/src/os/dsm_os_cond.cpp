@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
@@ -10,6 +13,7 @@
 #include <thread>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
 #include <vector>
@@ -20,6 +24,8 @@
 #include "os/lock_table.h"
 #include "os/page_table.h"
 #include "os/socket_table.h"
+#include "net/shm_transport.h"
+#include "net/udp_transport.h"
 #include "os/pfhandler.h"
 
 extern void dsm_start_daemon(int port);
@@ -38,6 +44,21 @@ extern int ProcNum;
 extern int WorkerNodeNum;
 extern std::vector<std::string> WorkerNodeIps;
 extern int* InvalidPages;
+extern int* BarrierPages;
+extern int* PageAccess;
+extern int* ProbOwner;
+extern int* BlockFirst;
+extern int MultiWriter;
+extern int PrefetchMax;
+extern int FaultThreads;
+extern int DaemonThreads;
+extern int LocalShm;
+extern int ControlUdp;
+extern int LockCache;
+extern int BarrierFanout;
+extern int PageCodec;
+extern char* TwinArea;
+extern char* HomeArea;
 
 extern int SAB_VPNumber ;           //共享区起始虚拟页号
 extern int SAC_VPNumber ;           //共享区下一次分配的空间的虚拟页号
@@ -47,39 +68,14 @@ extern int SAC_VPNumber ;           //共享区下一次分配的空间的虚拟
 // 外部引用来自 dsm_os.cpp 的函数
 extern std::string GetPodIp(int pod_id);
 extern int GetPodPort(int pod_id);
+extern bool PodSharesHost(int pod_id);
 
-// Helper function to get or create a socket connection to a remote pod
-// Returns existing socket if already connected, creates new connection otherwise
-int getsocket(const std::string& ip, int port) {
-    if (SocketTable == nullptr) {
-        std::cerr << "[getsocket] SocketTable not initialized" << std::endl;
-        return -1;
-    }
-
-    // Check if socket already exists for this target
-    int target_node = -1;
-    for (int i = 0; i < ProcNum; i++) {
-        if (GetPodIp(i) == ip && GetPodPort(i) == port) {
-            target_node = i;
-            break;
-        }
-    }
-
-    if (target_node >= 0) {
-        SocketTable->GlobalMutexLock();
-        SocketRecord* record = SocketTable->Find(target_node);
-        if (record != nullptr && record->socket >= 0) {
-            int existing_sock = record->socket;
-            SocketTable->GlobalMutexUnlock();
-            return existing_sock;
-        }
-        SocketTable->GlobalMutexUnlock();
-    }
-
-    // Create new socket connection
+// Open a fresh connection to a remote pod without caching it in SocketTable.
+// quiet: the caller retries, so a refused connection is not an error yet
+int connectsocket(const std::string& ip, int port, bool quiet) {
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
-        std::cerr << "[getsocket] Failed to create socket: " << std::strerror(errno) << std::endl;
+        std::cerr << "[connectsocket] Failed to create socket: " << std::strerror(errno) << std::endl;
         return -1;
     }
 
@@ -89,31 +85,165 @@ int getsocket(const std::string& ip, int port) {
     server_addr.sin_port = htons(port);
 
     if (inet_pton(AF_INET, ip.c_str(), &server_addr.sin_addr) <= 0) {
-        std::cerr << "[getsocket] Invalid address: " << ip << std::endl;
+        std::cerr << "[connectsocket] Invalid address: " << ip << std::endl;
         close(sockfd);
         return -1;
     }
 
     if (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        std::cerr << "[getsocket] Failed to connect to " << ip << ":" << port 
-                  << " - " << std::strerror(errno) << std::endl;
+        if (!quiet) {
+            std::cerr << "[connectsocket] Failed to connect to " << ip << ":" << port 
+                      << " - " << std::strerror(errno) << std::endl;
+        }
         close(sockfd);
         return -1;
     }
 
-    // Store socket in SocketTable if we identified the target node
-    if (target_node >= 0) {
-        SocketTable->GlobalMutexLock();
-        SocketRecord new_record;
-        new_record.socket = sockfd;
-        new_record.next_seq = 1;
-        SocketTable->Insert(target_node, new_record);
-        SocketTable->GlobalMutexUnlock();
-    }
+    // Every message is a single write, Nagle would only hold back pipelined requests
+    int nodelay = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
     return sockfd;
 }
 
+// Reach the daemon of a pod: its shared memory segment when it runs on this
+// machine, TCP otherwise. A daemon that is not listening yet is retried for
+// up to wait_ms.
+static std::unique_ptr<Transport> dial_pod(int node, int wait_ms) {
+    const bool shm = LocalShm && PodSharesHost(node);
+    const std::string ip = GetPodIp(node);
+    const int port = GetPodPort(node);
+    const std::string segment = ShmTransport::SegmentName(port, PodId);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+
+    while (true) {
+        std::unique_ptr<Transport> transport;
+        if (shm) {
+            transport = ShmTransport::Open(segment);
+            if (transport != nullptr) {
+                return transport;
+            }
+        }
+
+        const bool last_try = std::chrono::steady_clock::now() >= deadline;
+        int sockfd = connectsocket(ip, port, !last_try);
+        if (sockfd >= 0) {
+            // The daemon creates its segments before it listens, so one that
+            // was missing a moment ago may be there now
+            if (shm && (transport = ShmTransport::Open(segment)) != nullptr) {
+                close(sockfd);
+                return transport;
+            }
+            return std::make_unique<TcpTransport>(sockfd);
+        }
+        if (last_try) {
+            return nullptr;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+static RpcChannel* open_channel(int node, int wait_ms) {
+    // Held across connect so two threads do not open the same channel twice
+    std::lock_guard<std::mutex> guard(SocketTable->SlotMutex(node));
+    RpcChannel* channel = SocketTable->Find(node);
+    if (channel != nullptr) {
+        return channel;
+    }
+
+    std::unique_ptr<Transport> transport = dial_pod(node, wait_ms);
+    if (transport == nullptr) {
+        return nullptr;
+    }
+    std::cout << "[getchannel] Pod " << node << " reached via " << transport->Name() << std::endl;
+    return SocketTable->Install(node, std::make_unique<RpcChannel>(std::move(transport)));
+}
+
+// Lock, barrier and OWNER_UPDATE messages are a few dozen bytes; over TCP
+// they would wait behind whatever page data is queued on the connection.
+// With ControlUdp they get a datagram channel of their own to pods reached
+// over TCP; pods on shared memory keep using the ring.
+static RpcChannel* open_control(int node, RpcChannel* bulk) {
+    std::lock_guard<std::mutex> guard(SocketTable->SlotMutex(node));
+    RpcChannel* control = SocketTable->Find(node, SocketTable::CONTROL);
+    if (control != nullptr) {
+        return control;
+    }
+    if (!ControlUdp || dynamic_cast<const TcpTransport*>(&bulk->Link()) == nullptr) {
+        return SocketTable->Alias(node, SocketTable::CONTROL, bulk);
+    }
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(GetPodPort(node));
+    if (sockfd < 0 || inet_pton(AF_INET, GetPodIp(node).c_str(), &addr.sin_addr) <= 0 ||
+        connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "[getcontrol] No UDP channel to pod " << node << ", using " << bulk->Link().Name() << std::endl;
+        if (sockfd >= 0) {
+            close(sockfd);
+        }
+        return SocketTable->Alias(node, SocketTable::CONTROL, bulk);
+    }
+    std::unique_ptr<Transport> transport = std::make_unique<UdpTransport>(sockfd);
+    std::cout << "[getcontrol] Pod " << node << " control messages via " << transport->Name() << std::endl;
+    return SocketTable->Install(node, std::make_unique<RpcChannel>(std::move(transport)), SocketTable::CONTROL);
+}
+
+// The request channel to a pod. Every request to the pod goes through the
+// same connection; replies are matched by seq_num so callers on different
+// threads can wait at the same time. ConnectMesh has normally opened it
+// already, leaving a single atomic load here.
+RpcChannel* getchannel(int node) {
+    if (SocketTable == nullptr || node < 0 || node >= SocketTable->Size()) {
+        std::cerr << "[getchannel] No channel slot for pod " << node << std::endl;
+        return nullptr;
+    }
+    RpcChannel* channel = SocketTable->Find(node);
+    if (channel != nullptr) {
+        return channel;
+    }
+    return open_channel(node, 0);
+}
+
+// The channel for lock, barrier and OWNER_UPDATE messages to a pod; the same
+// as getchannel(node) unless ControlUdp gives them a datagram channel
+RpcChannel* getcontrol(int node) {
+    RpcChannel* control = SocketTable != nullptr ? SocketTable->Find(node, SocketTable::CONTROL) : nullptr;
+    if (control != nullptr) {
+        return control;
+    }
+    RpcChannel* bulk = getchannel(node);
+    if (bulk == nullptr) {
+        return nullptr;
+    }
+    return open_control(node, bulk);
+}
+
+// Open the channels to every pod (this one included) at the same time, so
+// neither the fault nor the lock path pays for a connection. Pods started
+// later are waited for; a pod that never shows up is left to getchannel.
+bool ConnectMesh() {
+    std::atomic<int> missing { 0 };
+    std::vector<std::thread> dialers;
+    for (int node = 0; node < ProcNum; node++) {
+        dialers.emplace_back([node, &missing] {
+            RpcChannel* bulk = open_channel(node, DSM_CONNECT_WAIT_MS);
+            if (bulk == nullptr) {
+                std::cerr << "[dsm] Pod " << node << " not reachable during dsm_init" << std::endl;
+                missing++;
+                return;
+            }
+            open_control(node, bulk);
+        });
+    }
+    for (std::thread& dialer : dialers) {
+        dialer.join();
+    }
+    return missing == 0;
+}
+
 template<typename T>
 bool GetEnvVar(const char* name, T& value, const T& default_val, bool required = true) {
     const char* env_val = std::getenv(name);
@@ -171,6 +301,16 @@ bool FetchGlobalData(int dsm_pagenum, std::string& LeaderNodeIp, int& LeaderNode
     if (!GetEnvVar("DSM_TOTAL_PROCESSES", ProcNum, 1, false)) exit(1);
     if (!GetEnvVar("DSM_POD_ID", PodId, -1, false)) exit(1);
     if (!GetEnvVar("DSM_WORKER_COUNT", WorkerNodeNum, 0, false)) exit(1);
+    if (!GetEnvVar("DSM_MULTI_WRITER", MultiWriter, 0, false)) exit(1);
+    if (!GetEnvVar("DSM_PREFETCH_MAX", PrefetchMax, 8, false)) exit(1);
+    if (!GetEnvVar("DSM_FAULT_THREADS", FaultThreads, 2, false)) exit(1);
+    if (!GetEnvVar("DSM_DAEMON_THREADS", DaemonThreads, 4, false)) exit(1);
+    if (!GetEnvVar("DSM_PAGE_CODEC", PageCodec, 0, false)) exit(1);
+    if (!GetEnvVar("DSM_DAEMON_URING", DaemonUring, 0, false)) exit(1);
+    if (!GetEnvVar("DSM_LOCAL_SHM", LocalShm, 1, false)) exit(1);
+    if (!GetEnvVar("DSM_CONTROL_UDP", ControlUdp, 0, false)) exit(1);
+    if (!GetEnvVar("DSM_LOCK_CACHE", LockCache, 1, false)) exit(1);
+    if (!GetEnvVar("DSM_BARRIER_FANOUT", BarrierFanout, 4, false)) exit(1);
     std::string worker_ips_str;
     if (!GetEnvVar("DSM_WORKER_IPS", worker_ips_str, std::string(""), false)) exit(1);
     WorkerNodeIps.clear();
@@ -214,7 +354,36 @@ bool InitDataStructs(int dsm_pagenum)
 
       InvalidPages = new int[SharedPages];
       std::memset(InvalidPages, 0, sizeof(int) * SharedPages);
-      install_handler(SharedAddrBase, SharedPages);
+      BarrierPages = new int[SharedPages];
+      std::memset(BarrierPages, 0, sizeof(int) * SharedPages);
+      PageAccess = new int[SharedPages];
+      std::memset(PageAccess, 0, sizeof(int) * SharedPages);   // PROT_NONE: nothing cached yet
+      ProbOwner = new int[SharedPages];
+      std::fill(ProbOwner, ProbOwner + SharedPages, -1);        // unknown: ask the manager
+      BlockFirst = new int[SharedPages];
+      for (size_t i = 0; i < SharedPages; i++) {
+         BlockFirst[i] = static_cast<int>(i);                   // one page per block until dsm_malloc_block
+      }
+
+      if (MultiWriter) {
+         // Twins and home copies are only touched for pages that are actually
+         // written or managed here, so reserve them lazily
+         TwinArea = static_cast<char*>(::mmap(nullptr, total_size, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+         HomeArea = static_cast<char*>(::mmap(nullptr, total_size, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+         if (TwinArea == MAP_FAILED || HomeArea == MAP_FAILED) {
+            std::cerr << "[dsm] failed to reserve twin/home areas: " << std::strerror(errno) << std::endl;
+            return false;
+         }
+      }
+      // Protection faults (upgrades, revoked access) are posted by the
+      // SIGSEGV handler to their own service threads; missing pages go to
+      // the userfaultfd service when the kernel allows it
+      install_handler(SharedAddrBase, SharedPages, FaultThreads > 0 ? FaultThreads : 1);
+      if (FaultThreads > 0 && !install_fault_service(SharedAddrBase, SharedPages, FaultThreads)) {
+         std::cerr << "[dsm] falling back to SIGSEGV page fetching" << std::endl;
+      }
    }else {
       std::cerr << "[dsm] invalid shared region parameters (base=" << SharedAddrBase 
                << ", pages=" << SharedPages << ")" << std::endl;
@@ -238,7 +407,7 @@ bool InitDataStructs(int dsm_pagenum)
    if (LockTable == nullptr)
       LockTable = new (::std::nothrow) class LockTable();
    if (SocketTable == nullptr)
-      SocketTable = new (::std::nothrow) class SocketTable();
+      SocketTable = new (::std::nothrow) class SocketTable(ProcNum);
    const bool ok = (PageTable != nullptr) && (LockTable != nullptr) && (SocketTable != nullptr);
    if (!ok){
       std::cerr << "[dsm] failed to allocate metadata tables" << std::endl;
@@ -0,0 +1,135 @@
+#include <cstring>
+#include <arpa/inet.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "os/page_diff.h"
+
+namespace {
+
+constexpr size_t kWord = 4;
+constexpr size_t kRunHeader = 2 * sizeof(uint16_t);
+
+// Bit i set when word i of the 16-byte block differs from the twin
+inline unsigned block_diff_mask(const uint8_t *page, const uint8_t *twin)
+{
+#if defined(__SSE2__)
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(page));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(twin));
+    unsigned equal = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))));
+    return ~equal & 0xFu;
+#else
+    unsigned mask = 0;
+    for (size_t w = 0; w < 4; w++) {
+        if (std::memcmp(page + w * kWord, twin + w * kWord, kWord) != 0)
+            mask |= 1u << w;
+    }
+    return mask;
+#endif
+}
+
+inline uint8_t *emit_run(uint8_t *out, const uint8_t *page, size_t start, size_t end)
+{
+    uint16_t offset = htons(static_cast<uint16_t>(start));
+    uint16_t length = htons(static_cast<uint16_t>(end - start));
+    std::memcpy(out, &offset, sizeof(offset));
+    std::memcpy(out + sizeof(offset), &length, sizeof(length));
+    std::memcpy(out + kRunHeader, page + start, end - start);
+    return out + kRunHeader + (end - start);
+}
+
+} // namespace
+
+size_t dsm_diff_encode(const void *page, const void *twin, size_t size, uint8_t *out)
+{
+    const uint8_t *cur = static_cast<const uint8_t *>(page);
+    const uint8_t *old = static_cast<const uint8_t *>(twin);
+    uint8_t *pos = out;
+    bool in_run = false;
+    size_t run_start = 0;
+
+    size_t off = 0;
+    for (; off + 16 <= size; off += 16) {
+        unsigned mask = block_diff_mask(cur + off, old + off);
+        // Fast path: nothing changed and no open run, or the whole block
+        // extends the current run
+        if ((mask == 0 && !in_run) || (mask == 0xFu && in_run))
+            continue;
+        for (size_t w = 0; w < 4; w++) {
+            bool differs = (mask >> w) & 1u;
+            if (differs && !in_run) {
+                run_start = off + w * kWord;
+                in_run = true;
+            } else if (!differs && in_run) {
+                pos = emit_run(pos, cur, run_start, off + w * kWord);
+                in_run = false;
+            }
+        }
+    }
+    // Tail shorter than one SIMD block
+    for (; off < size; off += kWord) {
+        bool differs = std::memcmp(cur + off, old + off, kWord) != 0;
+        if (differs && !in_run) {
+            run_start = off;
+            in_run = true;
+        } else if (!differs && in_run) {
+            pos = emit_run(pos, cur, run_start, off);
+            in_run = false;
+        }
+    }
+    if (in_run)
+        pos = emit_run(pos, cur, run_start, size);
+
+    return static_cast<size_t>(pos - out);
+}
+
+bool dsm_page_is_zero(const void *page, size_t size)
+{
+    const uint8_t *cur = static_cast<const uint8_t *>(page);
+    size_t off = 0;
+#if defined(__SSE2__)
+    // OR four blocks together so the branch runs once per 64 bytes
+    const __m128i zero = _mm_setzero_si128();
+    for (; off + 64 <= size; off += 64) {
+        __m128i acc = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + off)),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + off + 16))),
+            _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + off + 32)),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + off + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xFFFF)
+            return false;
+    }
+#endif
+    for (; off < size; off += kWord) {
+        uint32_t word;
+        std::memcpy(&word, cur + off, kWord);
+        if (word != 0)
+            return false;
+    }
+    return true;
+}
+
+bool dsm_diff_apply(void *page, size_t size, const uint8_t *diff, size_t diff_len)
+{
+    uint8_t *dst = static_cast<uint8_t *>(page);
+    size_t pos = 0;
+
+    while (pos < diff_len) {
+        if (diff_len - pos < kRunHeader)
+            return false;
+        uint16_t offset, length;
+        std::memcpy(&offset, diff + pos, sizeof(offset));
+        std::memcpy(&length, diff + pos + sizeof(offset), sizeof(length));
+        offset = ntohs(offset);
+        length = ntohs(length);
+        pos += kRunHeader;
+
+        if (static_cast<size_t>(offset) + length > size || diff_len - pos < length)
+            return false;
+        std::memcpy(dst + offset, diff + pos, length);
+        pos += length;
+    }
+    return true;
+}
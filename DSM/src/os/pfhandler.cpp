@@ -9,9 +9,25 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <fcntl.h>
+#include <ucontext.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
 #include "dsm.h"
 #include "net/protocol.h"
+#include "net/page_codec.h"
 #include "os/socket_table.h"
 #include "os/page_table.h"
 
@@ -21,26 +37,325 @@
 #define STATIC static
 #endif
 
+// UFFDIO_MOVE (Linux 6.8) is missing from older uapi headers
+#ifndef UFFD_FEATURE_MOVE
+#define UFFD_FEATURE_MOVE (1 << 16)
+#define _UFFDIO_MOVE (0x05)
+#define UFFDIO_MOVE_MODE_DONTWAKE ((__u64)1 << 0)
+struct uffdio_move {
+    __u64 dst;
+    __u64 src;
+    __u64 len;
+    __u64 mode;
+    __s64 move;
+};
+#define UFFDIO_MOVE _IOWR(UFFDIO, _UFFDIO_MOVE, struct uffdio_move)
+#endif
+
 // Forward declarations
 extern int* InvalidPages;
-extern int getsocket(const std::string& ip, int port);
+extern int* BarrierPages;
+extern int* PageAccess;
+extern int* ProbOwner;
+extern int* BlockFirst;
+extern int PageCodec;
+extern char* TwinArea;
+extern RpcChannel* getchannel(int node);
+extern RpcChannel* getcontrol(int node);
 extern int SAB_VPNumber;  // Base virtual page number of shared region
 
 STATIC size_t g_region_pages;   // number of pages in the managed region
 STATIC size_t g_page_sz;        // system page size
 STATIC void* g_region;          // start address of the managed memory region
 STATIC struct sigaction g_prev_sa;  // previous SIGSEGV handler
+STATIC int g_uffd = -1;             // userfaultfd serving missing pages, -1 when faults go through SIGSEGV
+STATIC bool g_uffd_move = false;    // g_uffd can move received pages into place instead of copying them
+STATIC std::mutex g_prefetch_mutex; // stream detector state shared by the fault service threads
+STATIC std::mutex g_inflight_mutex;          // guards g_inflight
+STATIC std::condition_variable g_inflight_cond; // signalled when a fetch leaves g_inflight
+STATIC std::set<int> g_inflight;             // VPNs a fault service thread is fetching right now
+
+// Protection faults are served off the signal handler. The faulting thread
+// claims a slot, posts the page in it, wakes a protection service thread
+// and sleeps on the slot's futex until the page has its final protection.
+// Only atomics and futex calls run in signal context.
+#define FAULT_SLOTS 64
+enum : uint32_t { SLOT_FREE, SLOT_CLAIMED, SLOT_POSTED, SLOT_TAKEN, SLOT_DONE };
+struct FaultSlot {
+    std::atomic<uint32_t> state{SLOT_FREE};
+    int VPN = 0;
+    bool is_write = false;
+};
+STATIC FaultSlot g_fault_slots[FAULT_SLOTS];
+STATIC std::atomic<uint32_t> g_fault_posts{0};  // bumped per posted fault, idle service threads sleep on it
+
+// Ownership updates on their way to the managers. The fault path only queues
+// them; one flusher thread sends everything queued so far, one OWNER_UPDATE
+// per manager, and what queues up meanwhile goes in the next round. Never
+// destroyed: the flusher still waits on it when the process exits.
+struct OwnerUpdateQueue {
+    std::mutex mutex;
+    std::condition_variable work;       // updates queued
+    std::condition_variable flushed;    // a round was acknowledged
+    std::map<int, std::vector<payload_owner_update_t>> pending;   // manager -> updates
+    uint64_t queued = 0;                // updates queued so far
+    uint64_t done = 0;                  // of those, acknowledged (or given up on)
+};
+STATIC OwnerUpdateQueue* g_owner_updates = new OwnerUpdateQueue;
+STATIC std::once_flag g_owner_flusher_once;
+
+// The handler only posts the fault and sleeps; the rest leaves room for
+// a chained handler
+#define SIGNAL_STACK_SIZE (16 * 1024)
+
+// Kernels before 5.11 do not know the flag and reject it with EINVAL
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+// Fault stream detector for the read prefetcher. Only the service threads
+// touch it, under g_prefetch_mutex.
+#define PREFETCH_MIN_WINDOW 2
+#define PREFETCH_MAX_STRIDE 64
+STATIC int g_last_vpn = -1;     // last page fetched by a read fault (demand or prefetch)
+STATIC int g_stride = 0;        // candidate stride in pages, 0 when there is no stream
+STATIC int g_window = 0;        // pages currently fetched ahead of the stream
 
 // Forward declaration
-STATIC void pull_remote_page(int VPN);
+STATIC void pull_remote_page(int VPN, bool is_write);
+void pull_remote_pages(const std::vector<int>& VPNs, bool is_write);
+void invalidate_local_page(int VPN);
+
+// Where to send the first request for a page: the last node known to hold
+// it, or its manager when nothing better is known. A stale hint costs one
+// redirect, never wrong data (see serve_page).
+STATIC int probable_owner(int VPN)
+{
+    int hint = ProbOwner[VPN - SAB_VPNumber];
+    if (MultiWriter || hint < 0 || hint >= ProcNum || hint == PodId) {
+        return VPN % ProcNum;
+    }
+    return hint;
+}
+
+// Read a payload_page_packed_t prefix and its data, and decode into page_buffer
+STATIC bool read_packed_page(RpcMessage& reply, char* page_buffer)
+{
+    payload_page_packed_t prefix;
+    if (!reply.Read(&prefix, sizeof(prefix))) {
+        return false;
+    }
+    // Decode straight out of the reply buffer
+    size_t packed_len = ntohs(prefix.packed_len);
+    if (packed_len > reply.payload.size() - reply.pos) {
+        return false;
+    }
+    const uint8_t* packed = reinterpret_cast<const uint8_t*>(reply.payload.data() + reply.pos);
+    reply.pos += packed_len;
+    return dsm_codec_decompress(prefix.codec, packed, packed_len, page_buffer, DSM_PAGE_SIZE);
+}
+
+// All threads share one channel per node, fault service threads included;
+// their requests are in flight together and matched to replies by seq_num
+STATIC RpcChannel* page_channel(int node)
+{
+    return getchannel(node);
+}
+
+// A read fault that needed a remote fetch. Once two consecutive faults agree
+// on a stride, the following pages of the stream are appended to pages and
+// fetched as read-only replicas together with the faulting one; each further
+// fault just past the prefetched range doubles the window up to PrefetchMax.
+STATIC void prefetch_stream(int VPN, std::vector<int>& pages)
+{
+    int delta = VPN - g_last_vpn;
+    if (g_stride != 0 && delta == g_stride) {
+        g_window = (g_window == 0) ? PREFETCH_MIN_WINDOW : g_window * 2;
+        if (g_window > PrefetchMax) {
+            g_window = PrefetchMax;
+        }
+    } else {
+        bool plausible = delta != 0 && delta >= -PREFETCH_MAX_STRIDE && delta <= PREFETCH_MAX_STRIDE;
+        g_stride = (g_last_vpn >= 0 && plausible) ? delta : 0;
+        g_window = 0;
+    }
+    g_last_vpn = VPN;
+
+    for (int k = 1; k <= g_window; k++) {
+        int next = VPN + k * g_stride;
+        int idx = next - SAB_VPNumber;
+        if (idx < 0 || idx >= static_cast<int>(g_region_pages)) {
+            break;
+        }
+        // Pages we already hold still count as covered by the stream
+        if (PageAccess[idx] == PROT_NONE) {
+            pages.push_back(next);
+        }
+        g_last_vpn = next;
+    }
+}
+
+// Append the other pages of VPN's coherence block that the access still
+// needs: missing ones for a read, every page not yet writable for a write.
+// Regions allocated with dsm_malloc_block fault in whole blocks.
+STATIC void block_pages(int VPN, bool is_write, std::vector<int>& pages)
+{
+    int idx = VPN - SAB_VPNumber;
+    int first = BlockFirst[idx];
+    for (int i = first; i < static_cast<int>(g_region_pages) && BlockFirst[i] == first; i++) {
+        bool needed = is_write ? !(PageAccess[i] & PROT_WRITE) : (PageAccess[i] == PROT_NONE);
+        if (i != idx && needed) {
+            pages.push_back(SAB_VPNumber + i);
+        }
+    }
+}
+
+// Whether the faulting access was a store. The page-fault error code only
+// reaches user space through the x86-64 ucontext; elsewhere every fault is
+// treated as a write, which is what the protocol did before read sharing.
+STATIC bool fault_is_write(void* uctx)
+{
+#if defined(__x86_64__)
+    const ucontext_t* uc = static_cast<const ucontext_t*>(uctx);
+    return (uc->uc_mcontext.gregs[REG_ERR] & 0x2) != 0;
+#else
+    (void)uctx;
+    return true;
+#endif
+}
+
+STATIC void futex_wait(std::atomic<uint32_t>* word, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+STATIC void futex_wake(std::atomic<uint32_t>* word, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+// Serialize the service threads working on one page; the second one in
+// finds the page already fetched and only fixes its protection
+STATIC void claim_page(int VPN)
+{
+    std::unique_lock<std::mutex> lock(g_inflight_mutex);
+    g_inflight_cond.wait(lock, [&] { return g_inflight.count(VPN) == 0; });
+    g_inflight.insert(VPN);
+}
+
+STATIC void release_page(int VPN)
+{
+    {
+        std::lock_guard<std::mutex> guard(g_inflight_mutex);
+        g_inflight.erase(VPN);
+    }
+    g_inflight_cond.notify_all();
+}
+
+// A protection fault posted by segv_handler, served on a protection
+// service thread while the faulting thread sleeps
+STATIC void serve_protection_fault(int VPN, bool is_write)
+{
+    uintptr_t page_base = static_cast<uintptr_t>(VPN) << 12;
+    int idx = VPN - SAB_VPNumber;
+
+    // With the fault service running, a page without access only needs its
+    // stale data dropped; the retried access becomes a missing fault
+    if (g_uffd >= 0 && PageAccess[idx] == PROT_NONE) {
+        invalidate_local_page(VPN);
+        return;
+    }
+    
+    if (is_write) {
+        // Only an exclusive copy may be written; a read-only replica has to
+        // take ownership first so the manager invalidates the other readers
+        if (PageAccess[idx] & PROT_WRITE) {
+            mprotect((void*)page_base, g_page_sz, PROT_READ | PROT_WRITE);
+        } else if (MultiWriter) {
+            // Multiple writers: keep a twin of the clean copy and write locally;
+            // the changes travel to the home as a diff at the next release
+            if (PageAccess[idx] == PROT_NONE) {
+                pull_remote_page(VPN, false);
+            }
+            mprotect((void*)page_base, g_page_sz, PROT_READ);
+            std::memcpy(TwinArea + static_cast<size_t>(idx) * g_page_sz, (void*)page_base, g_page_sz);
+            PageAccess[idx] = PROT_READ | PROT_WRITE;
+            mprotect((void*)page_base, g_page_sz, PROT_READ | PROT_WRITE);
+        } else {
+            std::vector<int> pages(1, VPN);
+            block_pages(VPN, true, pages);
+            if (pages.size() == 1) {
+                pull_remote_page(VPN, true);
+            } else {
+                // The whole block changes hands, all of it is reported at release
+                for (int page : pages) {
+                    InvalidPages[page - SAB_VPNumber] = 1;
+                    BarrierPages[page - SAB_VPNumber] = 1;
+                }
+                pull_remote_pages(pages, true);
+            }
+        }
+        // Mark the page as modified (invalid for other nodes)
+        InvalidPages[idx] = 1;
+        BarrierPages[idx] = 1;
+    } else {
+        if (PageAccess[idx] == PROT_NONE) {
+            // The faulting page and the pages predicted after it travel in
+            // one batch per node
+            std::vector<int> pages(1, VPN);
+            block_pages(VPN, false, pages);
+            if (PrefetchMax > 0) {
+                std::lock_guard<std::mutex> guard(g_prefetch_mutex);
+                prefetch_stream(VPN, pages);
+            }
+            if (pages.size() == 1) {
+                pull_remote_page(VPN, false);
+            } else {
+                pull_remote_pages(pages, false);
+            }
+        } else {
+            // Copy is still valid (e.g. revoked by a barrier). Keep clean pages
+            // read-only so the next store is recorded in InvalidPages.
+            int prot = (InvalidPages[idx] == 1) ? PageAccess[idx] : PROT_READ;
+            mprotect((void*)page_base, g_page_sz, prot);
+        }
+    }
+}
+
+STATIC FaultSlot* take_posted_fault()
+{
+    for (FaultSlot& slot : g_fault_slots) {
+        uint32_t posted = SLOT_POSTED;
+        if (slot.state.compare_exchange_strong(posted, SLOT_TAKEN, std::memory_order_acquire)) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+STATIC void protection_service_loop()
+{
+    while (true) {
+        uint32_t posts = g_fault_posts.load(std::memory_order_acquire);
+        FaultSlot* slot = take_posted_fault();
+        if (slot == nullptr) {
+            // A fault posted after the scan changed posts and ends the wait at once
+            futex_wait(&g_fault_posts, posts);
+            continue;
+        }
+        claim_page(slot->VPN);
+        serve_protection_fault(slot->VPN, slot->is_write);
+        release_page(slot->VPN);
+        slot->state.store(SLOT_DONE, std::memory_order_release);
+        futex_wake(&slot->state, 1);
+    }
+}
 
 STATIC void segv_handler(int signo, siginfo_t* info, void* uctx)
 {
     (void)signo;
-    (void)uctx;
     
     // Get the faulting address
-    std::cout << "[System information] Page Fault Happened!" << std::endl;
     uintptr_t fault_addr = (uintptr_t)info->si_addr;
     uintptr_t region_start = (uintptr_t)g_region;
     uintptr_t region_end = region_start + (g_region_pages * g_page_sz);
@@ -60,22 +375,57 @@ STATIC void segv_handler(int signo, siginfo_t* info, void* uctx)
         return;
     }
     
-    // Calculate page base address and page index
     int VPN = fault_addr >> 12;
-    uintptr_t page_base = static_cast<uintptr_t>(VPN) << 12;
-    
-    // Check if this page needs to be pulled from remote
-    if (InvalidPages != nullptr && InvalidPages[VPN - SAB_VPNumber] == 0) {
-        pull_remote_page(VPN);
-    } else {
-        mprotect((void*)page_base, g_page_sz, PROT_READ | PROT_WRITE);
+    bool is_write = fault_is_write(uctx);
+    int saved_errno = errno;
+
+    // Post the fault; more threads faulting at once than slots just retry
+    FaultSlot* slot = nullptr;
+    while (slot == nullptr) {
+        for (FaultSlot& candidate : g_fault_slots) {
+            uint32_t free_state = SLOT_FREE;
+            if (candidate.state.compare_exchange_strong(free_state, SLOT_CLAIMED, std::memory_order_acquire)) {
+                slot = &candidate;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            sched_yield();
+        }
     }
-    
-    // Mark the page as modified (invalid for other nodes)
-    InvalidPages[VPN - SAB_VPNumber] = 1;
+    slot->VPN = VPN;
+    slot->is_write = is_write;
+    slot->state.store(SLOT_POSTED, std::memory_order_release);
+    g_fault_posts.fetch_add(1, std::memory_order_release);
+    futex_wake(&g_fault_posts, 1);
+
+    // The access is retried on return, against the protection just set
+    uint32_t state;
+    while ((state = slot->state.load(std::memory_order_acquire)) != SLOT_DONE) {
+        futex_wait(&slot->state, state);
+    }
+    slot->state.store(SLOT_FREE, std::memory_order_release);
+    errno = saved_errno;
 }
 
-void install_handler(void* base_addr, size_t num_pages)
+void invalidate_local_page(int VPN)
+{
+    int idx = VPN - SAB_VPNumber;
+    if (PageAccess == nullptr || idx < 0 || idx >= static_cast<int>(SharedPages)) {
+        return;
+    }
+    PageAccess[idx] = PROT_NONE;
+    void* page_addr = reinterpret_cast<void*>(static_cast<uintptr_t>(VPN) << 12);
+    if (g_uffd >= 0) {
+        // Drop the data so the next access is a missing fault for the service
+        madvise(page_addr, PAGESIZE, MADV_DONTNEED);
+        mprotect(page_addr, PAGESIZE, PROT_READ | PROT_WRITE);
+        return;
+    }
+    mprotect(page_addr, PAGESIZE, PROT_NONE);
+}
+
+void install_handler(void* base_addr, size_t num_pages, int num_threads)
 {   
     //std::cout << "install handler set!" <<std::endl;
     g_page_sz =  PAGESIZE; // get system page size
@@ -88,8 +438,8 @@ void install_handler(void* base_addr, size_t num_pages)
     g_region = base_addr;
 
     stack_t alt{};
-    alt.ss_sp = std::malloc(SIGSTKSZ);
-    alt.ss_size = SIGSTKSZ;
+    alt.ss_sp = std::malloc(SIGNAL_STACK_SIZE);
+    alt.ss_size = SIGNAL_STACK_SIZE;
     sigaltstack(&alt, nullptr);
 
     struct sigaction sa{};
@@ -100,47 +450,292 @@ void install_handler(void* base_addr, size_t num_pages)
         perror("sigaction");
         std::exit(1);
     }
+
+    for (int i = 0; i < num_threads; i++) {
+        std::thread(protection_service_loop).detach();
+    }
 }
 
-void pull_remote_page(int VPN){
-    // Calculate probable owner using hash (VPN % ProcNum)
-    // This is the manager for this page - we need to update this node after getting the page
+// Map a fresh zero page: the kernel's zero page through userfaultfd, or a
+// dropped private anonymous page, which reads back as zeros
+STATIC void install_zero_page(int VPN, int granted)
+{
+    void* page_addr = reinterpret_cast<void*>(static_cast<uintptr_t>(VPN) << 12);
+
+    if (g_uffd >= 0) {
+        struct uffdio_zeropage zero{};
+        zero.range.start = reinterpret_cast<uintptr_t>(page_addr);
+        zero.range.len = g_page_sz;
+        zero.mode = UFFDIO_ZEROPAGE_MODE_DONTWAKE;
+        if (ioctl(g_uffd, UFFDIO_ZEROPAGE, &zero) == 0) {
+            mprotect(page_addr, g_page_sz, granted);
+            PageAccess[VPN - SAB_VPNumber] = granted;
+            return;
+        }
+        // EEXIST: a resident copy being upgraded, clear it in place
+        if (errno != EEXIST) {
+            std::cerr << "[pull_remote_page] UFFDIO_ZEROPAGE failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        mprotect(page_addr, g_page_sz, PROT_READ | PROT_WRITE);
+        std::memset(page_addr, 0, g_page_sz);
+    } else {
+        madvise(page_addr, g_page_sz, MADV_DONTNEED);
+    }
+    mprotect(page_addr, g_page_sz, granted);
+    PageAccess[VPN - SAB_VPNumber] = granted;
+}
+
+// Copy fetched page data into the shared region with the granted access.
+// page_data == nullptr installs an all-zero page without copying. A staged
+// page (RpcMessage::TakePage) is page-aligned and ours to give away: a
+// missing page takes it over with UFFDIO_MOVE, so its bytes are not copied
+// again; resident copies being upgraded and the SIGSEGV path still copy.
+STATIC void install_page(int VPN, bool is_write, const char* page_data, bool staged)
+{
+    uintptr_t page_base = static_cast<uintptr_t>(VPN) << 12;
+    int granted = is_write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+
+    if (page_data == nullptr) {
+        install_zero_page(VPN, granted);
+        return;
+    }
+
+    // Missing pages are filled atomically; the faulting thread stays asleep
+    // until the fault service wakes it, after the protection is final
+    if (g_uffd >= 0) {
+        int rc = -1;
+        errno = 0;
+        // Only a dropped page sits in a read-write mapping the move accepts;
+        // a resident read-only copy being upgraded is overwritten below
+        if (staged && g_uffd_move && PageAccess[VPN - SAB_VPNumber] == PROT_NONE) {
+            struct uffdio_move move{};
+            move.dst = page_base;
+            move.src = reinterpret_cast<uintptr_t>(page_data);
+            move.len = g_page_sz;
+            move.mode = UFFDIO_MOVE_MODE_DONTWAKE;
+            rc = ioctl(g_uffd, UFFDIO_MOVE, &move);
+        }
+        // A source page the kernel will not move (split or pinned) is copied
+        if (rc != 0 && errno != EEXIST) {
+            struct uffdio_copy copy{};
+            copy.dst = page_base;
+            copy.src = reinterpret_cast<uintptr_t>(page_data);
+            copy.len = g_page_sz;
+            copy.mode = UFFDIO_COPY_MODE_DONTWAKE;
+            rc = ioctl(g_uffd, UFFDIO_COPY, &copy);
+        }
+        if (rc == 0) {
+            if (!is_write) {
+                mprotect((void*)page_base, g_page_sz, PROT_READ);
+            }
+            PageAccess[VPN - SAB_VPNumber] = granted;
+            return;
+        }
+        // EEXIST: a resident read-only copy being upgraded, overwrite it below
+        if (errno != EEXIST) {
+            std::cerr << "[pull_remote_page] UFFDIO_COPY failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+    }
+
+    // Make the page writable before copying data
+    if (mprotect((void*)page_base, g_page_sz, PROT_READ | PROT_WRITE) != 0) {
+        std::cerr << "[pull_remote_page] mprotect failed" << std::endl;
+        return;
+    }
+    
+    // Copy page data to memory (equivalent to DMA)
+    std::memcpy((void*)page_base, page_data, DSM_PAGE_SIZE);
+
+    // A read fault installs a read-only replica and leaves ownership alone
+    if (!is_write) {
+        mprotect((void*)page_base, g_page_sz, PROT_READ);
+    }
+    PageAccess[VPN - SAB_VPNumber] = granted;
+}
+
+// A replica the manager did not add to the copyset may miss a writer's
+// invalidation, so it goes. By the time the verdict arrives the page may
+// have been upgraded to an owned copy, which stays.
+STATIC void drop_rejected_replica(int VPN)
+{
+    int idx = VPN - SAB_VPNumber;
+    PageTable->GlobalMutexLock();
+    PageRecord* page_rec = PageTable->Find(VPN);
+    bool owned = page_rec != nullptr && page_rec->owner_id == PodId;
+    PageTable->GlobalMutexUnlock();
+    if (!owned && PageAccess[idx] == PROT_READ) {
+        invalidate_local_page(VPN);
+        std::cout << "[System information] Replica of page " << VPN << " rejected by manager, dropped" << std::endl;
+    }
+}
+
+// Send one round of updates, at most DSM_OWNER_UPDATE_BATCH_MAX per message,
+// and act on the verdicts once every reply is in
+STATIC void send_owner_updates(const std::map<int, std::vector<payload_owner_update_t>>& rounds)
+{
+    std::vector<std::tuple<RpcChannel*, uint32_t, const payload_owner_update_t*, size_t>> sent;
+    for (auto& target : rounds) {
+        int manager_id = target.first;
+        RpcChannel* manager = getcontrol(manager_id);
+        if (manager == nullptr) {
+            std::cerr << "[owner_update] Failed to connect to manager " << manager_id << std::endl;
+            continue;
+        }
+        const std::vector<payload_owner_update_t>& updates = target.second;
+        for (size_t first = 0; first < updates.size(); first += DSM_OWNER_UPDATE_BATCH_MAX) {
+            size_t count = std::min(updates.size() - first, static_cast<size_t>(DSM_OWNER_UPDATE_BATCH_MAX));
+            dsm_header_t header = {
+                DSM_MSG_OWNER_UPDATE,
+                0,                              // unused
+                htons(static_cast<uint16_t>(PodId)),  // src_node_id
+                0,                              // seq_num: assigned by the channel
+                htonl(static_cast<uint32_t>(sizeof(payload_owner_update_batch_t) + count * sizeof(payload_owner_update_t)))
+            };
+            payload_owner_update_batch_t batch = {
+                htonl(static_cast<uint32_t>(count))
+            };
+            uint32_t seq = manager->Send(header, {
+                { &batch, sizeof(batch) },
+                { updates.data() + first, count * sizeof(payload_owner_update_t) }
+            });
+            if (seq == 0) {
+                std::cerr << "[owner_update] Failed to send OWNER_UPDATE to manager " << manager_id << std::endl;
+                break;
+            }
+            sent.emplace_back(manager, seq, updates.data() + first, count);
+        }
+    }
+
+    for (auto& request : sent) {
+        RpcMessage ack;
+        size_t count = std::get<3>(request);
+        std::vector<uint8_t> accepted(count);
+        if (!std::get<0>(request)->Wait(std::get<1>(request), ack) || ack.header.type != DSM_MSG_ACK
+            || !ack.Read(accepted.data(), count)) {
+            std::cerr << "[owner_update] No ACK for OWNER_UPDATE" << std::endl;
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!accepted[i]) {
+                drop_rejected_replica(static_cast<int>(ntohl(std::get<2>(request)[i].resource_id)));
+            }
+        }
+    }
+}
+
+STATIC void owner_update_flusher()
+{
+    OwnerUpdateQueue* queue = g_owner_updates;
+    while (true) {
+        std::map<int, std::vector<payload_owner_update_t>> rounds;
+        uint64_t round_end;
+        {
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->work.wait(lock, [queue] { return !queue->pending.empty(); });
+            rounds.swap(queue->pending);
+            round_end = queue->queued;
+        }
+        send_owner_updates(rounds);
+        {
+            std::lock_guard<std::mutex> guard(queue->mutex);
+            queue->done = round_end;
+        }
+        queue->flushed.notify_all();
+    }
+}
+
+STATIC void queue_owner_update(int manager_id, const payload_owner_update_t& update)
+{
+    std::call_once(g_owner_flusher_once, [] { std::thread(owner_update_flusher).detach(); });
+    OwnerUpdateQueue* queue = g_owner_updates;
+    {
+        std::lock_guard<std::mutex> guard(queue->mutex);
+        queue->pending[manager_id].push_back(update);
+        queue->queued++;
+    }
+    queue->work.notify_one();
+}
+
+void flush_owner_updates()
+{
+    OwnerUpdateQueue* queue = g_owner_updates;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    uint64_t target = queue->queued;
+    queue->flushed.wait(lock, [queue, target] { return queue->done >= target; });
+}
+
+// Tell the page's manager about the copy we just installed: a writer becomes
+// the owner at the transfer count version, a reader joins the copyset of
+// copy_source
+STATIC void announce_page(int VPN, bool is_write, uint16_t copy_source, uint32_t version)
+{
     int manager_id = VPN % ProcNum;
-    int probowner = manager_id;
+
+    // Multiple-writer pages always come from their home and are never
+    // owned, so there is no directory entry to update
+    if (MultiWriter) {
+        std::cout << "[System information] Page " << VPN << " loaded from home" << std::endl;
+        return;
+    }
+
+    // Update local PageTable: set this node as the owner of the page
+    if (is_write && PageTable != nullptr) {
+        PageTable->GlobalMutexLock();
+        PageRecord* page_rec = PageTable->Find(VPN);
+        if (page_rec != nullptr) {
+            page_rec->owner_id = PodId;  // Set ourselves as the new owner
+            page_rec->version = version;
+        } else {
+            // If record doesn't exist, create it
+            PageRecord new_record;
+            new_record.owner_id = PodId;
+            new_record.version = version;
+            PageTable->Insert(VPN, new_record);
+        }
+        PageTable->GlobalMutexUnlock();
+    }
     
-    // Calculate page base address
-    uintptr_t page_base = static_cast<uintptr_t>(VPN) << 12;
+    // Queue OWNER_UPDATE for the manager (the original probable owner, not
+    // the redirected one): a writer announces itself as the new owner, a
+    // reader asks to join the copyset of the node it copied from. The
+    // faulting access resumes without waiting for the manager.
+    payload_owner_update_t update = {
+        htonl(static_cast<uint32_t>(VPN)),    // resource_id (page number)
+        htons(static_cast<uint16_t>(is_write ? PodId : copy_source)),  // new owner / copy source
+        static_cast<uint8_t>(is_write ? DSM_OWNER_UPDATE_WRITER : DSM_OWNER_UPDATE_READER),
+        htonl(version)                        // transfer count, orders updates from different writers
+    };
+    queue_owner_update(manager_id, update);
+    
+    std::cout << "[System information] Page " << VPN << " loaded successfully"
+              << (is_write ? ", ownership update queued" : " as read-only replica") << std::endl;
+}
+
+void pull_remote_page(int VPN, bool is_write){
+    // Start from the probable owner; the manager (VPN % ProcNum) is the
+    // fallback and always gets the OWNER_UPDATE afterwards
+    int probowner = probable_owner(VPN);
+    uint8_t access = is_write ? DSM_PAGE_ACCESS_WRITE : DSM_PAGE_ACCESS_READ;
     
     // Retry loop for following redirects to real owner
     while (true) {
-        // Get socket to probable owner
-        std::string target_ip = GetPodIp(probowner);
-        int target_port = GetPodPort(probowner);
-        int sock = getsocket(target_ip, target_port);
+        // Get the channel to the probable owner
+        RpcChannel* channel = page_channel(probowner);
         
-        if (sock < 0) {
+        if (channel == nullptr) {
             std::cerr << "[pull_remote_page] Failed to connect to node " << probowner 
-                      << " at " << target_ip << ":" << target_port << std::endl;
+                      << " at " << GetPodIp(probowner) << ":" << GetPodPort(probowner) << std::endl;
             return;
         }
         
-        // Get sequence number for this connection
-        uint32_t seq_num = 1;
-        if (SocketTable != nullptr) {
-            SocketTable->GlobalMutexLock();
-            SocketRecord* record = SocketTable->Find(probowner);
-            if (record != nullptr) {
-                seq_num = record->allocate_seq();
-            }
-            SocketTable->GlobalMutexUnlock();
-        }
-        
         // Build and send PAGE_REQ message
         dsm_header_t req_header = {
             DSM_MSG_PAGE_REQ,
-            0,                              // unused
+            DSM_PAGE_REQ_FLAGS(access, PageCodec),
             htons(static_cast<uint16_t>(PodId)),  // src_node_id
-            htonl(seq_num),                 // seq_num
+            0,                              // seq_num: assigned by the channel
             htonl(sizeof(payload_page_req_t))  // payload_len
         };
         
@@ -148,29 +743,13 @@ void pull_remote_page(int VPN){
             htonl(static_cast<uint32_t>(VPN))  // page_index
         };
         
-        // Send header and payload
-        if (::send(sock, &req_header, sizeof(req_header), 0) != sizeof(req_header)) {
-            std::cerr << "[pull_remote_page] Failed to send PAGE_REQ header" << std::endl;
-            return;
-        }
-        
-        if (::send(sock, &req_payload, sizeof(req_payload), 0) != sizeof(req_payload)) {
-            std::cerr << "[pull_remote_page] Failed to send PAGE_REQ payload" << std::endl;
-            return;
-        }
-        
-        std::cout << "[System information] Succeed in sending PAGE_REQ for VPN=" << VPN 
-                  << " to node " << probowner << std::endl;
-        
-        // Receive response
-        rio_t rio;
-        rio_readinit(&rio, sock);
-        
-        dsm_header_t rep_header;
-        if (rio_readn(&rio, &rep_header, sizeof(rep_header)) != sizeof(rep_header)) {
-            std::cerr << "[pull_remote_page] Failed to receive PAGE_REP header" << std::endl;
+        // Send the request and wait for its reply
+        RpcMessage rep;
+        if (!channel->Call(req_header, { { &req_payload, sizeof(req_payload) } }, rep)) {
+            std::cerr << "[pull_remote_page] Failed to receive PAGE_REP for VPN=" << VPN << std::endl;
             return;
         }
+        dsm_header_t& rep_header = rep.header;
         
         // Check response type
         if (rep_header.type != DSM_MSG_PAGE_REP) {
@@ -178,118 +757,329 @@ void pull_remote_page(int VPN){
             return;
         }
         
-        // Read real_owner_id first
+        // Read real_owner_id and the transfer count first
         uint16_t real_owner_id;
-        if (rio_readn(&rio, &real_owner_id, sizeof(real_owner_id)) != sizeof(real_owner_id)) {
+        uint32_t version;
+        if (!rep.Read(&real_owner_id, sizeof(real_owner_id)) || !rep.Read(&version, sizeof(version))) {
             std::cerr << "[pull_remote_page] Failed to read real_owner_id" << std::endl;
             return;
         }
         real_owner_id = ntohs(real_owner_id);
+        version = ntohl(version);
         
         // Check unused flag to determine if this is a redirect or data response
-        if (rep_header.unused == 0) {
+        if (rep_header.unused == DSM_PAGE_REP_REDIRECT) {
             // Redirect to real owner - continue the loop
             std::cout << "[System information] Redirecting to real owner: node " << real_owner_id << std::endl;
             probowner = real_owner_id;
+            access = DSM_PAGE_REQ_ACCESS(access);
+            ProbOwner[VPN - SAB_VPNumber] = real_owner_id;
+            continue;
+        }
+        if (rep_header.unused == DSM_PAGE_REP_INITIAL) {
+            // Untouched page: the manager sends us to Pod 0 for the file contents
+            probowner = real_owner_id;
+            access |= DSM_PAGE_REQ_INITIAL;
             continue;
         }
         
-        // unused == 1: We received page data - break out of the loop
-        // Read page data
+        // We received page data (or learned it is all zeros) - break out of the loop.
+        // Raw pages are installed straight from the staging page the channel read them into.
         char page_buffer[DSM_PAGE_SIZE];
-        if (rio_readn(&rio, page_buffer, DSM_PAGE_SIZE) != DSM_PAGE_SIZE) {
+        const char* page_data = nullptr;
+        if (rep_header.unused == DSM_PAGE_REP_PACKED) {
+            if (!read_packed_page(rep, page_buffer)) {
+                std::cerr << "[pull_remote_page] Failed to read packed page data" << std::endl;
+                return;
+            }
+            page_data = page_buffer;
+        } else if (rep_header.unused != DSM_PAGE_REP_ZERO
+                   && (page_data = rep.TakePage()) == nullptr) {
             std::cerr << "[pull_remote_page] Failed to read page data" << std::endl;
             return;
         }
         
-        // Make the page writable before copying data
-        if (mprotect((void*)page_base, g_page_sz, PROT_READ | PROT_WRITE) != 0) {
-            std::cerr << "[pull_remote_page] mprotect failed" << std::endl;
-            return;
+        install_page(VPN, is_write, page_data, page_data != page_buffer);
+        ProbOwner[VPN - SAB_VPNumber] = is_write ? PodId : real_owner_id;
+        announce_page(VPN, is_write, real_owner_id, version);
+        return;
+    }
+}
+
+void pull_remote_pages(const std::vector<int>& VPNs, bool is_write)
+{
+    // Ask each page's probable owner first; redirected pages are regrouped
+    // by the node they point at and asked again in the next round. Untouched
+    // pages the managers sent on to Pod 0 form their own batches.
+    std::map<std::pair<int, bool>, std::vector<int>> pending;   // (node, initial) -> pages
+    for (int VPN : VPNs) {
+        pending[{probable_owner(VPN), false}].push_back(VPN);
+    }
+    uint8_t access = is_write ? DSM_PAGE_ACCESS_WRITE : DSM_PAGE_ACCESS_READ;
+    std::vector<std::tuple<int, uint16_t, uint32_t>> loaded;   // VPN, copy source, version
+
+    while (!pending.empty()) {
+        // Send every batch before reading any reply so the round trips to
+        // different nodes overlap
+        std::vector<std::tuple<RpcChannel*, uint32_t, size_t>> sent;   // channel, seq, pages asked
+        for (auto& target : pending) {
+            int node = target.first.first;
+            RpcChannel* channel = page_channel(node);
+            if (channel == nullptr) {
+                std::cerr << "[pull_remote_pages] Failed to connect to node " << node << std::endl;
+                continue;
+            }
+            const std::vector<int>& pages = target.second;
+            for (size_t first = 0; first < pages.size(); first += DSM_PAGE_BATCH_MAX) {
+                size_t count = std::min(pages.size() - first, static_cast<size_t>(DSM_PAGE_BATCH_MAX));
+                std::vector<uint32_t> list(count);
+                for (size_t i = 0; i < count; i++) {
+                    list[i] = htonl(static_cast<uint32_t>(pages[first + i]));
+                }
+
+                dsm_header_t req_header = {
+                    DSM_MSG_PAGE_BATCH_REQ,
+                    DSM_PAGE_REQ_FLAGS(target.first.second ? (access | DSM_PAGE_REQ_INITIAL) : access, PageCodec),
+                    htons(static_cast<uint16_t>(PodId)),
+                    0,
+                    htonl(static_cast<uint32_t>(sizeof(payload_page_batch_req_t) + count * sizeof(uint32_t)))
+                };
+                payload_page_batch_req_t req_payload = {
+                    htonl(static_cast<uint32_t>(count))
+                };
+
+                uint32_t seq = channel->Send(req_header, {
+                    { &req_payload, sizeof(req_payload) },
+                    { list.data(), count * sizeof(uint32_t) }
+                });
+                if (seq == 0) {
+                    std::cerr << "[pull_remote_pages] Failed to send PAGE_BATCH_REQ to node " << node << std::endl;
+                    break;
+                }
+                sent.emplace_back(channel, seq, count);
+            }
         }
-        
-        // Copy page data to memory (equivalent to DMA)
-        std::memcpy((void*)page_base, page_buffer, DSM_PAGE_SIZE);
-
-        // Update local PageTable: set this node as the owner of the page
-        if (PageTable != nullptr) {
-            PageTable->GlobalMutexLock();
-            PageRecord* page_rec = PageTable->Find(VPN);
-            if (page_rec != nullptr) {
-                page_rec->owner_id = PodId;  // Set ourselves as the new owner
-            } else {
-                // If record doesn't exist, create it
-                PageRecord new_record;
-                new_record.owner_id = PodId;
-                PageTable->Insert(VPN, new_record);
+
+        // Each batch is matched to its reply by seq_num, whatever order the
+        // replies arrive in. After a failure the remaining replies are still
+        // waited for, so no seq is left registered on its channel.
+        std::map<std::pair<int, bool>, std::vector<int>> redirected;
+        bool failed = false;
+        for (auto& batch : sent) {
+            RpcMessage rep;
+            bool received = std::get<0>(batch)->Wait(std::get<1>(batch), rep);
+            if (failed) {
+                continue;
+            }
+            if (!received || rep.header.type != DSM_MSG_PAGE_BATCH_REP) {
+                std::cerr << "[pull_remote_pages] Failed to receive PAGE_BATCH_REP" << std::endl;
+                failed = true;
+                continue;
+            }
+
+            for (size_t i = 0; i < std::get<2>(batch); i++) {
+                payload_page_batch_entry_t entry;
+                if (!rep.Read(&entry, sizeof(entry))) {
+                    std::cerr << "[pull_remote_pages] Truncated PAGE_BATCH_REP" << std::endl;
+                    failed = true;
+                    break;
+                }
+                int VPN = static_cast<int>(ntohl(entry.page_index));
+                uint16_t real_owner_id = ntohs(entry.real_owner_id);
+
+                if (entry.status == DSM_PAGE_BATCH_DATA || entry.status == DSM_PAGE_BATCH_ZERO
+                    || entry.status == DSM_PAGE_BATCH_PACKED) {
+                    char page_buffer[DSM_PAGE_SIZE];
+                    const char* page_data = nullptr;
+                    if (entry.status == DSM_PAGE_BATCH_PACKED) {
+                        if (!read_packed_page(rep, page_buffer)) {
+                            std::cerr << "[pull_remote_pages] Failed to read packed page data" << std::endl;
+                            failed = true;
+                            break;
+                        }
+                        page_data = page_buffer;
+                    } else if (entry.status == DSM_PAGE_BATCH_DATA
+                               && (page_data = rep.TakePage()) == nullptr) {
+                        std::cerr << "[pull_remote_pages] Failed to read page data" << std::endl;
+                        failed = true;
+                        break;
+                    }
+                    install_page(VPN, is_write, page_data, page_data != page_buffer);
+                    ProbOwner[VPN - SAB_VPNumber] = is_write ? PodId : real_owner_id;
+                    loaded.emplace_back(VPN, real_owner_id, ntohl(entry.version));
+                } else if (entry.status == DSM_PAGE_BATCH_REDIRECT) {
+                    ProbOwner[VPN - SAB_VPNumber] = real_owner_id;
+                    redirected[{real_owner_id, false}].push_back(VPN);
+                } else if (entry.status == DSM_PAGE_BATCH_INITIAL) {
+                    redirected[{real_owner_id, true}].push_back(VPN);
+                }
+                // DSM_PAGE_BATCH_FAILED: leave the page unmapped, touching it
+                // faults again and goes through pull_remote_page
             }
-            PageTable->GlobalMutexUnlock();
         }
-        
-        // Send OWNER_UPDATE to the manager (the original probable owner, not the redirected one)
-        std::string manager_ip = GetPodIp(manager_id);
-        int manager_port = GetPodPort(manager_id);
-        int manager_sock = getsocket(manager_ip, manager_port);
-        
-        if (manager_sock < 0) {
-            std::cerr << "[pull_remote_page] Failed to connect to manager " << manager_id << std::endl;
-            // Page data is already loaded, so we can continue
-            std::cout << "[System information] Page loaded successfully (OWNER_UPDATE skipped)" << std::endl;
+        // Pages left unmapped fault again and go through pull_remote_page
+        if (failed) {
+            break;
+        }
+        pending.swap(redirected);
+    }
+
+    // One queued ownership update per installed page, flushed together; this
+    // includes the pages installed before a failed batch
+    for (auto& page : loaded) {
+        announce_page(std::get<0>(page), is_write, std::get<1>(page), std::get<2>(page));
+    }
+    std::cout << "[System information] Batch loaded " << loaded.size() << " of " << VPNs.size() << " pages" << std::endl;
+}
+
+// Resume the threads blocked on a missing fault for VPN
+STATIC void wake_faulting_thread(int VPN)
+{
+    struct uffdio_range wake{};
+    wake.start = static_cast<uintptr_t>(VPN) << 12;
+    wake.len = g_page_sz;
+    ioctl(g_uffd, UFFDIO_WAKE, &wake);
+}
+
+// Fetch a page whose missing fault was reported by userfaultfd. Same
+// protocol as the SIGSEGV path, minus the twin: a multiple-writer store
+// retries on the read-only copy and takes the write-fault path.
+STATIC void service_missing_page(int VPN, bool is_write)
+{
+    int idx = VPN - SAB_VPNumber;
+    if (idx < 0 || idx >= static_cast<int>(g_region_pages)) {
+        return;
+    }
+
+    // Threads faulting on the same page all get the event; only the first
+    // fetches, the rest wait for it and just wake their own faulting thread
+    {
+        std::unique_lock<std::mutex> lock(g_inflight_mutex);
+        g_inflight_cond.wait(lock, [&] { return g_inflight.count(VPN) == 0; });
+        if (PageAccess[idx] != PROT_NONE) {
+            lock.unlock();
+            wake_faulting_thread(VPN);
             return;
         }
-        
-        // Get sequence number for manager connection
-        uint32_t update_seq = 1;
-        if (SocketTable != nullptr) {
-            SocketTable->GlobalMutexLock();
-            SocketRecord* record = SocketTable->Find(manager_id);
-            if (record != nullptr) {
-                update_seq = record->allocate_seq();
+        g_inflight.insert(VPN);
+    }
+
+    // A replica invalidated before the thread resumes is fetched again
+    while (PageAccess[idx] == PROT_NONE) {
+        std::vector<int> pages(1, VPN);
+        if (is_write && !MultiWriter) {
+            // Recorded before the thread resumes and can reach its release
+            block_pages(VPN, true, pages);
+            for (int page : pages) {
+                InvalidPages[page - SAB_VPNumber] = 1;
+                BarrierPages[page - SAB_VPNumber] = 1;
             }
-            SocketTable->GlobalMutexUnlock();
+            if (pages.size() == 1) {
+                pull_remote_page(VPN, true);
+            } else {
+                pull_remote_pages(pages, true);
+            }
+            continue;
         }
-        
-        // Build and send OWNER_UPDATE message
-        dsm_header_t update_header = {
-            DSM_MSG_OWNER_UPDATE,
-            0,                              // unused
-            htons(static_cast<uint16_t>(PodId)),  // src_node_id
-            htonl(update_seq),              // seq_num
-            htonl(sizeof(payload_owner_update_t))  // payload_len
-        };
-        
-        payload_owner_update_t update_payload = {
-            htonl(static_cast<uint32_t>(VPN)),    // resource_id (page number)
-            htons(static_cast<uint16_t>(PodId))   // new_owner_id (we are the new owner)
-        };
-        
-        // Send OWNER_UPDATE header and payload
-        if (::send(manager_sock, &update_header, sizeof(update_header), 0) != sizeof(update_header)) {
-            std::cerr << "[pull_remote_page] Failed to send OWNER_UPDATE header" << std::endl;
-            return;
+
+        block_pages(VPN, false, pages);
+        if (PrefetchMax > 0) {
+            std::lock_guard<std::mutex> guard(g_prefetch_mutex);
+            prefetch_stream(VPN, pages);
         }
-        
-        if (::send(manager_sock, &update_payload, sizeof(update_payload), 0) != sizeof(update_payload)) {
-            std::cerr << "[pull_remote_page] Failed to send OWNER_UPDATE payload" << std::endl;
-            return;
+        if (pages.size() == 1) {
+            pull_remote_page(VPN, false);
+        } else {
+            pull_remote_pages(pages, false);
         }
-        
-        // Wait for ACK
-        rio_t ack_rio;
-        rio_readinit(&ack_rio, manager_sock);
-        
-        dsm_header_t ack_header;
-        if (rio_readn(&ack_rio, &ack_header, sizeof(ack_header)) != sizeof(ack_header)) {
-            std::cerr << "[pull_remote_page] Failed to receive ACK for OWNER_UPDATE" << std::endl;
+    }
+
+    release_page(VPN);
+    wake_faulting_thread(VPN);
+}
+
+STATIC void fault_service_loop()
+{
+    while (true) {
+        struct uffd_msg msg;
+        ssize_t n = read(g_uffd, &msg, sizeof(msg));
+        if (n != sizeof(msg)) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[fault_service] userfaultfd read failed: " << std::strerror(errno) << std::endl;
             return;
         }
-        
-        if (ack_header.type != DSM_MSG_ACK) {
-            std::cerr << "[pull_remote_page] Unexpected ACK type: " << static_cast<int>(ack_header.type) << std::endl;
-            return;
+        if (msg.event != UFFD_EVENT_PAGEFAULT) {
+            continue;
         }
-        
-        std::cout << "[System information] Page " << VPN << " loaded successfully, ownership updated" << std::endl;
-        return;
+        int VPN = static_cast<int>(msg.arg.pagefault.address >> 12);
+        bool is_write = (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) != 0;
+        service_missing_page(VPN, is_write);
     }
-}
\ No newline at end of file
+}
+
+// A userfaultfd with the given features enabled, -1 when the kernel refuses
+// them; a refused UFFDIO_API leaves the descriptor unusable, so it is closed
+static int open_userfaultfd(uint64_t features)
+{
+    // Only our own user-space faults are handled, which is what unprivileged
+    // processes may ask for under the default vm.unprivileged_userfaultfd=0
+    int fd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY));
+    if (fd < 0 && errno == EINVAL) {
+        fd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC));
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct uffdio_api api{};
+    api.api = UFFD_API;
+    api.features = features;
+    if (ioctl(fd, UFFDIO_API, &api) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool install_fault_service(void* base_addr, size_t num_pages, int num_threads)
+{
+    // Received pages are moved into place where the kernel can (Linux 6.8+)
+    bool move = true;
+    int fd = open_userfaultfd(UFFD_FEATURE_MOVE);
+    if (fd < 0) {
+        move = false;
+        fd = open_userfaultfd(0);
+    }
+    if (fd < 0) {
+        std::cerr << "[fault_service] userfaultfd unavailable: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct uffdio_register reg{};
+    reg.range.start = reinterpret_cast<uintptr_t>(base_addr);
+    reg.range.len = num_pages * PAGESIZE;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(fd, UFFDIO_REGISTER, &reg) == -1
+        || !(reg.ioctls & (1ULL << _UFFDIO_COPY))) {
+        std::cerr << "[fault_service] userfaultfd registration failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    // Nothing is resident yet, so opening the region only turns first
+    // touches into missing faults
+    if (mprotect(base_addr, num_pages * PAGESIZE, PROT_READ | PROT_WRITE) == -1) {
+        std::cerr << "[fault_service] mprotect failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    g_uffd = fd;
+    g_uffd_move = move && (reg.ioctls & (1ULL << _UFFDIO_MOVE)) != 0;
+
+    for (int i = 0; i < num_threads; i++) {
+        std::thread(fault_service_loop).detach();
+    }
+    return true;
+}
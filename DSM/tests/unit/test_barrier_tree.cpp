@@ -0,0 +1,136 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "os/barrier_tree.h"
+
+namespace {
+
+/* Walk up from every pod; each must reach Pod 0 and be its parent's child */
+void check_tree(const std::vector<std::string> &hosts, int fanout, int max_depth)
+{
+	int n = static_cast<int>(hosts.size());
+	for (int pod = 0; pod < n; pod++) {
+		BarrierLinks links = dsm_barrier_links(pod, hosts, fanout);
+		if (fanout > 0)
+			assert(static_cast<int>(links.children.size()) <= 2 * fanout);
+		for (int child : links.children)
+			assert(dsm_barrier_links(child, hosts, fanout).parent == pod);
+
+		int depth = 0;
+		for (int at = pod; at != 0; depth++) {
+			at = dsm_barrier_links(at, hosts, fanout).parent;
+			assert(at >= 0 && depth < n);
+		}
+		assert(depth <= max_depth);
+	}
+	assert(dsm_barrier_links(0, hosts, fanout).parent == -1);
+}
+
+void test_single_host_tree()
+{
+	std::vector<std::string> hosts(13, "127.0.0.1");
+	BarrierLinks root = dsm_barrier_links(0, hosts, 3);
+	assert((root.children == std::vector<int> { 1, 2, 3 }));
+	assert((dsm_barrier_links(1, hosts, 3).children == std::vector<int> { 4, 5, 6 }));
+	assert(dsm_barrier_links(12, hosts, 3).parent == 3);
+	/* 13 pods with fan-out 3 need 3 levels below the root */
+	check_tree(hosts, 3, 3);
+}
+
+void test_hosts_aggregate_first()
+{
+	/* Pods are spread round-robin over three hosts, as with DSM_WORKER_IPS */
+	std::vector<std::string> hosts;
+	for (int i = 0; i < 12; i++)
+		hosts.push_back("10.0.0." + std::to_string(1 + i % 3));
+
+	/* Same-host pods hang below the lowest pod of their host */
+	BarrierLinks five = dsm_barrier_links(5, hosts, 2);
+	assert(five.parent == 2);
+	/* Only host roots talk across hosts */
+	for (int pod = 0; pod < 12; pod++) {
+		int parent = dsm_barrier_links(pod, hosts, 2).parent;
+		bool root = pod == 0 || pod == 1 || pod == 2;
+		assert(root || hosts[parent] == hosts[pod]);
+	}
+	check_tree(hosts, 2, 4);
+}
+
+void test_unlimited_fanout_is_flat()
+{
+	std::vector<std::string> hosts(6, "127.0.0.1");
+	assert(dsm_barrier_links(0, hosts, 0).children.size() == 5);
+	check_tree(hosts, 0, 1);
+
+	/* A single pod is its own root */
+	assert(dsm_barrier_links(0, { "127.0.0.1" }, 4).children.empty());
+}
+
+/* A JOIN_REQ or JOIN_ACK carrying the notices, as the daemon reads it */
+RpcMessage message(const BarrierNotices &notices)
+{
+	RpcMessage msg;
+	msg.header = { DSM_MSG_JOIN_REQ, notices.Flags(), 0, 0, 0 };
+	msg.payload = notices.Encode();
+	return msg;
+}
+
+void test_notices_merge_writers()
+{
+	BarrierNotices left, right;
+	left.Add(3, 1);
+	left.Add(7, 1);
+	right.Add(7, 2);
+	right.Add(9, 2);
+
+	BarrierNotices merged;
+	RpcMessage a = message(left), b = message(right);
+	assert(merged.Merge(a) && merged.Merge(b));
+	assert(merged.pages.size() == 3);
+	assert(merged.pages[3] == 1 && merged.pages[9] == 2);
+	/* Written by two pods: nobody keeps its copy */
+	assert(merged.pages[7] == DSM_BARRIER_WRITER_MANY);
+
+	/* An arrival without writes carries no payload at all */
+	RpcMessage empty;
+	empty.header = { DSM_MSG_JOIN_REQ, 0, 0, 0, 0 };
+	assert(merged.Merge(empty) && merged.pages.size() == 3);
+
+	/* A truncated list is rejected */
+	RpcMessage cut = message(left);
+	cut.payload.pop_back();
+	BarrierNotices bad;
+	assert(!bad.Merge(cut));
+}
+
+void test_notices_overflow()
+{
+	BarrierNotices many;
+	for (uint32_t page = 0; page <= DSM_BARRIER_NOTICE_MAX; page++)
+		many.Add(page, 4);
+	assert(many.overflow && many.pages.empty());
+	assert(many.Flags() == DSM_BARRIER_ALL && many.Encode().empty());
+
+	/* Overflow anywhere in the tree reaches every pod */
+	BarrierNotices merged;
+	merged.Add(1, 0);
+	RpcMessage msg = message(many);
+	assert(merged.Merge(msg) && merged.overflow);
+	merged.Add(2, 0);
+	assert(merged.pages.empty());
+}
+
+} // namespace
+
+int main()
+{
+	test_single_host_tree();
+	test_hosts_aggregate_first();
+	test_unlimited_fanout_is_flat();
+	test_notices_merge_writers();
+	test_notices_overflow();
+	std::cout << "All barrier tree tests passed" << std::endl;
+	return 0;
+}
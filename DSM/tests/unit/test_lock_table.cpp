@@ -0,0 +1,142 @@
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "os/lock_table.h"
+
+namespace {
+
+LockWaiter waiter(uint16_t node, uint32_t seq, uint8_t mode = DSM_LOCK_MUTEX)
+{
+	LockWaiter w;
+	w.requester_id = node;
+	w.seq_num = seq;
+	w.mode = mode;
+	return w;
+}
+
+/* Release with the grants discarded, for steps that only check the result */
+LockTable::ReleaseResult release(LockTable &table, int lock_id, int node, const std::vector<int> &pages = {})
+{
+	std::vector<LockWaiter> granted;
+	std::vector<int> grant_pages;
+	return table.Release(lock_id, node, pages, granted, grant_pages);
+}
+
+void test_free_lock_is_granted()
+{
+	LockTable table;
+	std::vector<int> pages;
+	assert(table.Acquire(3, waiter(1, 10), pages));
+	assert(pages.empty());
+	assert(table.Find(3)->holder == 1);
+
+	assert(release(table, 3, 1, { 5, 6 }) == LockTable::FREED);
+	assert(table.Find(3)->holder == -1);
+
+	/* The next holder learns what the previous one wrote */
+	assert(table.Acquire(3, waiter(2, 11), pages));
+	assert((pages == std::vector<int> { 5, 6 }));
+}
+
+void test_waiters_are_granted_in_order()
+{
+	LockTable table;
+	std::vector<int> pages;
+	assert(table.Acquire(1, waiter(0, 1), pages));
+	assert(!table.Acquire(1, waiter(2, 7), pages));
+	assert(!table.Acquire(1, waiter(1, 9), pages));
+	assert(table.Find(1)->waiters.size() == 2);
+
+	std::vector<LockWaiter> granted;
+	assert(table.Release(1, 0, { 4 }, granted, pages) == LockTable::HANDED_OVER);
+	assert(granted.size() == 1 && granted[0].requester_id == 2 && granted[0].seq_num == 7);
+	assert((pages == std::vector<int> { 4 }));
+	assert(table.Find(1)->holder == 2);
+
+	assert(table.Release(1, 2, {}, granted, pages) == LockTable::HANDED_OVER);
+	assert(granted.size() == 1 && granted[0].requester_id == 1 && granted[0].seq_num == 9);
+
+	assert(release(table, 1, 1) == LockTable::FREED);
+	assert(table.Find(1)->waiters.empty());
+}
+
+void test_release_by_other_node_is_ignored()
+{
+	LockTable table;
+	std::vector<int> pages;
+	assert(table.Acquire(2, waiter(1, 1), pages));
+	assert(!table.Acquire(2, waiter(3, 2), pages));
+
+	assert(release(table, 2, 3, { 8 }) == LockTable::NOT_HELD);
+	assert(table.Find(2)->holder == 1);
+	assert(table.Find(2)->waiters.size() == 1);
+	assert(table.Find(2)->invalid_page_list.empty());
+
+	/* Never acquired at all */
+	assert(release(table, 9, 1) == LockTable::NOT_HELD);
+}
+
+void test_recall_once_per_tenure()
+{
+	LockTable table;
+	std::vector<int> pages;
+	/* Nobody waits, the holder keeps its cached token */
+	assert(table.Acquire(4, waiter(1, 1), pages));
+	assert(table.TakeRecall(4) == -1);
+
+	assert(!table.Acquire(4, waiter(2, 2), pages));
+	assert(table.TakeRecall(4) == 1);
+	/* Another waiter does not ask the holder a second time */
+	assert(!table.Acquire(4, waiter(3, 3), pages));
+	assert(table.TakeRecall(4) == -1);
+
+	/* The next holder is recalled afresh, since pod 3 still waits */
+	assert(release(table, 4, 1, { 7 }) == LockTable::HANDED_OVER);
+	assert(table.TakeRecall(4) == 2);
+}
+
+void test_readers_share_and_writers_wait()
+{
+	LockTable table;
+	std::vector<int> pages;
+	assert(table.Acquire(5, waiter(0, 1, DSM_LOCK_READ), pages));
+	assert(table.Acquire(5, waiter(1, 1, DSM_LOCK_READ), pages));
+	assert(!table.Acquire(5, waiter(2, 1, DSM_LOCK_WRITE), pages));
+	/* A reader arriving behind a waiting writer does not overtake it */
+	assert(!table.Acquire(5, waiter(3, 1, DSM_LOCK_READ), pages));
+	assert(!table.Acquire(5, waiter(0, 2, DSM_LOCK_READ), pages));
+	assert(!table.Acquire(5, waiter(1, 2, DSM_LOCK_WRITE), pages));
+
+	assert(release(table, 5, 0) == LockTable::FREED);
+	std::vector<LockWaiter> granted;
+	assert(table.Release(5, 1, {}, granted, pages) == LockTable::HANDED_OVER);
+	assert(granted.size() == 1 && granted[0].requester_id == 2);
+	/* A writer holding the lock is never recalled like a cached mutex */
+	assert(table.TakeRecall(5) == -1);
+
+	/* The writer's release grants both queued readers at once, with its pages */
+	assert(table.Release(5, 2, { 9 }, granted, pages) == LockTable::HANDED_OVER);
+	assert(granted.size() == 2 && granted[0].requester_id == 3 && granted[1].requester_id == 0);
+	assert((pages == std::vector<int> { 9 }));
+	assert(table.Find(5)->readers.size() == 2);
+
+	/* Readers carry no pages, the next writer still learns the last writer's */
+	assert(release(table, 5, 3) == LockTable::FREED);
+	assert(table.Release(5, 0, {}, granted, pages) == LockTable::HANDED_OVER);
+	assert(granted.size() == 1 && granted[0].requester_id == 1);
+	assert((pages == std::vector<int> { 9 }));
+}
+
+} // namespace
+
+int main()
+{
+	test_free_lock_is_granted();
+	test_waiters_are_granted_in_order();
+	test_release_by_other_node_is_ignored();
+	test_recall_once_per_tenure();
+	test_readers_share_and_writers_wait();
+	std::cout << "All lock table tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net/msg_builder.h"
+
+namespace {
+
+void read_all(int sock, void *buf, size_t len)
+{
+	rio_t rio;
+	rio_readinit(&rio, sock);
+	assert(rio_readn(&rio, buf, len) == (ssize_t)len);
+}
+
+void test_segments_in_order()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	dsm_header_t header = { DSM_MSG_PAGE_REP, 1, htons(3), htonl(42), 0 };
+	uint16_t owner = htons(7);
+	const char body[] = "page body";
+	MsgBuilder msg(header);
+	msg.Add(owner).Add(body, sizeof(body)).Add(nullptr, 0);
+	assert(msg.PayloadLen() == sizeof(owner) + sizeof(body));
+	assert(msg.Send(fds[0]));
+
+	/* payload_len is filled in, the segments follow the header back to back */
+	char buf[sizeof(dsm_header_t) + sizeof(owner) + sizeof(body)];
+	read_all(fds[1], buf, sizeof(buf));
+	dsm_header_t got;
+	memcpy(&got, buf, sizeof(got));
+	assert(got.type == DSM_MSG_PAGE_REP && got.unused == 1);
+	assert(ntohl(got.seq_num) == 42);
+	assert(ntohl(got.payload_len) == sizeof(owner) + sizeof(body));
+	assert(memcmp(buf + sizeof(got), &owner, sizeof(owner)) == 0);
+	assert(memcmp(buf + sizeof(got) + sizeof(owner), body, sizeof(body)) == 0);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_partial_writes()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	/* Far beyond the socket buffer, so sendmsg returns short writes */
+	std::vector<char> a(700 * 1024), b(300 * 1024 + 17);
+	for (size_t i = 0; i < a.size(); i++)
+		a[i] = (char)(i * 7);
+	for (size_t i = 0; i < b.size(); i++)
+		b[i] = (char)(i * 13);
+
+	std::vector<char> got(sizeof(dsm_header_t) + a.size() + b.size());
+	std::thread reader([&] { read_all(fds[1], got.data(), got.size()); });
+
+	dsm_header_t header = { DSM_MSG_PAGE_BATCH_REP, 0, 0, htonl(1), 0 };
+	assert(MsgBuilder(header).Add(a.data(), a.size()).Add(b.data(), b.size()).Send(fds[0]));
+	reader.join();
+
+	assert(memcmp(got.data() + sizeof(dsm_header_t), a.data(), a.size()) == 0);
+	assert(memcmp(got.data() + sizeof(dsm_header_t) + a.size(), b.data(), b.size()) == 0);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_too_many_parts()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	dsm_header_t header = { DSM_MSG_ACK, 0, 0, htonl(1), 0 };
+	uint32_t word = 0;
+	MsgBuilder msg(header);
+	for (int i = 0; i <= DSM_MSG_MAX_PARTS; i++)
+		msg.Add(word);
+	assert(!msg.Send(fds[0]));
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+} // namespace
+
+int main()
+{
+	test_segments_in_order();
+	test_partial_writes();
+	test_too_many_parts();
+
+	std::cout << "All msg builder tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+
+#include "os/page_table.h"
+
+namespace {
+
+void test_writers_in_order()
+{
+	PageRecord record;
+
+	/* Pod 0 hands the untouched page to node 1, which passes it to node 2 */
+	assert(record.AcceptWriter(1, 1));
+	assert(record.owner_id == 1 && record.version == 1);
+	assert(record.AcceptWriter(2, 2));
+	assert(record.owner_id == 2 && record.version == 2);
+}
+
+void test_late_writer_is_ignored()
+{
+	PageRecord record;
+	record.owner_id = 0;
+
+	/* Node 2 took the page from node 1, but its update arrives first */
+	assert(record.AcceptWriter(2, 2));
+	assert(!record.AcceptWriter(1, 1));
+	assert(record.owner_id == 2 && record.version == 2);
+
+	/* A later transfer back to node 1 still counts */
+	assert(record.AcceptWriter(1, 3));
+	assert(record.owner_id == 1 && record.version == 3);
+}
+
+void test_owning_manager_accepts_its_transfer()
+{
+	/* The manager owned the page and already bumped the count handing it over */
+	PageRecord record;
+	record.owner_id = 4;
+	record.version = 7;
+	assert(record.AcceptWriter(5, 7));
+	assert(record.owner_id == 5);
+}
+
+void test_count_wraps()
+{
+	PageRecord record;
+	record.version = UINT32_MAX;
+	assert(record.AcceptWriter(1, 0));
+	assert(record.version == 0);
+	assert(!record.AcceptWriter(2, UINT32_MAX));
+	assert(record.owner_id == 1);
+}
+
+} // namespace
+
+int main()
+{
+	test_writers_in_order();
+	test_late_writer_is_ignored();
+	test_owning_manager_accepts_its_transfer();
+	test_count_wraps();
+	std::cout << "All owner version tests passed" << std::endl;
+	return 0;
+}
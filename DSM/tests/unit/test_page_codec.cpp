@@ -0,0 +1,87 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "net/page_codec.h"
+
+namespace {
+
+constexpr size_t kPage = 4096;
+
+std::vector<uint8_t> small_ints()
+{
+	/* Matrix entries: small non-negative ints, high bytes all zero */
+	std::vector<int> ints(kPage / sizeof(int));
+	for (size_t i = 0; i < ints.size(); i++)
+		ints[i] = static_cast<int>(i % 97);
+	std::vector<uint8_t> page(kPage);
+	std::memcpy(page.data(), ints.data(), kPage);
+	return page;
+}
+
+std::vector<uint8_t> random_bytes()
+{
+	std::vector<uint8_t> page(kPage);
+	unsigned seed = 12345;
+	for (auto &b : page) {
+		seed = seed * 1103515245u + 12345u;
+		b = static_cast<uint8_t>(seed >> 16);
+	}
+	return page;
+}
+
+void check_roundtrip(int codec, const std::vector<uint8_t> &page)
+{
+	std::vector<uint8_t> packed(kPage), back(kPage, 0xAA);
+	size_t len = dsm_codec_compress(codec, page.data(), kPage, packed.data());
+	assert(len > 0 && len < DSM_CODEC_THRESHOLD(kPage));
+	assert(dsm_codec_decompress(codec, packed.data(), len, back.data(), kPage));
+	assert(back == page);
+}
+
+void test_roundtrip_compressible()
+{
+	std::vector<uint8_t> repeated(kPage);
+	for (size_t i = 0; i < kPage; i++)
+		repeated[i] = static_cast<uint8_t>("distance"[i % 8]);
+
+	check_roundtrip(DSM_CODEC_LZ, small_ints());
+	check_roundtrip(DSM_CODEC_LZ, repeated);
+	check_roundtrip(DSM_CODEC_SHUFFLE, small_ints());
+}
+
+void test_incompressible_skipped()
+{
+	std::vector<uint8_t> page = random_bytes(), packed(kPage);
+	assert(dsm_codec_compress(DSM_CODEC_LZ, page.data(), kPage, packed.data()) == 0);
+	assert(dsm_codec_compress(DSM_CODEC_SHUFFLE, page.data(), kPage, packed.data()) == 0);
+	assert(dsm_codec_compress(DSM_CODEC_NONE, page.data(), kPage, packed.data()) == 0);
+}
+
+void test_rejects_corrupt_input()
+{
+	std::vector<uint8_t> page = small_ints(), packed(kPage), back(kPage);
+	for (int codec : { DSM_CODEC_LZ, DSM_CODEC_SHUFFLE }) {
+		size_t len = dsm_codec_compress(codec, page.data(), kPage, packed.data());
+		/* Truncated stream decodes to fewer bytes than a page */
+		assert(!dsm_codec_decompress(codec, packed.data(), len / 2, back.data(), kPage));
+	}
+
+	/* LZ match pointing before the start of the page */
+	const uint8_t bad_offset[] = { 0x10, 'a', 0x10, 0x00 };
+	assert(!dsm_codec_decompress(DSM_CODEC_LZ, bad_offset, sizeof(bad_offset), back.data(), kPage));
+}
+
+} // namespace
+
+int main()
+{
+	test_roundtrip_compressible();
+	test_incompressible_skipped();
+	test_rejects_corrupt_input();
+
+	std::cout << "All page codec tests passed" << std::endl;
+	return 0;
+}
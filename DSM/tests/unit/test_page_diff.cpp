@@ -0,0 +1,95 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "os/page_diff.h"
+
+namespace {
+
+constexpr size_t kPage = 4096;
+
+void test_identical_page()
+{
+	std::vector<uint8_t> page(kPage, 0x5a), twin(kPage, 0x5a);
+	std::vector<uint8_t> diff(DSM_DIFF_MAX_SIZE(kPage));
+
+	assert(dsm_diff_encode(page.data(), twin.data(), kPage, diff.data()) == 0);
+}
+
+void test_disjoint_writers_merge()
+{
+	/* Two writers start from the same twin and touch different ints */
+	std::vector<int> base(kPage / sizeof(int), 7);
+	std::vector<int> writer_a = base, writer_b = base;
+	writer_a[0] = 100;
+	writer_a[1] = 101;
+	writer_b[2] = 200;
+	writer_b[1023] = 300;
+
+	std::vector<uint8_t> diff_a(DSM_DIFF_MAX_SIZE(kPage)), diff_b(DSM_DIFF_MAX_SIZE(kPage));
+	size_t len_a = dsm_diff_encode(writer_a.data(), base.data(), kPage, diff_a.data());
+	size_t len_b = dsm_diff_encode(writer_b.data(), base.data(), kPage, diff_b.data());
+	assert(len_a == 4 + 8);      /* one run of two ints */
+	assert(len_b == 2 * (4 + 4)); /* two runs of one int */
+
+	std::vector<int> home = base;
+	assert(dsm_diff_apply(home.data(), kPage, diff_a.data(), len_a));
+	assert(dsm_diff_apply(home.data(), kPage, diff_b.data(), len_b));
+	assert(home[0] == 100 && home[1] == 101 && home[2] == 200 && home[1023] == 300);
+	assert(home[3] == 7 && home[1022] == 7);
+}
+
+void test_full_page_and_tail()
+{
+	/* Non multiple of the SIMD block exercises the scalar tail */
+	const size_t size = 4100;
+	std::vector<uint8_t> page(size), twin(size, 0);
+	for (size_t i = 0; i < size; i++)
+		page[i] = static_cast<uint8_t>(i * 31 + 1);
+
+	std::vector<uint8_t> diff(DSM_DIFF_MAX_SIZE(size));
+	size_t len = dsm_diff_encode(page.data(), twin.data(), size, diff.data());
+	assert(len <= DSM_DIFF_MAX_SIZE(size));
+
+	assert(dsm_diff_apply(twin.data(), size, diff.data(), len));
+	assert(std::memcmp(page.data(), twin.data(), size) == 0);
+}
+
+void test_rejects_out_of_bounds()
+{
+	std::vector<uint8_t> page(kPage, 0);
+	const uint8_t bad[] = { 0x0f, 0xfc, 0x00, 0x08, 1, 2, 3, 4, 5, 6, 7, 8 }; /* offset 4092, len 8 */
+	assert(!dsm_diff_apply(page.data(), kPage, bad, sizeof(bad)));
+
+	const uint8_t truncated[] = { 0x00, 0x00, 0x00, 0x04, 1, 2 };
+	assert(!dsm_diff_apply(page.data(), kPage, truncated, sizeof(truncated)));
+}
+
+void test_zero_page()
+{
+	std::vector<uint8_t> page(kPage + 8, 0);
+	assert(dsm_page_is_zero(page.data(), page.size()));
+
+	/* A single byte anywhere, including the scalar tail, makes it non-zero */
+	const size_t probes[] = { 0, 63, 64, 2049, kPage - 1, kPage + 7 };
+	for (size_t at : probes) {
+		page[at] = 1;
+		assert(!dsm_page_is_zero(page.data(), page.size()));
+		page[at] = 0;
+	}
+}
+
+} // namespace
+
+int main()
+{
+	test_identical_page();
+	test_disjoint_writers_merge();
+	test_full_page_and_tail();
+	test_rejects_out_of_bounds();
+	test_zero_page();
+
+	std::cout << "All page diff tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net/rpc_channel.h"
+
+namespace {
+
+struct Request {
+	dsm_header_t header;
+	uint32_t value;
+};
+
+Request read_request(rio_t *rio)
+{
+	Request req;
+	assert(rio_readn(rio, &req.header, sizeof(req.header)) == sizeof(req.header));
+	assert(ntohl(req.header.payload_len) == sizeof(uint32_t));
+	assert(rio_readn(rio, &req.value, sizeof(req.value)) == sizeof(req.value));
+	return req;
+}
+
+/* Answers with the request's value plus one, echoing its seq_num */
+void reply(int sock, const Request &req)
+{
+	dsm_header_t rep = { DSM_MSG_ACK, 0, 0, req.header.seq_num, htonl(sizeof(uint32_t)) };
+	uint32_t value = htonl(ntohl(req.value) + 1);
+	assert(write(sock, &rep, sizeof(rep)) == sizeof(rep));
+	assert(write(sock, &value, sizeof(value)) == sizeof(value));
+}
+
+uint32_t send_value(RpcChannel &channel, uint32_t value)
+{
+	dsm_header_t header = { DSM_MSG_LOCK_ACQ, 0, 0, 0, htonl(sizeof(uint32_t)) };
+	uint32_t net = htonl(value);
+	uint32_t seq = channel.Send(header, { { &net, sizeof(net) } });
+	assert(seq != 0);
+	return seq;
+}
+
+uint32_t reply_value(RpcMessage &rep)
+{
+	uint32_t value;
+	assert(rep.Read(&value, sizeof(value)));
+	assert(!rep.Read(&value, 1));
+	return ntohl(value);
+}
+
+void test_out_of_order_replies()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	RpcChannel *channel = new RpcChannel(std::make_unique<TcpTransport>(fds[0]));
+
+	/* The server holds all three requests and answers them backwards */
+	std::thread server([&] {
+		rio_t rio;
+		rio_readinit(&rio, fds[1]);
+		std::vector<Request> reqs;
+		for (int i = 0; i < 3; i++)
+			reqs.push_back(read_request(&rio));
+		assert(reqs[0].header.seq_num != reqs[1].header.seq_num);
+		for (int i = 2; i >= 0; i--)
+			reply(fds[1], reqs[i]);
+	});
+
+	uint32_t seqs[3];
+	for (uint32_t i = 0; i < 3; i++)
+		seqs[i] = send_value(*channel, 10 * i);
+	for (uint32_t i = 0; i < 3; i++) {
+		RpcMessage rep;
+		assert(channel->Wait(seqs[i], rep));
+		assert(rep.header.seq_num == htonl(seqs[i]));
+		assert(reply_value(rep) == 10 * i + 1);
+	}
+	server.join();
+	close(fds[1]);
+}
+
+void test_concurrent_callers()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	RpcChannel *channel = new RpcChannel(std::make_unique<TcpTransport>(fds[0]));
+	const int kThreads = 4, kCalls = 50;
+
+	std::thread server([&] {
+		rio_t rio;
+		rio_readinit(&rio, fds[1]);
+		for (int i = 0; i < kThreads * kCalls; i++)
+			reply(fds[1], read_request(&rio));
+	});
+
+	std::vector<std::thread> callers;
+	for (int t = 0; t < kThreads; t++) {
+		callers.emplace_back([channel, t] {
+			for (uint32_t i = 0; i < kCalls; i++) {
+				uint32_t value = t * 1000 + i;
+				uint32_t net = htonl(value);
+				dsm_header_t header = { DSM_MSG_LOCK_ACQ, 0, 0, 0, htonl(sizeof(net)) };
+				RpcMessage rep;
+				assert(channel->Call(header, { { &net, sizeof(net) } }, rep));
+				assert(reply_value(rep) == value + 1);
+			}
+		});
+	}
+	for (auto &caller : callers)
+		caller.join();
+	server.join();
+	close(fds[1]);
+}
+
+void test_peer_closed()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	RpcChannel *channel = new RpcChannel(std::make_unique<TcpTransport>(fds[0]));
+
+	uint32_t seq = send_value(*channel, 7);
+	close(fds[1]);
+
+	/* A waiter is woken up with a failure, later sends fail straight away */
+	RpcMessage rep;
+	assert(!channel->Wait(seq, rep));
+	dsm_header_t header = { DSM_MSG_LOCK_ACQ, 0, 0, 0, 0 };
+	assert(channel->Send(header, {}) == 0);
+}
+
+void test_posted_requests()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	RpcChannel *channel = new RpcChannel(std::make_unique<TcpTransport>(fds[0]));
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<uint32_t> answers;
+	int failures = 0;
+	auto post = [&](uint32_t value) {
+		uint32_t net = htonl(value);
+		dsm_header_t header = { DSM_MSG_LOCK_RECALL, 0, 0, 0, htonl(sizeof(net)) };
+		channel->Post(header, { { &net, sizeof(net) } }, [&](bool ok, RpcMessage &rep) {
+			std::lock_guard<std::mutex> guard(mutex);
+			if (ok)
+				answers.push_back(reply_value(rep));
+			else
+				failures++;
+			cond.notify_all();
+		});
+	};
+
+	/* Posted and waited-for requests share the channel */
+	post(5);
+	uint32_t seq = send_value(*channel, 20);
+	post(30);
+	rio_t rio;
+	rio_readinit(&rio, fds[1]);
+	std::vector<Request> reqs;
+	for (int i = 0; i < 3; i++)
+		reqs.push_back(read_request(&rio));
+	for (int i = 2; i >= 0; i--)
+		reply(fds[1], reqs[i]);
+
+	RpcMessage rep;
+	assert(channel->Wait(seq, rep) && reply_value(rep) == 21);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&] { return answers.size() == 2; });
+		assert(answers[0] == 31 && answers[1] == 6);
+	}
+
+	/* An unanswered request fails when the peer goes away, later ones at once */
+	post(40);
+	close(fds[1]);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&] { return failures == 1; });
+	}
+	post(50);
+	std::lock_guard<std::mutex> guard(mutex);
+	assert(failures == 2 && answers.size() == 2);
+}
+
+} // namespace
+
+int main()
+{
+	test_out_of_order_replies();
+	test_concurrent_callers();
+	test_peer_closed();
+	test_posted_requests();
+
+	std::cout << "All rpc channel tests passed" << std::endl;
+	return 0;
+}
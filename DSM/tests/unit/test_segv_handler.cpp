@@ -12,7 +12,7 @@ extern size_t g_page_sz;
 
 int main()
 {
-    install_handler(nullptr, 4);
+    install_handler(nullptr, 4, 1);
     std::cout << "managed region: " << g_region << " (" << g_region_pages
               << " pages, PROT_NONE)\n";
 
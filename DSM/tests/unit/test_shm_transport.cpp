@@ -0,0 +1,165 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "net/shm_transport.h"
+
+namespace {
+
+std::string segment_name(int client_pod)
+{
+	return ShmTransport::SegmentName(getpid(), client_pod);
+}
+
+/* Receive from t until one whole frame is available */
+RpcMessage recv_frame(Transport &t, FrameBuffer &frames)
+{
+	RpcMessage msg;
+	char chunk[4096];
+	while (!frames.Next(msg)) {
+		ssize_t n = t.Recv(chunk, sizeof(chunk));
+		assert(n > 0);
+		frames.Append(chunk, n);
+	}
+	return msg;
+}
+
+void test_attach_once()
+{
+	assert(ShmTransport::Open(segment_name(1)) == nullptr);
+
+	std::unique_ptr<ShmTransport> daemon = ShmTransport::Create(segment_name(1));
+	assert(daemon != nullptr);
+	std::unique_ptr<ShmTransport> client = ShmTransport::Open(segment_name(1));
+	assert(client != nullptr);
+
+	/* One client per segment */
+	assert(ShmTransport::Open(segment_name(1)) == nullptr);
+}
+
+void test_round_trip()
+{
+	std::unique_ptr<ShmTransport> daemon = ShmTransport::Create(segment_name(2));
+	std::unique_ptr<ShmTransport> client = ShmTransport::Open(segment_name(2));
+	assert(daemon != nullptr && client != nullptr);
+
+	dsm_header_t req = { DSM_MSG_PAGE_REQ, 0, htons(2), htonl(9), 0 };
+	uint32_t vpn = htonl(1234);
+	assert(client->Send(MsgBuilder(req).Add(vpn)));
+
+	FrameBuffer daemon_in;
+	RpcMessage got = recv_frame(*daemon, daemon_in);
+	uint32_t got_vpn;
+	assert(got.header.type == DSM_MSG_PAGE_REQ && ntohl(got.header.seq_num) == 9);
+	assert(got.Read(&got_vpn, sizeof(got_vpn)) && ntohl(got_vpn) == 1234);
+
+	/* Replies travel on the other ring */
+	dsm_header_t ack = { DSM_MSG_ACK, 1, 0, htonl(9), 0 };
+	assert(daemon->Send(MsgBuilder(ack)));
+	FrameBuffer client_in;
+	got = recv_frame(*client, client_in);
+	assert(got.header.type == DSM_MSG_ACK && got.payload.empty());
+}
+
+void test_larger_than_ring()
+{
+	std::unique_ptr<ShmTransport> daemon = ShmTransport::Create(segment_name(3));
+	std::unique_ptr<ShmTransport> client = ShmTransport::Open(segment_name(3));
+
+	/* The writer has to wait for the reader to free space, several times over */
+	std::vector<char> body(3 * DSM_SHM_RING_SIZE + 123);
+	for (size_t i = 0; i < body.size(); i++)
+		body[i] = (char)(i * 31);
+
+	std::thread writer([&] {
+		dsm_header_t header = { DSM_MSG_PAGE_BATCH_REP, 0, 0, htonl(5), 0 };
+		assert(daemon->Send(MsgBuilder(header).Add(body.data(), body.size())));
+	});
+	FrameBuffer in;
+	RpcMessage got = recv_frame(*client, in);
+	writer.join();
+
+	assert(got.payload.size() == body.size());
+	assert(memcmp(got.payload.data(), body.data(), body.size()) == 0);
+}
+
+void test_concurrent_senders()
+{
+	std::unique_ptr<ShmTransport> daemon = ShmTransport::Create(segment_name(4));
+	std::unique_ptr<ShmTransport> client = ShmTransport::Open(segment_name(4));
+
+	const int threads = 4, per_thread = 2000;
+	std::vector<std::thread> senders;
+	for (int t = 0; t < threads; t++) {
+		senders.emplace_back([&, t] {
+			for (int i = 0; i < per_thread; i++) {
+				dsm_header_t header = { DSM_MSG_LOCK_ACQ, 0, htons(t), htonl(i), 0 };
+				std::vector<uint32_t> words(1 + i % 300, htonl(t * per_thread + i));
+				assert(client->Send(MsgBuilder(header).Add(words.data(), words.size() * sizeof(uint32_t))));
+			}
+		});
+	}
+
+	/* Messages are never interleaved, and each sender's arrive in order */
+	FrameBuffer in;
+	std::vector<int> next(threads, 0);
+	for (int n = 0; n < threads * per_thread; n++) {
+		RpcMessage got = recv_frame(*daemon, in);
+		int t = ntohs(got.header.src_node_id);
+		int i = (int)ntohl(got.header.seq_num);
+		assert(i == next[t]++);
+		assert(got.payload.size() == (1 + i % 300) * sizeof(uint32_t));
+		uint32_t word;
+		while (got.Read(&word, sizeof(word)))
+			assert(ntohl(word) == (uint32_t)(t * per_thread + i));
+	}
+	for (std::thread &sender : senders)
+		sender.join();
+}
+
+void test_wait_any()
+{
+	std::unique_ptr<ShmTransport> first = ShmTransport::Create(segment_name(5));
+	std::unique_ptr<ShmTransport> second = ShmTransport::Create(segment_name(6));
+	std::unique_ptr<ShmTransport> client = ShmTransport::Open(segment_name(6));
+	assert(first != nullptr && second != nullptr && client != nullptr);
+	std::vector<ShmTransport *> rings = { first.get(), second.get() };
+
+	char buf[64];
+	assert(first->TryRecv(buf, sizeof(buf)) == 0);
+	assert(second->TryRecv(buf, sizeof(buf)) == 0);
+
+	/* A frame on either ring ends the wait */
+	std::thread sender([&] {
+		usleep(20000);
+		dsm_header_t req = { DSM_MSG_LOCK_ACQ, 0, htons(6), htonl(3), 0 };
+		assert(client->Send(MsgBuilder(req)));
+	});
+	size_t got = 0;
+	while (got < sizeof(dsm_header_t)) {
+		assert(ShmTransport::WaitAny(rings) || got == 0);
+		got += second->TryRecv(buf + got, sizeof(buf) - got);
+	}
+	sender.join();
+	assert(got == sizeof(dsm_header_t));
+	assert(first->TryRecv(buf, sizeof(buf)) == 0);
+	assert(!first->Closed() && !second->Closed());
+}
+
+} // namespace
+
+int main()
+{
+	test_attach_once();
+	test_round_trip();
+	test_larger_than_ring();
+	test_concurrent_senders();
+	test_wait_any();
+
+	std::cout << "All shm transport tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "os/socket_table.h"
+
+namespace {
+
+std::unique_ptr<RpcChannel> make_channel(int *peer)
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	*peer = fds[1];
+	return std::make_unique<RpcChannel>(std::make_unique<TcpTransport>(fds[0]));
+}
+
+void test_empty_slots()
+{
+	SocketTable table(3);
+	assert(table.Size() == 3);
+	for (int node = 0; node < 3; node++)
+		assert(table.Find(node) == nullptr);
+	/* Out of range pod ids find nothing instead of reading past the array */
+	assert(table.Find(-1) == nullptr);
+	assert(table.Find(3) == nullptr);
+}
+
+void test_install_by_node()
+{
+	/* The table keeps its channels, whose reader threads outlive the test */
+	SocketTable *table = new SocketTable(4);
+	int peer;
+	RpcChannel *installed;
+	{
+		std::lock_guard<std::mutex> guard(table->SlotMutex(2));
+		installed = table->Install(2, make_channel(&peer));
+	}
+	assert(installed != nullptr);
+	assert(table->Find(2) == installed);
+	assert(table->Find(1) == nullptr);
+	assert(table->Find(3) == nullptr);
+	close(peer);
+}
+
+} // namespace
+
+int main()
+{
+	test_empty_slots();
+	test_install_by_node();
+	std::cout << "All socket table tests passed" << std::endl;
+	return 0;
+}
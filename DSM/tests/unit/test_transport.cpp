@@ -0,0 +1,165 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net/transport.h"
+
+namespace {
+
+std::vector<char> pattern(size_t len, int seed)
+{
+	std::vector<char> v(len);
+	for (size_t i = 0; i < len; i++)
+		v[i] = (char)(i * 11 + seed);
+	return v;
+}
+
+void test_frame_buffer_split_input()
+{
+	std::vector<char> body = pattern(5000, 1);
+	dsm_header_t header = { DSM_MSG_PAGE_REP, 0, 0, htonl(3), htonl((uint32_t)body.size()) };
+	std::vector<char> wire((char *)&header, (char *)&header + sizeof(header));
+	wire.insert(wire.end(), body.begin(), body.end());
+	wire.insert(wire.end(), (char *)&header, (char *)&header + sizeof(header) / 2);
+
+	/* Fed a byte at a time, a frame appears only once it is complete */
+	FrameBuffer frames;
+	RpcMessage msg;
+	for (size_t i = 0; i < sizeof(header) + body.size(); i++) {
+		assert(!frames.Next(msg));
+		frames.Append(&wire[i], 1);
+	}
+	assert(frames.Next(msg));
+	assert(msg.payload == body);
+	frames.Append(wire.data() + sizeof(header) + body.size(), sizeof(header) / 2);
+	assert(!frames.Next(msg));
+}
+
+/* A batch reply's trailing pages go to the staging pages, not the payload */
+void test_frame_buffer_raw_pages()
+{
+	std::vector<char> entries = pattern(3 * sizeof(payload_page_batch_entry_t), 2);
+	std::vector<char> raw = pattern(2 * DSM_PAGE_SIZE, 3);
+	dsm_header_t header = { DSM_MSG_PAGE_BATCH_REP, 2, 0, htonl(4),
+				htonl((uint32_t)(entries.size() + raw.size())) };
+	FrameBuffer frames;
+	frames.Append((char *)&header, sizeof(header));
+	frames.Append(entries.data(), entries.size());
+	frames.Append(raw.data(), raw.size());
+
+	RpcMessage msg;
+	assert(frames.Next(msg));
+	assert(msg.payload == entries);
+	char *first = msg.TakePage();
+	char *second = msg.TakePage();
+	assert(msg.TakePage() == nullptr);
+	assert((uintptr_t)first % DSM_PAGE_SIZE == 0 && second == first + DSM_PAGE_SIZE);
+	assert(memcmp(first, raw.data(), raw.size()) == 0);
+
+	/* More pages announced than the payload holds: all of it stays in payload */
+	header.unused = 3;
+	frames.Append((char *)&header, sizeof(header));
+	frames.Append(entries.data(), entries.size());
+	frames.Append(raw.data(), raw.size());
+	assert(frames.Next(msg));
+	assert(msg.payload.size() == entries.size() + raw.size());
+	assert(msg.TakePage() == nullptr);
+}
+
+void test_take_and_read()
+{
+	RpcMessage msg;
+	msg.payload = { 1, 2, 3, 4, 5 };
+	uint16_t two;
+	assert(msg.Read(&two, sizeof(two)));
+	const char *rest = msg.Take(3);
+	assert(rest == msg.payload.data() + 2 && rest[0] == 3);
+	assert(msg.Take(1) == nullptr);
+	assert(!msg.Read(&two, 1));
+}
+
+/* Small and page-sized messages back to back, read one at a time */
+void test_message_reader()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	const int count = 300;
+
+	std::thread writer([&] {
+		TcpTransport out(fds[1]);
+		for (int i = 0; i < count; i++) {
+			std::vector<char> body = pattern(i % 4 ? (size_t)(i % 7) : 2 + 4096, i);
+			dsm_header_t header = { DSM_MSG_ACK, 0, 0, htonl(i), 0 };
+			assert(out.Send(MsgBuilder(header).Add(body.data(), body.size())));
+		}
+	});
+
+	TcpTransport in(fds[0]);
+	MessageReader reader(in);
+	for (int i = 0; i < count; i++) {
+		RpcMessage msg;
+		assert(reader.Next(msg));
+		assert(ntohl(msg.header.seq_num) == (uint32_t)i);
+		assert(msg.payload == pattern(i % 4 ? (size_t)(i % 7) : 2 + 4096, i));
+	}
+	writer.join();
+
+	/* The writer's transport closed its end */
+	RpcMessage msg;
+	assert(!reader.Next(msg));
+}
+
+/* Page replies between small messages: each page lands in its staging page
+ * whole, nothing of it is read ahead with the message before */
+void test_message_reader_pages()
+{
+	int fds[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	const int count = 100;
+
+	std::thread writer([&] {
+		TcpTransport out(fds[1]);
+		for (int i = 0; i < count; i++) {
+			uint16_t owner = htons((uint16_t)i);
+			std::vector<char> page = pattern(DSM_PAGE_SIZE, i);
+			dsm_header_t small = { DSM_MSG_ACK, 0, 0, htonl(i), 0 };
+			dsm_header_t rep = { DSM_MSG_PAGE_REP, DSM_PAGE_REP_DATA, 0, htonl(i), 0 };
+			assert(out.Send(MsgBuilder(small).Add(owner)));
+			assert(out.Send(MsgBuilder(rep).Add(owner).Add(page.data(), page.size())));
+		}
+	});
+
+	TcpTransport in(fds[0]);
+	MessageReader reader(in);
+	for (int i = 0; i < count; i++) {
+		RpcMessage small, rep;
+		assert(reader.Next(small) && reader.Next(rep));
+		assert(small.payload.size() == sizeof(uint16_t) && small.TakePage() == nullptr);
+		uint16_t owner;
+		assert(rep.Read(&owner, sizeof(owner)) && ntohs(owner) == i);
+		assert(rep.payload.size() == sizeof(owner));
+		char *page = rep.TakePage();
+		assert(page != nullptr && (uintptr_t)page % DSM_PAGE_SIZE == 0);
+		assert(memcmp(page, pattern(DSM_PAGE_SIZE, i).data(), DSM_PAGE_SIZE) == 0);
+	}
+	writer.join();
+}
+
+} // namespace
+
+int main()
+{
+	test_frame_buffer_split_input();
+	test_frame_buffer_raw_pages();
+	test_take_and_read();
+	test_message_reader();
+	test_message_reader_pages();
+
+	std::cout << "All transport tests passed" << std::endl;
+	return 0;
+}
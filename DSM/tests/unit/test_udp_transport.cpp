@@ -0,0 +1,171 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "net/rpc_channel.h"
+#include "net/udp_transport.h"
+
+namespace {
+
+/* A datagram socket on an ephemeral loopback port */
+int bind_loopback(struct sockaddr_in *addr)
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(sock, (struct sockaddr *)addr, sizeof(*addr)) == 0);
+	socklen_t len = sizeof(*addr);
+	assert(getsockname(sock, (struct sockaddr *)addr, &len) == 0);
+	return sock;
+}
+
+int connect_to(const struct sockaddr_in &addr)
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+	assert(connect(sock, (const struct sockaddr *)&addr, sizeof(addr)) == 0);
+	return sock;
+}
+
+std::vector<char> datagram(uint32_t seq, uint32_t total, uint32_t offset, const std::vector<char> &part, uint32_t low_seq)
+{
+	dsm_dgram_t prefix;
+	prefix.header = { DSM_MSG_LOCK_ACQ, 0, 0, htonl(seq), htonl(total) };
+	prefix.offset = htonl(offset);
+	prefix.low_seq = htonl(low_seq);
+	std::vector<char> out(reinterpret_cast<char *>(&prefix), reinterpret_cast<char *>(&prefix) + sizeof(prefix));
+	out.insert(out.end(), part.begin(), part.end());
+	return out;
+}
+
+void test_assembler_reorders_fragments()
+{
+	std::vector<char> payload(DSM_UDP_FRAGMENT * 2 + 100);
+	for (size_t i = 0; i < payload.size(); i++)
+		payload[i] = static_cast<char>(i * 7);
+	auto slice = [&](size_t off) {
+		size_t n = std::min<size_t>(DSM_UDP_FRAGMENT, payload.size() - off);
+		return std::vector<char>(payload.begin() + off, payload.begin() + off + n);
+	};
+
+	DatagramAssembler in;
+	RpcMessage msg;
+	std::vector<char> last = datagram(9, payload.size(), DSM_UDP_FRAGMENT * 2, slice(DSM_UDP_FRAGMENT * 2), 9);
+	std::vector<char> first = datagram(9, payload.size(), 0, slice(0), 9);
+	std::vector<char> middle = datagram(9, payload.size(), DSM_UDP_FRAGMENT, slice(DSM_UDP_FRAGMENT), 9);
+	assert(!in.Add(last.data(), last.size(), msg));
+	assert(!in.Add(first.data(), first.size(), msg));
+	/* A repeated fragment does not count twice */
+	assert(!in.Add(first.data(), first.size(), msg));
+	assert(in.Add(middle.data(), middle.size(), msg));
+	assert(ntohl(msg.header.seq_num) == 9);
+	assert(msg.payload == payload);
+
+	/* A fragment whose length does not match its offset is dropped */
+	std::vector<char> bad = datagram(10, 10, 0, std::vector<char>(4), 10);
+	assert(!in.Add(bad.data(), bad.size(), msg));
+}
+
+void test_round_trip_through_channel()
+{
+	struct sockaddr_in addr;
+	int server = bind_loopback(&addr);
+	RpcChannel *channel = new RpcChannel(std::make_unique<UdpTransport>(connect_to(addr)));
+
+	/* Echo the request back with every byte incremented, large enough to be
+	 * fragmented; the first fragment is lost and comes back by retransmission */
+	std::thread daemon([server] {
+		char buf[sizeof(dsm_dgram_t) + DSM_UDP_FRAGMENT];
+		std::shared_ptr<UdpPeer> peer;
+		bool lost = false;
+		while (true) {
+			struct sockaddr_in from;
+			socklen_t fromlen = sizeof(from);
+			ssize_t n = recvfrom(server, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+			assert(n > 0);
+			if (!lost) {
+				lost = true;
+				continue;
+			}
+			if (peer == nullptr)
+				peer = std::make_shared<UdpPeer>(server, from);
+			RpcMessage req;
+			if (!peer->Deliver(buf, n, req))
+				continue;
+			for (char &c : req.payload)
+				c++;
+			dsm_header_t rep = { DSM_MSG_ACK, 0, 0, req.header.seq_num, 0 };
+			MsgBuilder msg(rep);
+			msg.Add(req.payload.data(), req.payload.size());
+			assert(peer->Send(msg));
+			return;
+		}
+	});
+
+	std::vector<char> body(5000, 'a');
+	dsm_header_t header = { DSM_MSG_LOCK_ACQ, 0, 0, 0, 0 };
+	RpcMessage rep;
+	assert(channel->Call(header, { { body.data(), body.size() } }, rep));
+	assert(rep.header.type == DSM_MSG_ACK);
+	assert(rep.payload == std::vector<char>(5000, 'b'));
+	daemon.join();
+	close(server);
+}
+
+void test_peer_serves_each_request_once()
+{
+	struct sockaddr_in addr;
+	int server = bind_loopback(&addr);
+	int client = connect_to(addr);
+	struct sockaddr_in client_addr;
+	socklen_t len = sizeof(client_addr);
+	assert(getsockname(client, (struct sockaddr *)&client_addr, &len) == 0);
+
+	UdpPeer peer(server, client_addr);
+	std::vector<char> req = datagram(5, 4, 0, std::vector<char>(4, 'x'), 5);
+	RpcMessage msg;
+	assert(peer.Deliver(req.data(), req.size(), msg));
+	/* A retransmission while the request is still being served is dropped */
+	assert(!peer.Deliver(req.data(), req.size(), msg));
+
+	dsm_header_t rep = { DSM_MSG_LOCK_REP, 0, 0, htonl(5), 0 };
+	assert(peer.Send(MsgBuilder(rep)));
+	/* Once answered, a retransmission gets the same reply again */
+	assert(!peer.Deliver(req.data(), req.size(), msg));
+	char buf[sizeof(dsm_dgram_t) + DSM_UDP_FRAGMENT];
+	for (int i = 0; i < 2; i++) {
+		ssize_t n = recv(client, buf, sizeof(buf), 0);
+		assert(n == (ssize_t)sizeof(dsm_dgram_t));
+		dsm_dgram_t got;
+		memcpy(&got, buf, sizeof(got));
+		assert(got.header.type == DSM_MSG_LOCK_REP && ntohl(got.header.seq_num) == 5);
+	}
+
+	/* Once the client is past seq 5, the request is forgotten and stays dropped */
+	std::vector<char> next = datagram(6, 0, 0, std::vector<char>(), 6);
+	assert(peer.Deliver(next.data(), next.size(), msg));
+	assert(!peer.Deliver(req.data(), req.size(), msg));
+
+	close(client);
+	close(server);
+}
+
+} // namespace
+
+int main()
+{
+	test_assembler_reorders_fragments();
+	test_round_trip_through_channel();
+	test_peer_serves_each_request_once();
+	std::cout << "All udp transport tests passed" << std::endl;
+	return 0;
+}
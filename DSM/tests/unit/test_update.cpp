@@ -22,7 +22,8 @@ int main() {
     int sock = connect_server();
     if (sock < 0) { std::cerr << "Connect failed" << std::endl; return 1; }
 
-    uint32_t test_page_id = 999;
+    // 共享区从 0x4000000000 开始（dsm_init），Manager 只认区内的页；单节点时 Node 0 是它的 Manager
+    uint32_t test_page_id = (0x4000000000ULL >> 12) + 7;
     uint16_t new_owner_id = 5; // 我们要篡改的目标 Owner
 
     // -------------------------------------------------------
@@ -30,34 +31,51 @@ int main() {
     // -------------------------------------------------------
     std::cout << "[Step 1] Sending UPDATE: Page " << test_page_id << " -> Node " << new_owner_id << std::endl;
 
-    dsm_header_t upd_head = {0};
+    // 报文头与负载的各字段都是网络字节序
+    dsm_header_t upd_head = {};
     upd_head.type = DSM_MSG_OWNER_UPDATE;
-    upd_head.src_node_id = 2; // 模拟我是 Node 2
-    upd_head.payload_len = sizeof(payload_owner_update_t);
-    upd_head.unused = 0; // 0 表示 Page Update (根据 dsm_misc.cpp 的约定)
+    upd_head.src_node_id = htons(2); // 模拟我是 Node 2
+    upd_head.seq_num = htonl(1);
+    upd_head.payload_len = htonl(sizeof(payload_owner_update_batch_t) + sizeof(payload_owner_update_t));
 
-    payload_owner_update_t upd_body;
-    upd_body.resource_id = test_page_id;
-    upd_body.new_owner_id = new_owner_id;
+    payload_owner_update_batch_t upd_batch = {};
+    upd_batch.count = htonl(1);
+
+    // Manager 只接受不早于目录中版本的 WRITER 更新，新页面的版本为 0
+    payload_owner_update_t upd_body = {};
+    upd_body.resource_id = htonl(test_page_id);
+    upd_body.new_owner_id = htons(new_owner_id);
+    upd_body.kind = DSM_OWNER_UPDATE_WRITER;
+    upd_body.version = htonl(1);
 
     write(sock, &upd_head, sizeof(upd_head));
+    write(sock, &upd_batch, sizeof(upd_batch));
     write(sock, &upd_body, sizeof(upd_body));
 
-    // 给 Manager 一点点时间处理 (微秒级即可)
-    usleep(10000); 
+    // 等待 ACK：负载为每条更新一个字节
+    dsm_header_t ack_head;
+    uint8_t accepted = 0;
+    if (read(sock, &ack_head, sizeof(ack_head)) != sizeof(ack_head) || ack_head.type != DSM_MSG_ACK
+        || read(sock, &accepted, sizeof(accepted)) != sizeof(accepted) || accepted != 1) {
+        std::cerr << "[FAIL] OWNER_UPDATE not acknowledged" << std::endl;
+        close(sock);
+        return 1;
+    }
+    std::cout << "[PASS] OWNER_UPDATE accepted" << std::endl;
 
     // -------------------------------------------------------
     // 步骤 2: 发送 REQ 消息 (验证 Manager 是否更新了记录)
     // -------------------------------------------------------
     std::cout << "[Step 2] Sending PAGE_REQ for Page " << test_page_id << "..." << std::endl;
 
-    dsm_header_t req_head = {0};
+    dsm_header_t req_head = {};
     req_head.type = DSM_MSG_PAGE_REQ;
-    req_head.src_node_id = 2; 
-    req_head.payload_len = sizeof(payload_page_req_t);
+    req_head.src_node_id = htons(2);
+    req_head.seq_num = htonl(2);
+    req_head.payload_len = htonl(sizeof(payload_page_req_t));
     
-    payload_page_req_t req_body;
-    req_body.page_index = test_page_id;
+    payload_page_req_t req_body = {};
+    req_body.page_index = htonl(test_page_id);
 
     write(sock, &req_head, sizeof(req_head));
     write(sock, &req_body, sizeof(req_body));
@@ -73,16 +91,20 @@ int main() {
         if (rep_head.unused == 0) {
             std::cout << "[PASS] Received Redirect (unused=0)" << std::endl;
             
-            payload_page_rep_t rep_body;
-            read(sock, &rep_body, sizeof(rep_body));
+            // 重定向只带 real_owner_id 与 version，没有页面数据
+            uint16_t real_owner_id = 0;
+            uint32_t version = 0;
+            read(sock, &real_owner_id, sizeof(real_owner_id));
+            read(sock, &version, sizeof(version));
+            real_owner_id = ntohs(real_owner_id);
             
-            std::cout << "  -> Redirected to Node: " << rep_body.requester_id << std::endl;
+            std::cout << "  -> Redirected to Node: " << real_owner_id << std::endl;
 
-            if (rep_body.requester_id == new_owner_id) {
+            if (real_owner_id == new_owner_id) {
                 std::cout << "[PASS] Target matches the updated owner (" << new_owner_id << ")!" << std::endl;
             } else {
                 std::cerr << "[FAIL] Target mismatch! Expected " << new_owner_id 
-                          << ", got " << rep_body.requester_id << std::endl;
+                          << ", got " << real_owner_id << std::endl;
             }
 
         } else {
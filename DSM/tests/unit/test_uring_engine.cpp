@@ -0,0 +1,123 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "net/rpc_channel.h"
+#include "net/uring_engine.h"
+
+namespace {
+
+/* Echoes the payload back under the request's seq_num. LOCK_ACQ is answered
+ * on the loop thread, PAGE_REQ from another thread, anything else drops the
+ * connection. */
+bool echo(const std::shared_ptr<Transport> &peer, RpcMessage &msg)
+{
+	dsm_header_t rep = { DSM_MSG_ACK, 0, 0, msg.header.seq_num, 0 };
+	switch (msg.header.type) {
+	case DSM_MSG_LOCK_ACQ:
+		assert(peer->Send(MsgBuilder(rep).Add(msg.payload.data(), msg.payload.size())));
+		return true;
+	case DSM_MSG_PAGE_REQ:
+		std::thread([peer, rep, payload = std::move(msg.payload)] {
+			assert(peer->Send(MsgBuilder(rep).Add(payload.data(), payload.size())));
+		}).detach();
+		return true;
+	default:
+		return false;
+	}
+}
+
+int listen_any(int *port)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(sock, 16) == 0);
+	socklen_t len = sizeof(addr);
+	assert(getsockname(sock, (struct sockaddr *)&addr, &len) == 0);
+	*port = ntohs(addr.sin_port);
+	return sock;
+}
+
+int connect_to(int port)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	return sock;
+}
+
+std::vector<char> pattern(size_t len, int seed)
+{
+	std::vector<char> v(len);
+	for (size_t i = 0; i < len; i++)
+		v[i] = (char)(i * 7 + seed);
+	return v;
+}
+
+/* Many requests in flight, some larger than a receive buffer, answered from
+ * both the loop and other threads */
+void test_pipelined_echo(int port)
+{
+	RpcChannel *channel = new RpcChannel(std::make_unique<TcpTransport>(connect_to(port)));
+	const int count = 600;
+	std::vector<std::vector<char>> bodies;
+	std::vector<uint32_t> seqs;
+	for (int i = 0; i < count; i++) {
+		size_t len = (i % 50 == 0) ? 3 * DSM_URING_BUFFER_SIZE + 5 : 4 + i % 300;
+		bodies.push_back(pattern(len, i));
+		dsm_header_t header = { (uint8_t)(i % 3 ? DSM_MSG_LOCK_ACQ : DSM_MSG_PAGE_REQ), 0, 0, 0, 0 };
+		seqs.push_back(channel->Send(header, { { bodies.back().data(), len } }));
+		assert(seqs.back() != 0);
+	}
+	for (int i = 0; i < count; i++) {
+		RpcMessage rep;
+		assert(channel->Wait(seqs[i], rep));
+		assert(rep.header.type == DSM_MSG_ACK);
+		assert(rep.payload == bodies[i]);
+	}
+}
+
+void test_unknown_message_drops(int port)
+{
+	int sock = connect_to(port);
+	dsm_header_t header = { 0xEE, 0, 0, htonl(1), 0 };
+	assert(MsgBuilder(header).Send(sock));
+	char byte;
+	assert(read(sock, &byte, 1) == 0);
+	close(sock);
+}
+
+} // namespace
+
+int main()
+{
+	std::unique_ptr<UringEngine> engine = UringEngine::Create();
+	if (engine == nullptr) {
+		std::cout << "io_uring not available, uring engine tests skipped" << std::endl;
+		return 0;
+	}
+
+	int port;
+	int listenfd = listen_any(&port);
+	UringEngine *loop = engine.release();   /* Run never returns */
+	std::thread([loop, listenfd] { loop->Run(listenfd, echo); }).detach();
+
+	test_pipelined_echo(port);
+	test_unknown_message_drops(port);
+	test_pipelined_echo(port);
+
+	std::cout << "All uring engine tests passed" << std::endl;
+	return 0;
+}
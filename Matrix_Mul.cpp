@@ -37,7 +37,7 @@ int main() {
     int *B = (int *)dsm_malloc("$HOME/dsm/B", nullptr);
     int *C = (int *)dsm_malloc("$HOME/dsm/C", nullptr);
 
-    int lock_A = dsm_mutex_init();
+    int lock_A = dsm_rwlock_init();
     
     
     dsm_barrier();
@@ -59,10 +59,11 @@ int main() {
     //std::cout << "[Pod " << myrank << "] Processing rows " << start_row << " to " << end_row - 1 << std::endl;
     
     // 加锁后拷贝矩阵A和B到本地，然后立即释放锁
-    //dsm_mutex_lock(&lock_A);
+    // 只读不写，用读锁，各进程的拷贝互不等待
+    dsm_rwlock_rdlock(&lock_A);
     memcpy(local_A, A, M * K * sizeof(int));
     memcpy(local_B, B, K * N * sizeof(int));
-    //dsm_mutex_unlock(&lock_A);
+    dsm_rwlock_unlock(&lock_A);
     
     // 初始化本地结果矩阵C为0
     memset(local_C, 0, M * N * sizeof(int));
@@ -91,19 +92,19 @@ int main() {
     dsm_barrier();
     
     // 加锁后将本进程计算的结果写回共享内存C
-    dsm_mutex_lock(&lock_A);
+    dsm_rwlock_wrlock(&lock_A);
     for (int i = start_row; i < end_row; i++) {
         for (int j = 0; j < N; j++) {
             C[i * N + j] = local_C[i * N + j];
         }
     }
-    dsm_mutex_unlock(&lock_A);
+    dsm_rwlock_unlock(&lock_A);
     
     dsm_barrier();
     
     // 进程0输出结果矩阵
     if (myrank == 0) {
-        dsm_mutex_lock(&lock_A);
+        dsm_rwlock_rdlock(&lock_A);
         std::cout << "\n[Result] Matrix C = A * B:" << std::endl;
         for (int i = 0; i < M; i++) {
             for (int j = 0; j < N; j++) {
@@ -111,7 +112,7 @@ int main() {
             }
             std::cout << std::endl;
         }
-        dsm_mutex_unlock(&lock_A);
+        dsm_rwlock_unlock(&lock_A);
     }
     
     // 释放本地分配的内存